@@ -21,7 +21,7 @@ limitations under the License.
 #include <memory>
 #include <functional>
 
-#include <boost/any.hpp>
+#include <boost/optional.hpp>
 
 #include "utility/unique_ptr.hpp"
 
@@ -31,6 +31,7 @@ limitations under the License.
 #include "math/sequence.hpp"
 #include "math/product.hpp"
 
+#include "flipsta/core/dense.hpp"
 #include "flipsta/automaton.hpp"
 
 #include "symbol_table.hpp"
@@ -43,108 +44,256 @@ namespace detail {
     typedef typename Alphabet::dense_symbol_type Symbol;
     typedef math::optional_sequence <std::string> OptionalSequence;
     typedef math::empty_sequence <std::string> EmptySymbol;
-    typedef math::cost <double> Weight;
 
-    typedef math::product <math::over <
-        OptionalSequence, OptionalSequence, Weight>> Label;
+    /// The weight type used if none is given: the tropical semiring.
+    typedef math::cost <double> Weight;
 
     typedef std::size_t State;
 
-    typedef math::product <math::over <
-        EmptySymbol, EmptySymbol, Weight>> TerminalLabel;
+    /**
+    The symbol type used when the symbols in the file are kept as integers.
+    Zero, which indicates the empty symbol in the file, never occurs as a
+    symbol.
+    */
+    typedef Dense <unsigned> IntegerSymbol;
+
+    /** \brief
+    Compute the label types and the automaton type for AT&T automata with
+    weight type \a Weight.
+
+    \tparam ExternalSymbol
+        The type of symbols: std::string if the symbols are converted using a
+        symbol table; IntegerSymbol if they are kept as they are in the file.
+    */
+    template <class Weight, class ExternalSymbol = std::string>
+        struct AutomatonTypes
+    {
+        typedef math::optional_sequence <ExternalSymbol> OptionalSequence;
+        typedef math::empty_sequence <ExternalSymbol> EmptySymbol;
+
+        typedef math::product <math::over <
+            OptionalSequence, OptionalSequence, Weight>> Label;
+
+        typedef math::product <math::over <
+            EmptySymbol, EmptySymbol, Weight>> TerminalLabel;
 
-    typedef flipsta::Automaton <State, Label, TerminalLabel> Automaton;
+        typedef flipsta::Automaton <State, Label, TerminalLabel> Automaton;
+    };
+
+    typedef AutomatonTypes <Weight>::Label Label;
+    typedef AutomatonTypes <Weight>::TerminalLabel TerminalLabel;
+    typedef AutomatonTypes <Weight>::Automaton Automaton;
+
+    /** \brief
+    Default conversion from the number in the file to a weight: call the
+    constructor.
+    */
+    template <class Weight> struct ConvertWeight {
+        Weight operator() (double value) const { return Weight (value); }
+    };
 
-    class AutomatonWrapper {
+    /** \brief
+    Interface between the parser, which is compiled into the library, and the
+    automaton, the type of which is only known in the header.
+
+    This is called once for each line in the file.
+    The weight is passed as it was read, and converted by the implementation.
+
+    \tparam OptionalSequence
+        The type of the input and output symbols on arcs.
+    */
+    template <class OptionalSequence> class AutomatonWrapper {
     public:
-        virtual boost::any one() const = 0;
-        virtual boost::any weight (double) const = 0;
-        virtual bool hasState (State) const = 0;
-        virtual void addState (State) = 0;
-        virtual void addArc (State, State, OptionalSequence, OptionalSequence,
-            boost::any const &) = 0;
-        virtual void setStartState (State) = 0;
-        virtual void setFinalState (State, boost::any const &) = 0;
+        virtual void addArc (State source, State destination,
+            OptionalSequence && input, OptionalSequence && output,
+            boost::optional <double> const & weight) = 0;
+        virtual void addFinalState (State state,
+            boost::optional <double> const & weight) = 0;
     };
 
-    template <class Weight, class Automaton> class WrappedAutomaton
-    : public AutomatonWrapper
+    template <class Types, class Weight, class ConvertWeight>
+        class WrappedAutomaton
+    : public AutomatonWrapper <typename Types::OptionalSequence>
     {
+        typedef typename Types::OptionalSequence OptionalSequence;
+        typedef typename Types::EmptySymbol EmptySymbol;
+        typedef typename Types::Label Label;
+        typedef typename Types::TerminalLabel TerminalLabel;
+        typedef typename Types::Automaton Automaton;
+
         Automaton & automaton_;
-    public:
-        WrappedAutomaton (Automaton & automaton) : automaton_ (automaton) {}
+        ConvertWeight convertWeight_;
+        bool seenState_;
 
-        boost::any one() const { return math::one <Weight>(); }
-        boost::any weight (double d) const  { return Weight (d); }
-        bool hasState (State s) const { return automaton_.hasState (s); }
-        void addState (State s) { automaton_.addState (s); }
+        Weight weight (boost::optional <double> const & representation) const
+        {
+            if (representation)
+                return convertWeight_ (representation.get());
+            else
+                return math::one <Weight>();
+        }
+
+        void ensureState (State state) {
+            if (!automaton_.hasState (state))
+                automaton_.addState (state);
+        }
+
+    public:
+        WrappedAutomaton (Automaton & automaton, ConvertWeight convertWeight)
+        : automaton_ (automaton), convertWeight_ (convertWeight),
+            seenState_ (false) {}
 
         void addArc (State source, State destination,
-            OptionalSequence input, OptionalSequence output,
-            boost::any const & weight)
+            OptionalSequence && input, OptionalSequence && output,
+            boost::optional <double> const & weight)
         {
+            ensureState (source);
+            if (!seenState_) {
+                // The first state is automatically the start state.
+                automaton_.setTerminalLabel (
+                    forward, source, math::one <Label>());
+                seenState_ = true;
+            }
+            ensureState (destination);
+
             automaton_.addArc (source, destination,
-                Label (input, output, boost::any_cast <Weight> (weight)));
+                Label (std::move (input), std::move (output),
+                    this->weight (weight)));
         }
 
-        void setStartState (State s)
-        { automaton_.setTerminalLabel (forward, s, math::one <Label>()); }
-
-        void setFinalState (State s, boost::any const & weight) {
-            automaton_.setTerminalLabel (backward, s,
-                Label (EmptySymbol(), EmptySymbol(),
-                    boost::any_cast <Weight> (weight)));
+        void addFinalState (State state,
+            boost::optional <double> const & weight)
+        {
+            ensureState (state);
+            automaton_.setTerminalLabel (backward, state,
+                TerminalLabel (EmptySymbol(), EmptySymbol(),
+                    this->weight (weight)));
         }
     };
 
     void readAutomaton (
-        std::string const & fileName, AutomatonWrapper & wrapper,
+        std::string const & fileName,
+        AutomatonWrapper <OptionalSequence> & wrapper,
         SymbolTable const & inputSymbolTable,
         SymbolTable const & outputSymbolTable);
 
+    void readAutomaton (
+        std::string const & fileName,
+        AutomatonWrapper <math::optional_sequence <IntegerSymbol>> & wrapper);
+
 } // namespace detail
 
 
 /** \brief
 Read an automaton from a file in AT&T format.
 
-The weights are currently assumed to be StdWeights, i.e. math::cost \<double>.
+The weights in the file are read as floating-point numbers, and then converted
+into \a Weight by \a convertWeight.
+By default, \a Weight is math::cost \<double>, i.e. the weights are taken to be
+StdWeights.
+For example, <c>readAutomaton \<math::cost \<float>> (...)</c> reads the same
+file but uses half the memory for the weights.
 
 The symbol tables can be the same, if the input and output alphabets are the
 same.
 
+\tparam Weight
+    The weight type, which becomes the third component of the labels.
+\tparam ConvertWeight
+    The type of the function object that converts the \c double from the file
+    into \a Weight.
+    By default, this calls the constructor of \a Weight.
+    For weights that cannot be constructed from a \c double (a
+    math::lexicographical or math::product, say), a function object must be
+    passed in.
+
+\param file_name
+    The name of the file to read.
+\param inputSymbolTable
+    The symbol table for the input symbols.
+\param outputSymbolTable
+    The symbol table for the output symbols.
+\param convertWeight
+    (optional) The function object that converts a \c double into \a Weight.
+
 \todo The symbol mapping merely needs to indicate what the empty symbol is, and
 an alphabet needs to be passed to the automaton's label descriptor.
-Allow for these two cases:
-\li The symbols in the file are strings, but the symbol table should be built as
-    the symbols are encountered.
-    This should be initialised with an empty symbol (\<eps>, typically).
-\li The symbols in the file are dense integers, and should be saved as such.
-    In that case, there should be no alphabet descriptor at all, and "0" should
-    map to the empty sequence.
+Allow for the case where the symbols in the file are strings, but the symbol
+table should be built as the symbols are encountered.
+This should be initialised with an empty symbol (\<eps>, typically).
+(For symbols that are dense integers, use readAutomatonWithIntegerSymbols.)
 
 \todo Maybe it should be possible to read automata while guaranteeing that no
 symbols are actually empty?
-
-\todo Allow for different semirings.
 */
-inline std::unique_ptr <detail::Automaton>
+template <class Weight = detail::Weight,
+    class ConvertWeight = detail::ConvertWeight <Weight>>
+inline std::unique_ptr <typename detail::AutomatonTypes <Weight>::Automaton>
     readAutomaton (std::string const & file_name,
         SymbolTable const & inputSymbolTable,
-        SymbolTable const & outputSymbolTable)
+        SymbolTable const & outputSymbolTable,
+        ConvertWeight convertWeight = ConvertWeight())
 {
-    typedef detail::Automaton Automaton;
+    typedef detail::AutomatonTypes <Weight> Types;
+    typedef typename Types::Automaton Automaton;
     typedef typename DescriptorType <Automaton>::type Descriptor;
 
     auto result = utility::make_unique <Automaton> (
         Descriptor (inputSymbolTable.alphabet(), outputSymbolTable.alphabet(),
             label::NoDescriptor()));
-    detail::WrappedAutomaton <detail::Weight, Automaton> wrapper (*result);
+    detail::WrappedAutomaton <Types, Weight, ConvertWeight> wrapper (
+        *result, convertWeight);
     detail::readAutomaton (
         file_name, wrapper, inputSymbolTable, outputSymbolTable);
     return std::move (result);
 }
 
+/** \brief
+Read an automaton from a file in AT&T format, keeping the symbols as the
+integers in the file.
+
+No symbol table is required.
+The symbol columns are read as unsigned integers, and stored directly as
+Dense \<unsigned> symbols, so that reading an arc does not require allocating
+strings or looking up symbols in an alphabet.
+The symbol "0" is taken to be the empty symbol, and maps to the empty sequence.
+The labels therefore do not have an alphabet descriptor.
+
+If the names of the symbols are required, for example to print out a path, the
+symbol table can be read separately with readSymbolTable.
+Symbol \c n in the automaton then corresponds to the symbol with index \c n in
+the symbol table.
+
+The weights are handled as for readAutomaton.
+
+\tparam Weight
+    The weight type, which becomes the third component of the labels.
+\tparam ConvertWeight
+    The type of the function object that converts the \c double from the file
+    into \a Weight.
+
+\param file_name
+    The name of the file to read.
+\param convertWeight
+    (optional) The function object that converts a \c double into \a Weight.
+*/
+template <class Weight = detail::Weight,
+    class ConvertWeight = detail::ConvertWeight <Weight>>
+inline std::unique_ptr <typename detail::AutomatonTypes <
+    Weight, detail::IntegerSymbol>::Automaton>
+    readAutomatonWithIntegerSymbols (std::string const & file_name,
+        ConvertWeight convertWeight = ConvertWeight())
+{
+    typedef detail::AutomatonTypes <Weight, detail::IntegerSymbol> Types;
+    typedef typename Types::Automaton Automaton;
+
+    auto result = utility::make_unique <Automaton>();
+    detail::WrappedAutomaton <Types, Weight, ConvertWeight> wrapper (
+        *result, convertWeight);
+    detail::readAutomaton (file_name, wrapper);
+    return std::move (result);
+}
+
 }} // namespace flipsta::att
 
 #endif // FLIPSTA_ATT_AUTOMATON_HPP_INCLUDED
@@ -57,12 +57,12 @@ public:
     Automaton automaton_;
 
 private:
-    static std::shared_ptr <State const> unityState (
+    static detail::SolePtr <State> unityState (
         Memo * memo, Key const & key)
     {
-        std::map <Key, Automaton> arcs;
-        arcs.insert (std::make_pair (key,
-            Automaton (math::one <Weight>(), State::finalState())));
+        typename State::Arcs arcs;
+        arcs.emplace_back (key,
+            Automaton (math::one <Weight>(), State::finalState()));
         return memo->get (State (
             memo, math::zero <Weight>(), std::move (arcs)));
     }
@@ -134,6 +134,13 @@ namespace label {
 
     Its main purpose is to keep the memo (which keeps states minimised and
     optimises the union operation) alive as long as the labels need it.
+
+    To build automata from multiple threads at the same time, pass in a memo
+    that is constructed with \c concurrent set to \c true:
+    \code
+    AutomatonSemiringTag <Key, Weight> tag (
+        std::make_shared <SharedAutomatonMemo <Key, Weight>> (true));
+    \endcode
     */
     template <class Key, class Weight> class AutomatonSemiringTag {
         typedef SharedAutomatonMemo <Key, Weight> Memo;
@@ -15,12 +15,15 @@ limitations under the License.
 */
 
 /** \file
-Provide hash_value for types that Boost does not provide it for.
+Provide hash_value for types that Boost does not provide it for, and a
+function to combine hash values.
 */
 
 #ifndef FLIPSTA_CORE_HASH_HELPER_HPP_INCLUDED
 #define FLIPSTA_CORE_HASH_HELPER_HPP_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
 #include <boost/version.hpp>
@@ -40,4 +43,26 @@ namespace boost {
 
 } // namespace boost
 
+namespace flipsta { namespace detail {
+
+    /** \brief
+    Combine \a value into the hash value \a seed.
+
+    This is like boost::hash_combine, but it mixes all 64 bits, so that values
+    that differ only in a few bits, like pointers and small integers, still
+    spread over the whole range.
+    This matters for hash values that are themselves combined again, like
+    those of states in an automaton.
+    */
+    inline void combineHash (std::size_t & seed, std::size_t value) {
+        std::uint64_t x = std::uint64_t (seed)
+            + 0x9e3779b97f4a7c15ull + std::uint64_t (value);
+        // The finaliser of SplitMix64.
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        seed = std::size_t (x ^ (x >> 31));
+    }
+
+}} // namespace flipsta::detail
+
 #endif // FLIPSTA_CORE_HASH_HELPER_HPP_INCLUDED
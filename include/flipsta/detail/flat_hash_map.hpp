@@ -0,0 +1,355 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_DETAIL_FLAT_HASH_MAP_HPP_INCLUDED
+#define FLIPSTA_DETAIL_FLAT_HASH_MAP_HPP_INCLUDED
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <functional>
+
+#include <boost/functional/hash.hpp>
+
+namespace flipsta { namespace detail {
+
+    /** \brief
+    Hash map that stores its entries in one array, using open addressing.
+
+    This uses Robin Hood hashing: when inserting, an entry that is further away
+    from its home slot takes the place of one that is closer to its home slot.
+    This keeps probe sequences short, and makes it possible to stop looking for
+    a key as soon as an entry is found that is closer to its home slot than the
+    key would be.
+    Erasing an entry shifts the following entries in the same cluster back by
+    one slot, so that no tombstones are needed.
+
+    Unlike std::unordered_map, this does not allocate memory for each entry.
+    Pointers to values are invalidated by any insertion or erasure.
+
+    \tparam Key
+        The key type.
+        This must be copy-constructible and move-assignable.
+    \tparam Value
+        The value type.
+        This must be copy-constructible and move-assignable.
+    \tparam Hash
+        The hash function.
+        The result is mixed before use, so it is fine if it is the identity.
+    \tparam Equal
+        The equality comparison for keys.
+    */
+    template <class Key, class Value, class Hash = boost::hash <Key>,
+        class Equal = std::equal_to <Key>>
+    class FlatHashMap
+    {
+        typedef std::pair <Key, Value> Entry;
+        typedef std::allocator <Entry> Allocator;
+
+        static std::size_t constexpr notFound = std::size_t (-1);
+
+        /**
+        For each slot, one more than its distance from its home slot, or 0 if
+        the slot is empty.
+        */
+        std::vector <std::uint32_t> distances_;
+        Entry * entries_;
+        std::size_t size_;
+        // log2 of the capacity.
+        unsigned capacityBits_;
+
+        Hash hash_;
+        Equal equal_;
+
+        std::size_t capacity() const { return distances_.size(); }
+        std::size_t mask() const { return capacity() - 1; }
+
+        /**
+        Return the slot at which \a key would ideally be.
+        Fibonacci hashing is used to mix the bits of the hash value, so that
+        identity hashes of integers and pointers still spread well.
+        */
+        std::size_t home (Key const & key) const {
+            std::uint64_t hash = std::uint64_t (hash_ (key));
+            return std::size_t (
+                (hash * 0x9E3779B97F4A7C15ull) >> (64 - capacityBits_));
+        }
+
+        std::size_t findIndex (Key const & key) const {
+            if (size_ == 0)
+                return notFound;
+            std::size_t index = home (key);
+            for (std::uint32_t distance = 1; ; ++ distance) {
+                std::uint32_t slotDistance = distances_ [index];
+                // If the slot is empty (0) or is closer to its home than the
+                // key would be, the key is not in the map.
+                if (slotDistance < distance)
+                    return notFound;
+                if (slotDistance == distance
+                        && equal_ (entries_ [index].first, key))
+                    return index;
+                index = (index + 1) & mask();
+            }
+        }
+
+        /**
+        Insert an entry that is known not to be in the map yet.
+        \pre There is room for it.
+        */
+        void insertNew (Entry && entry) {
+            std::size_t index = home (entry.first);
+            std::uint32_t distance = 1;
+            while (true) {
+                if (distances_ [index] == 0) {
+                    ::new (static_cast <void *> (entries_ + index))
+                        Entry (std::move (entry));
+                    distances_ [index] = distance;
+                    ++ size_;
+                    return;
+                }
+                if (distances_ [index] < distance) {
+                    // Robin Hood: take from the rich.
+                    using std::swap;
+                    swap (entry, entries_ [index]);
+                    swap (distance, distances_ [index]);
+                }
+                index = (index + 1) & mask();
+                ++ distance;
+            }
+        }
+
+        void destroyEntries() {
+            if (size_ != 0) {
+                for (std::size_t index = 0; index != capacity(); ++ index) {
+                    if (distances_ [index] != 0) {
+                        entries_ [index].~Entry();
+                        distances_ [index] = 0;
+                    }
+                }
+            }
+            size_ = 0;
+        }
+
+        void deallocate() {
+            destroyEntries();
+            if (entries_)
+                Allocator().deallocate (entries_, capacity());
+            entries_ = nullptr;
+            distances_.clear();
+            capacityBits_ = 0;
+        }
+
+        /**
+        Set the capacity to 2 ^ \a bits and move all entries into the new
+        array.
+        */
+        void rehash (unsigned bits) {
+            std::size_t newCapacity = std::size_t (1) << bits;
+            std::vector <std::uint32_t> oldDistances (newCapacity, 0);
+            oldDistances.swap (distances_);
+            Entry * oldEntries = entries_;
+            entries_ = Allocator().allocate (newCapacity);
+            capacityBits_ = bits;
+            size_ = 0;
+
+            for (std::size_t index = 0; index != oldDistances.size(); ++ index)
+            {
+                if (oldDistances [index] != 0) {
+                    insertNew (std::move (oldEntries [index]));
+                    oldEntries [index].~Entry();
+                }
+            }
+            if (oldEntries)
+                Allocator().deallocate (oldEntries, oldDistances.size());
+        }
+
+        /// Return whether \a size entries fit at a load factor of at most 0.8.
+        bool fits (std::size_t size) const
+        { return size * 5 <= capacity() * 4; }
+
+    public:
+        FlatHashMap()
+        : entries_ (nullptr), size_ (0), capacityBits_ (0) {}
+
+        FlatHashMap (FlatHashMap const & that)
+        : distances_ (that.distances_), entries_ (nullptr), size_ (0),
+            capacityBits_ (that.capacityBits_),
+            hash_ (that.hash_), equal_ (that.equal_)
+        {
+            if (that.entries_) {
+                entries_ = Allocator().allocate (capacity());
+                // The hash function is the same, so entries can go in the same
+                // slots.
+                for (std::size_t index = 0; index != capacity(); ++ index) {
+                    if (distances_ [index] != 0) {
+                        try {
+                            ::new (static_cast <void *> (entries_ + index))
+                                Entry (that.entries_ [index]);
+                        } catch (...) {
+                            // Only keep the entries that have been constructed.
+                            std::fill (distances_.begin() + index,
+                                distances_.end(), 0);
+                            deallocate();
+                            throw;
+                        }
+                        ++ size_;
+                    }
+                }
+                assert (size_ == that.size_);
+            }
+        }
+
+        FlatHashMap (FlatHashMap && that)
+        : distances_ (std::move (that.distances_)), entries_ (that.entries_),
+            size_ (that.size_), capacityBits_ (that.capacityBits_),
+            hash_ (std::move (that.hash_)), equal_ (std::move (that.equal_))
+        {
+            that.distances_.clear();
+            that.entries_ = nullptr;
+            that.size_ = 0;
+            that.capacityBits_ = 0;
+        }
+
+        ~FlatHashMap() { deallocate(); }
+
+        FlatHashMap & operator= (FlatHashMap const & that) {
+            if (this != &that) {
+                FlatHashMap copy (that);
+                swap (copy);
+            }
+            return *this;
+        }
+
+        FlatHashMap & operator= (FlatHashMap && that) {
+            if (this != &that) {
+                deallocate();
+                swap (that);
+            }
+            return *this;
+        }
+
+        void swap (FlatHashMap & that) {
+            using std::swap;
+            swap (distances_, that.distances_);
+            swap (entries_, that.entries_);
+            swap (size_, that.size_);
+            swap (capacityBits_, that.capacityBits_);
+            swap (hash_, that.hash_);
+            swap (equal_, that.equal_);
+        }
+
+        std::size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        /**
+        Make sure that \a size entries can be held without reallocation.
+        */
+        void reserve (std::size_t size) {
+            if (capacity() != 0 && fits (size))
+                return;
+            unsigned bits = capacityBits_ == 0 ? 3 : capacityBits_;
+            while ((std::size_t (1) << bits) * 4 < size * 5)
+                ++ bits;
+            if (bits != capacityBits_)
+                rehash (bits);
+        }
+
+        /**
+        Remove all entries, but keep the memory allocated.
+        */
+        void clear() { destroyEntries(); }
+
+        bool contains (Key const & key) const
+        { return findIndex (key) != notFound; }
+
+        /**
+        Return a pointer to the value for \a key, or a null pointer if \a key
+        is not in the map.
+        */
+        Value const * find (Key const & key) const {
+            std::size_t index = findIndex (key);
+            if (index == notFound)
+                return nullptr;
+            return &entries_ [index].second;
+        }
+
+        Value * find (Key const & key) {
+            std::size_t index = findIndex (key);
+            if (index == notFound)
+                return nullptr;
+            return &entries_ [index].second;
+        }
+
+        /**
+        Set the value for \a key to \a value, inserting \a key if necessary.
+        */
+        void set (Key const & key, Value const & value) {
+            std::size_t index = findIndex (key);
+            if (index != notFound) {
+                entries_ [index].second = value;
+                return;
+            }
+            if (capacity() == 0 || !fits (size_ + 1))
+                reserve (size_ == 0 ? 1 : size_ * 2);
+            insertNew (Entry (key, value));
+        }
+
+        /**
+        Remove \a key from the map.
+        \return \c true iff \a key was in the map.
+        */
+        bool erase (Key const & key) {
+            std::size_t index = findIndex (key);
+            if (index == notFound)
+                return false;
+
+            // Shift the following entries that are not in their home slot
+            // back by one.
+            std::size_t next = (index + 1) & mask();
+            while (distances_ [next] > 1) {
+                entries_ [index] = std::move (entries_ [next]);
+                distances_ [index] = distances_ [next] - 1;
+                index = next;
+                next = (next + 1) & mask();
+            }
+            entries_ [index].~Entry();
+            distances_ [index] = 0;
+            -- size_;
+            return true;
+        }
+
+        /**
+        Call \a function with each key and value.
+        */
+        template <class Function> void forEach (Function && function) const {
+            for (std::size_t index = 0; index != capacity(); ++ index)
+                if (distances_ [index] != 0)
+                    function (entries_ [index].first, entries_ [index].second);
+        }
+    };
+
+    template <class Key, class Value, class Hash, class Equal>
+        inline void swap (FlatHashMap <Key, Value, Hash, Equal> & left,
+            FlatHashMap <Key, Value, Hash, Equal> & right)
+    { left.swap (right); }
+
+}} // namespace flipsta::detail
+
+#endif // FLIPSTA_DETAIL_FLAT_HASH_MAP_HPP_INCLUDED
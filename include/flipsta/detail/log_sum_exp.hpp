@@ -0,0 +1,215 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compute log (exp (a) + exp (b) + ...) for arrays of floating-point numbers.
+
+If the compiler targets AVX2 (for example, with -mavx2 or -march=native), and
+FLIPSTA_NO_SIMD is not defined, the fast approximation for float uses AVX2
+instructions.
+*/
+
+#ifndef FLIPSTA_DETAIL_LOG_SUM_EXP_HPP_INCLUDED
+#define FLIPSTA_DETAIL_LOG_SUM_EXP_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#if defined (__AVX2__) && !defined (FLIPSTA_NO_SIMD)
+#   define FLIPSTA_LOG_SUM_EXP_AVX2 1
+#   include <immintrin.h>
+#endif
+
+namespace flipsta {
+
+/** \brief
+Indicate how accurately the sum of values in the log domain is computed.
+*/
+enum class LogAddAccuracy {
+    /// Use std::exp and std::log.
+    exact,
+    /// Approximate exp with a polynomial, which can be vectorised.
+    /// The relative error is around 1e-7 for float and 1e-12 for double.
+    fast
+};
+
+namespace detail {
+
+    /*
+    The fast approximations of exp split x into n * log(2) + r, with
+    |r| <= log(2) / 2, and compute exp (r) with a polynomial.
+    The result is then multiplied by 2^n by adding n to the exponent bits.
+    The argument is clamped so that the result is a normal number; since the
+    values are relative to the maximum, smaller values do not contribute
+    anything noticeable to the sum anyway.
+    The constants are from the Cephes library.
+    */
+
+    /**
+    Return an approximation of exp (x).
+    \pre x <= 0.
+    */
+    inline float fastExp (float x) {
+        if (x < -87.f)
+            x = -87.f;
+        float n = std::floor (x * 1.44269504088896341f + .5f);
+        // log(2) split into two parts for precision.
+        float r = x - n * 0.693359375f - n * -2.12194440e-4f;
+        float p = 1.9875691500e-4f;
+        p = p * r + 1.3981999507e-3f;
+        p = p * r + 8.3334519073e-3f;
+        p = p * r + 4.1665795894e-2f;
+        p = p * r + 1.6666665459e-1f;
+        p = p * r + 5.0000001201e-1f;
+        p = p * r * r + r + 1.f;
+
+        std::int32_t bits = (std::int32_t (n) + 127) << 23;
+        float scale;
+        std::memcpy (&scale, &bits, sizeof (scale));
+        return p * scale;
+    }
+
+    /**
+    Return an approximation of exp (x).
+    \pre x <= 0.
+    */
+    inline double fastExp (double x) {
+        if (x < -708.)
+            x = -708.;
+        double n = std::floor (x * 1.4426950408889634074 + .5);
+        double r = x - n * 6.93145751953125e-1 - n * 1.42860682030941723212e-6;
+        // Taylor series up to r^10.
+        double p = 1. / 3628800.;
+        p = p * r + 1. / 362880.;
+        p = p * r + 1. / 40320.;
+        p = p * r + 1. / 5040.;
+        p = p * r + 1. / 720.;
+        p = p * r + 1. / 120.;
+        p = p * r + 1. / 24.;
+        p = p * r + 1. / 6.;
+        p = p * r + .5;
+        p = p * r * r + r + 1.;
+
+        std::int64_t bits = (std::int64_t (n) + 1023) << 52;
+        double scale;
+        std::memcpy (&scale, &bits, sizeof (scale));
+        return p * scale;
+    }
+
+    /**
+    Return the sum of fastExp (values [i] - offset).
+    */
+    template <class Value> inline Value sumFastExp (
+        Value const * values, std::size_t size, Value offset)
+    {
+        Value sum = 0;
+        for (std::size_t index = 0; index != size; ++ index)
+            sum += fastExp (values [index] - offset);
+        return sum;
+    }
+
+#if FLIPSTA_LOG_SUM_EXP_AVX2
+
+    inline float sumFastExp (
+        float const * values, std::size_t size, float offset)
+    {
+        __m256 const offsetVector = _mm256_set1_ps (offset);
+        __m256 const minimum = _mm256_set1_ps (-87.f);
+        __m256 sum = _mm256_setzero_ps();
+        std::size_t index = 0;
+        for (; index + 8 <= size; index += 8) {
+            __m256 x = _mm256_max_ps (minimum, _mm256_sub_ps (
+                _mm256_loadu_ps (values + index), offsetVector));
+            __m256 n = _mm256_floor_ps (_mm256_add_ps (
+                _mm256_mul_ps (x, _mm256_set1_ps (1.44269504088896341f)),
+                _mm256_set1_ps (.5f)));
+            __m256 r = _mm256_sub_ps (x,
+                _mm256_mul_ps (n, _mm256_set1_ps (0.693359375f)));
+            r = _mm256_sub_ps (r,
+                _mm256_mul_ps (n, _mm256_set1_ps (-2.12194440e-4f)));
+
+            __m256 p = _mm256_set1_ps (1.9875691500e-4f);
+            p = _mm256_add_ps (_mm256_mul_ps (p, r),
+                _mm256_set1_ps (1.3981999507e-3f));
+            p = _mm256_add_ps (_mm256_mul_ps (p, r),
+                _mm256_set1_ps (8.3334519073e-3f));
+            p = _mm256_add_ps (_mm256_mul_ps (p, r),
+                _mm256_set1_ps (4.1665795894e-2f));
+            p = _mm256_add_ps (_mm256_mul_ps (p, r),
+                _mm256_set1_ps (1.6666665459e-1f));
+            p = _mm256_add_ps (_mm256_mul_ps (p, r),
+                _mm256_set1_ps (5.0000001201e-1f));
+            p = _mm256_add_ps (_mm256_mul_ps (_mm256_mul_ps (p, r), r),
+                _mm256_add_ps (r, _mm256_set1_ps (1.f)));
+
+            __m256i bits = _mm256_slli_epi32 (_mm256_add_epi32 (
+                _mm256_cvtps_epi32 (n), _mm256_set1_epi32 (127)), 23);
+            sum = _mm256_add_ps (sum,
+                _mm256_mul_ps (p, _mm256_castsi256_ps (bits)));
+        }
+        // Horizontal sum.
+        __m128 half = _mm_add_ps (_mm256_castps256_ps128 (sum),
+            _mm256_extractf128_ps (sum, 1));
+        half = _mm_add_ps (half, _mm_movehl_ps (half, half));
+        half = _mm_add_ss (half, _mm_shuffle_ps (half, half, 1));
+        float result = _mm_cvtss_f32 (half);
+
+        for (; index != size; ++ index)
+            result += fastExp (values [index] - offset);
+        return result;
+    }
+
+#endif // FLIPSTA_LOG_SUM_EXP_AVX2
+
+    /**
+    Return log (exp (values [0]) + exp (values [1]) + ...).
+
+    To prevent overflow and underflow, the maximum value is subtracted from
+    all values before exponentiating them, and added back afterwards.
+
+    If \a size is 0, or all values are minus infinity, the result is minus
+    infinity.
+    */
+    template <class Value> inline Value logSumExp (Value const * values,
+        std::size_t size, LogAddAccuracy accuracy = LogAddAccuracy::exact)
+    {
+        Value maximum = -std::numeric_limits <Value>::infinity();
+        for (std::size_t index = 0; index != size; ++ index)
+            if (values [index] > maximum)
+                maximum = values [index];
+        // This also deals with infinities and with size 0 or 1.
+        if (size <= 1 || std::isinf (maximum))
+            return maximum;
+
+        Value sum;
+        if (accuracy == LogAddAccuracy::fast)
+            sum = sumFastExp (values, size, maximum);
+        else {
+            sum = 0;
+            for (std::size_t index = 0; index != size; ++ index)
+                sum += std::exp (values [index] - maximum);
+        }
+        return maximum + std::log (sum);
+    }
+
+} // namespace detail
+
+} // namespace flipsta
+
+#endif // FLIPSTA_DETAIL_LOG_SUM_EXP_HPP_INCLUDED
@@ -17,17 +17,26 @@ limitations under the License.
 #ifndef FLIPSTA_DETAIL_SHARED_AUTOMATON_STATE_MEMO_HPP_INCLUDED
 #define FLIPSTA_DETAIL_SHARED_AUTOMATON_STATE_MEMO_HPP_INCLUDED
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <ostream>
 #include <utility>
+#include <vector>
 
 #include <boost/functional/hash.hpp>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/global_fun.hpp>
 
 #include "range/tuple.hpp"
 
 #include "./sole.hpp"
+#include "./statistics_counter.hpp"
 
 #include "flipsta/core/hash_helper.hpp"
 
@@ -41,6 +50,77 @@ namespace flipsta {
         template <class Key, class Weight> struct SharedAutomatonOperations;
     } // namespace detail
 
+    /** \brief
+    Statistics about the work done on SharedAutomaton objects that use one
+    SharedAutomatonMemo, as returned by SharedAutomatonMemo::statistics().
+
+    This can help find out why a computation in the AutomatonSemiring takes
+    much time or memory.
+
+    The counts of operations, and of states created and destructed, are kept
+    only if FLIPSTA_SHARED_AUTOMATON_STATISTICS is defined, since they take
+    time to update; otherwise they are 0.
+    The other values are always available.
+    Since the macro changes the layout of SharedAutomatonMemo, it must be
+    defined for all translation units in a program or for none.
+    */
+    struct SharedAutomatonStatistics {
+        /// Calls to union_() that did not have a trivial answer.
+        std::size_t unionCalls;
+        /// Merges of more than two automata by unionAll(), including the
+        /// recursive ones.
+        std::size_t unionAllCalls;
+        /// Unions that were found in the memo.
+        std::size_t unionHits;
+        /// Unions that were not found in the memo and had to be computed.
+        std::size_t unionMisses;
+        /// Unions that were evicted to keep the memo within its capacity.
+        std::size_t unionEvictions;
+        /// Unions currently remembered.
+        std::size_t unionNum;
+
+        /// Calls to concatenate().
+        std::size_t concatenateCalls;
+        /// Distinct left states that were concatenated with a right automaton.
+        std::size_t concatenateStates;
+        /// Of those, the ones without arcs.
+        std::size_t concatenateLeftEmpty;
+        /// Of those, the ones where the right automaton's state has no arcs.
+        std::size_t concatenateRightEmpty;
+
+        /// States that have been created, including the final state.
+        std::size_t statesCreated;
+        /// States that have been destructed.
+        std::size_t statesDestructed;
+        /// States currently alive, including the final state.
+        std::size_t stateNum;
+        /// The largest number of states that have been alive at once.
+        std::size_t peakStateNum;
+        /// Bytes in the slabs that states are allocated from.
+        std::size_t stateMemory;
+    };
+
+    inline std::ostream & operator<< (
+        std::ostream & stream, SharedAutomatonStatistics const & statistics)
+    {
+        return stream
+            << "union: " << statistics.unionCalls << " calls, "
+            << statistics.unionAllCalls << " unionAll calls, "
+            << statistics.unionHits << " hits, "
+            << statistics.unionMisses << " misses, "
+            << statistics.unionEvictions << " evictions, "
+            << statistics.unionNum << " remembered\n"
+            << "concatenate: " << statistics.concatenateCalls << " calls, "
+            << statistics.concatenateStates << " states, "
+            << statistics.concatenateLeftEmpty << " left empty, "
+            << statistics.concatenateRightEmpty << " right empty\n"
+            << "states: " << statistics.statesCreated << " created, "
+            << statistics.statesDestructed << " destructed, "
+            << statistics.stateNum << " alive, "
+            << statistics.peakStateNum << " at peak, "
+            << statistics.stateMemory << " bytes\n";
+    }
+
     /** \brief
     Keep track of SharedState objects, and memoise the result of computing
     the union of two SharedAutomaton objects.
@@ -48,6 +128,25 @@ namespace flipsta {
     This derives from SoleStore, so that a <c>SoleStore *</c> can be converted
     with <c>static_cast \<SharedAutomatonMemo *> (...)</c>.
     This SoleStore will contain the singleton final state.
+
+    If this is constructed with \c concurrent set to \c true, then it is safe
+    to use from multiple threads at the same time, so that automata that share
+    the memo can be built in parallel.
+    Both the store of states and the memo of unions are then split into shards,
+    each with its own mutex.
+    Equal states are still guaranteed to be the same object.
+
+    By default, the result of a union is remembered until one of its arguments
+    is destructed.
+    In long-running programs, the memo can then grow without bound.
+    If a capacity is given, then the memo of unions is limited to about that
+    many entries.
+    When it is full, the least recently used entry is evicted.
+    This trades memory for recomputation: an evicted union is simply computed
+    again the next time it is needed, and yields the same states.
+    The numbers of hits, misses, and evictions are counted, to help choose the
+    capacity.
+    These and other statistics are returned by statistics().
     */
     template <class Key, class Weight> class SharedAutomatonMemo
     : public detail::SoleStore <SharedState <Key, Weight>>
@@ -55,8 +154,9 @@ namespace flipsta {
         typedef detail::SoleStore <SharedState <Key, Weight>> Store;
         typedef SharedState <Key, Weight> State;
         typedef SharedAutomaton <Key, Weight> Automaton;
-        typedef std::shared_ptr <State const> StatePtr;
-        typedef std::weak_ptr <State const> WeakStatePtr;
+        typedef detail::SolePtr <State> StatePtr;
+        // A pointer that does not keep the state alive.
+        typedef State const * WeakStatePtr;
 
     public:
         class UnionArguments {
@@ -69,9 +169,9 @@ namespace flipsta {
         public:
             UnionArguments (
                 Weight const & leftWeight,
-                std::shared_ptr <State const> const & leftState,
+                StatePtr const & leftState,
                 Weight const & rightWeight,
-                std::shared_ptr <State const> const & rightState)
+                StatePtr const & rightState)
             : leftWeight_ (leftWeight), leftPointer_ (leftState.get()),
                 rightWeight_ (rightWeight), rightPointer_ (rightState.get())
             {
@@ -94,10 +194,14 @@ namespace flipsta {
 
             friend std::size_t hash_value (UnionArguments const & a) {
                 std::size_t seed = 0;
-                boost::hash_combine (seed, a.leftWeight_);
-                boost::hash_combine (seed, a.leftPointer_);
-                boost::hash_combine (seed, a.rightWeight_);
-                boost::hash_combine (seed, a.rightPointer_);
+                detail::combineHash (seed,
+                    boost::hash <Weight>() (a.leftWeight_));
+                detail::combineHash (seed,
+                    boost::hash <State const *>() (a.leftPointer_));
+                detail::combineHash (seed,
+                    boost::hash <Weight>() (a.rightWeight_));
+                detail::combineHash (seed,
+                    boost::hash <State const *>() (a.rightPointer_));
                 return seed;
             }
 
@@ -117,8 +221,10 @@ namespace flipsta {
         The result as it is saved.
 
         This would be an Automaton, but if the left or right argument is the
-        state itself, then that would create a cycle, so a weak_ptr should be
+        state itself, then that would create a cycle, so a raw pointer should be
         saved.
+        This is safe because the entry is removed when the argument is
+        destructed.
         */
         typedef std::pair <Weight,
             rime::variant <StatePtr, WeakStatePtr>> StoredResult;
@@ -138,6 +244,7 @@ namespace flipsta {
         \li hashed by the left state pointer, to delete the stored result when
             the argument gets destructed (keeping it would be useless).
         \li hashed by the right state pointer.
+        \li in order of use, most recent first, to find the entry to evict.
         */
         typedef boost::multi_index_container <
             Mapping,
@@ -152,13 +259,83 @@ namespace flipsta {
                 boost::multi_index::hashed_non_unique <
                     boost::multi_index::global_fun <
                         Mapping const &, State const *,
-                        SharedAutomatonMemo::rightRawPointer>>
+                        SharedAutomatonMemo::rightRawPointer>>,
+                boost::multi_index::sequenced<>
             >> Memo;
 
-        Memo memo_;
+        struct Shard {
+            std::mutex mutex;
+            Memo memo;
+        };
+
+        static std::size_t constexpr concurrentShardNum = 64;
+        // Each state keeps a mask of the shards that may refer to it.
+        static_assert (concurrentShardNum <= 64,
+            "The shards must fit in a 64-bit mask.");
+
+        std::unique_ptr <Shard []> shards_;
+        std::size_t shardNum_;
+        // Maximum number of entries per shard, or 0 for no maximum.
+        std::size_t shardCapacity_;
+
+        mutable std::atomic <std::size_t> hitNum_;
+        mutable std::atomic <std::size_t> missNum_;
+        std::atomic <std::size_t> evictionNum_;
+
+        // Counts that are kept only if statistics are enabled.
+        // SharedAutomatonOperations updates them.
+        struct Counts {
+            detail::StatisticsCounter<> unionCalls;
+            detail::StatisticsCounter<> unionAllCalls;
+            detail::StatisticsCounter<> concatenateCalls;
+            detail::StatisticsCounter<> concatenateStates;
+            detail::StatisticsCounter<> concatenateLeftEmpty;
+            detail::StatisticsCounter<> concatenateRightEmpty;
+        };
+        Counts counts_;
+
+        friend struct detail::SharedAutomatonOperations <Key, Weight>;
+
+        typedef std::unique_lock <std::mutex> Lock;
+
+        Lock lock (Shard & shard) const {
+            if (this->concurrent())
+                return Lock (shard.mutex);
+            else
+                return Lock (shard.mutex, std::defer_lock);
+        }
+
+        std::size_t shardIndexFor (UnionArguments const & arguments) const {
+            std::size_t hash = hash_value (arguments);
+            return std::size_t (
+                (std::uint64_t (hash) * 0x9e3779b97f4a7c15ull) >> 32)
+                % shardNum_;
+        }
+
+        Shard & shardFor (UnionArguments const & arguments) const
+        { return shards_ [shardIndexFor (arguments)]; }
 
     public:
-        SharedAutomatonMemo() {
+        /** \brief
+        Initialise with only the final state.
+
+        \param concurrent
+            (optional) Whether the memo should be safe to use from multiple
+            threads at the same time.
+        \param unionCapacity
+            (optional) The maximum number of union results to remember.
+            If this is 0, which is the default, there is no maximum.
+            If the memo is concurrent, the capacity is divided between the
+            shards, so the actual maximum may be slightly higher.
+        */
+        explicit SharedAutomatonMemo (
+            bool concurrent = false, std::size_t unionCapacity = 0)
+        : Store (concurrent),
+            shards_ (new Shard [concurrent ? concurrentShardNum : 1]),
+            shardNum_ (concurrent ? concurrentShardNum : 1),
+            shardCapacity_ ((unionCapacity + shardNum_ - 1) / shardNum_),
+            hitNum_ (0), missNum_ (0), evictionNum_ (0)
+        {
             // Insert the singleton final state.
             Store::set (State::finalState());
         }
@@ -166,7 +343,8 @@ namespace flipsta {
         ~SharedAutomatonMemo() {
             // All states must have been removed from the memo before it is
             // destructed.
-            assert (memo_.empty());
+            for (std::size_t index = 0; index != shardNum_; ++ index)
+                assert (shards_ [index].memo.empty());
 
             // Remove the singleton final state.
             Store::remove (State::finalState());
@@ -176,101 +354,235 @@ namespace flipsta {
         Retrieve the result of a remembered function call.
         */
         Automaton retrieve (UnionArguments const & arguments) const {
-            auto position = memo_.find (arguments);
+            Shard & shard = shardFor (arguments);
+            Lock lock = this->lock (shard);
+            auto position = shard.memo.find (arguments);
 
-            if (position == memo_.end())
+            if (position == shard.memo.end()) {
+                missNum_.fetch_add (1, std::memory_order_relaxed);
                 return Automaton (math::zero <Weight>(), nullptr);
+            }
+            hitNum_.fetch_add (1, std::memory_order_relaxed);
+
+            if (shardCapacity_ != 0) {
+                // Mark the entry as the most recently used.
+                auto & order = shard.memo.template get <3>();
+                order.relocate (order.begin(),
+                    shard.memo.template project <3> (position));
+            }
 
             if (position->second.second.template contains <StatePtr>())
                 return Automaton (position->second.first,
                     rime::get <StatePtr> (position->second.second));
             else
-                return Automaton (position->second.first,
-                    rime::get <WeakStatePtr> (position->second.second).lock());
+                // The state is one of the arguments, which the caller keeps
+                // alive.
+                return Automaton (position->second.first, StatePtr (
+                    rime::get <WeakStatePtr> (position->second.second)));
         }
 
         /** \brief
         Remember the result of the function call to be retrieved next time
         using retrieve().
 
-        \pre \c arguments must not yet be in the memo.
+        \pre \c arguments must not yet be in the memo, unless the memo is
+            concurrent.
+            Then, another thread may have computed the same union in the
+            meantime.
+            Since equal states are the same object, its result is the same, and
+            the entry is left alone.
         */
         void remember (UnionArguments const & arguments,
             Automaton const & result)
         {
             // Check whether the function has returned the left or the right
             // state argument itself.
-            if (arguments.leftPointer() == result.state().get()
-                || arguments.rightPointer() == result.state().get())
-            {
-                // One of the arguments is in there.
-                // To prevent circular references, we want to save a weak_ptr.
-                auto iteratorAndSuccess = memo_.insert (Mapping (arguments,
-                    StoredResult (result.startWeight(),
-                        WeakStatePtr (result.state()))));
-
-                assert (iteratorAndSuccess.second);
-                (void) iteratorAndSuccess;
-            } else {
-                // Store the shared_ptr.
-                auto iteratorAndSuccess = memo_.insert (Mapping (arguments,
-                    StoredResult (result.startWeight(), result.state())));
-                assert (iteratorAndSuccess.second);
-                (void) iteratorAndSuccess;
+            bool isArgument = arguments.leftPointer() == result.state().get()
+                || arguments.rightPointer() == result.state().get();
+            // To prevent circular references, if one of the arguments is in
+            // there, we want to save a raw pointer.
+            // Otherwise, store the SolePtr.
+            Mapping mapping = isArgument
+                ? Mapping (arguments, StoredResult (result.startWeight(),
+                    WeakStatePtr (result.state().get())))
+                : Mapping (arguments, StoredResult (result.startWeight(),
+                    result.state()));
+
+            // When the arguments are destructed, this shard must be searched
+            // for them.
+            std::size_t shardIndex = shardIndexFor (arguments);
+            std::uint64_t shardBit = std::uint64_t (1) << shardIndex;
+            arguments.leftPointer()->memoShards_.fetch_or (
+                shardBit, std::memory_order_relaxed);
+            arguments.rightPointer()->memoShards_.fetch_or (
+                shardBit, std::memory_order_relaxed);
+
+            // Evicted results are destructed only after the shard has been
+            // unlocked, since that may destruct states, which calls
+            // removeStatePointer().
+            std::vector <StatePtr> garbage;
+
+            Shard & shard = shards_ [shardIndex];
+            Lock lock = this->lock (shard);
+            // Insert the entry as the most recently used.
+            auto & order = shard.memo.template get <3>();
+            auto iteratorAndSuccess = order.push_front (std::move (mapping));
+            assert (iteratorAndSuccess.second || this->concurrent());
+            (void) iteratorAndSuccess;
+
+            if (shardCapacity_ != 0) {
+                while (order.size() > shardCapacity_) {
+                    auto const & pointer = order.back().second.second;
+                    if (pointer.template contains <StatePtr>())
+                        garbage.push_back (rime::get <StatePtr> (pointer));
+                    order.pop_back();
+                    evictionNum_.fetch_add (1, std::memory_order_relaxed);
+                }
             }
         }
 
+        /** \brief
+        Return the number of union results that are remembered.
+        */
+        std::size_t unionNum() const {
+            std::size_t result = 0;
+            for (std::size_t index = 0; index != shardNum_; ++ index) {
+                Shard & shard = shards_ [index];
+                Lock lock = this->lock (shard);
+                result += shard.memo.size();
+            }
+            return result;
+        }
+
+        /** \brief
+        Return the maximum number of union results that are remembered, or 0
+        if there is no maximum.
+        */
+        std::size_t unionCapacity() const
+        { return shardCapacity_ * shardNum_; }
+
+        /** \brief
+        Return the number of times retrieve() has found a remembered result.
+        */
+        std::size_t hitNum() const
+        { return hitNum_.load (std::memory_order_relaxed); }
+
+        /** \brief
+        Return the number of times retrieve() has not found a remembered
+        result, so that the union had to be computed.
+        */
+        std::size_t missNum() const
+        { return missNum_.load (std::memory_order_relaxed); }
+
+        /** \brief
+        Return the number of results that have been evicted to keep the memo
+        within its capacity.
+        */
+        std::size_t evictionNum() const
+        { return evictionNum_.load (std::memory_order_relaxed); }
+
+        /** \brief
+        Return statistics about the operations that have used this memo, and
+        the states in it.
+
+        Unless FLIPSTA_SHARED_AUTOMATON_STATISTICS is defined, some of the
+        values are 0.
+        */
+        SharedAutomatonStatistics statistics() const {
+            SharedAutomatonStatistics result;
+            result.unionCalls = counts_.unionCalls.value();
+            result.unionAllCalls = counts_.unionAllCalls.value();
+            result.unionHits = hitNum();
+            result.unionMisses = missNum();
+            result.unionEvictions = evictionNum();
+            result.unionNum = unionNum();
+
+            result.concatenateCalls = counts_.concatenateCalls.value();
+            result.concatenateStates = counts_.concatenateStates.value();
+            result.concatenateLeftEmpty = counts_.concatenateLeftEmpty.value();
+            result.concatenateRightEmpty
+                = counts_.concatenateRightEmpty.value();
+
+            result.statesCreated = this->insertionNum();
+            result.statesDestructed = this->removalNum();
+            result.stateNum = this->size();
+            result.peakStateNum = this->peakSize();
+            result.stateMemory = this->memory();
+            return result;
+        }
+
         /** \brief
         Notify the memo that a SharedState object is being destructed.
 
         Any memoised result where either the left or the right argument is a
         SharedState should therefore be removed from the memo.
+        This is called only for states that have been arguments to a union
+        that has been remembered, and only the shards that those unions were
+        remembered in are searched.
+
+        The results that are removed are released only after all shards have
+        been unlocked.
+        If that destructs states, SoleBase queues them, so that they are
+        destructed one at a time after this returns, rather than recursively.
         */
         void removeStatePointer (State const * statePointer) {
             // Removing a state pointer is a dangerous action.
             // When an entry from the memo is removed, the result may be the
             // last reference to that state.
-            // This triggers the destruction of that state, which will
-            // recursively call this method.
+            // This triggers the destruction of that state, which will call
+            // this method again.
             // That situation must be handled carefully.
 
             // Collect all resulting state pointers that are removed in one
             // place.
             std::vector <StatePtr> garbage;
 
-            // Put the results with statePointer as the left argument in
-            // "garbage".
-            auto & index1 = memo_.template get<1>();
-            {
-                auto r = index1.equal_range (statePointer);
-                for (; r.first != r.second; ++ r.first) {
-                    // If it is a shared_ptr, copy it: we do not want to mutate
-                    // the memo while using the iterators.
-                    auto pointer = r.first->second.second;
-                    if (pointer.template contains <StatePtr>())
-                        garbage.push_back (rime::get <StatePtr> (pointer));
+            // The entries are sharded by their arguments, so they can be in
+            // any shard, but the state knows which shards it has been
+            // remembered in.
+            std::uint64_t shards
+                = statePointer->memoShards_.load (std::memory_order_relaxed);
+            for (std::size_t index = 0; shards != 0; ++ index, shards >>= 1) {
+                if (!(shards & 1))
+                    continue;
+                Shard & shard = shards_ [index];
+                Lock lock = this->lock (shard);
+
+                // Put the results with statePointer as the left argument in
+                // "garbage".
+                auto & index1 = shard.memo.template get<1>();
+                {
+                    auto r = index1.equal_range (statePointer);
+                    for (; r.first != r.second; ++ r.first) {
+                        // If it is a SolePtr, copy it: we do not want to
+                        // mutate the memo while using the iterators.
+                        auto pointer = r.first->second.second;
+                        if (pointer.template contains <StatePtr>())
+                            garbage.push_back (rime::get <StatePtr> (pointer));
+                    }
                 }
-            }
-            index1.erase (statePointer);
-
-            // Put the results with statePointer as the right argument in
-            // "garbage".
-            auto & index2 = memo_.template get<2>();
-            {
-                auto r = index2.equal_range (statePointer);
-                for (; r.first != r.second; ++ r.first) {
-                    auto pointer = r.first->second.second;
-                    if (pointer.template contains <StatePtr>())
-                        garbage.push_back (rime::get <StatePtr> (pointer));
+                index1.erase (statePointer);
+
+                // Put the results with statePointer as the right argument in
+                // "garbage".
+                auto & index2 = shard.memo.template get<2>();
+                {
+                    auto r = index2.equal_range (statePointer);
+                    for (; r.first != r.second; ++ r.first) {
+                        auto pointer = r.first->second.second;
+                        if (pointer.template contains <StatePtr>())
+                            garbage.push_back (rime::get <StatePtr> (pointer));
+                    }
                 }
-            }
 
-            // Erase the entries, which will now not trigger any use_count to
-            // drop to 0.
-            index2.erase (statePointer);
+                // Erase the entries, which will now not trigger any use_count
+                // to drop to 0.
+                index2.erase (statePointer);
+            }
 
-            // Now "garbage" is destructed, and ~SharedState may be called
-            // recursively.
+            // Now "garbage" is destructed, outside the locks.
+            // States that lose their last reference are queued by SoleBase,
+            // so this does not recurse.
         }
     };
 
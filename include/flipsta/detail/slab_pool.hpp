@@ -0,0 +1,130 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_DETAIL_SLAB_POOL_HPP_INCLUDED
+#define FLIPSTA_DETAIL_SLAB_POOL_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace flipsta { namespace detail {
+
+    /** \brief
+    Pool of memory for objects of type \a Object, allocated in slabs.
+
+    Memory is taken from slabs, which each hold many objects, and which grow
+    in size up to a maximum.
+    Memory that is given back is kept in a free list, and handed out again
+    before new memory is taken from a slab.
+    The memory is given back to the system only when the pool is destructed,
+    one slab at a time.
+
+    This only provides raw memory; the caller constructs and destructs the
+    objects.
+    This is not thread-safe.
+    */
+    template <class Object> class SlabPool {
+        union Slot {
+            Slot * next;
+            typename std::aligned_storage <
+                sizeof (Object), alignof (Object)>::type storage;
+        };
+
+        static std::size_t constexpr firstSlabSize = 32;
+        static std::size_t constexpr maximumSlabSize = 4096;
+
+        std::vector <std::unique_ptr <Slot []>> slabs_;
+        // The size of the next slab to be allocated.
+        std::size_t nextSlabSize_;
+        // The part of the last slab that has never been handed out.
+        Slot * unused_;
+        Slot * unusedEnd_;
+        // Slots that have been given back.
+        Slot * free_;
+        std::size_t capacity_;
+
+    public:
+        SlabPool()
+        : nextSlabSize_ (firstSlabSize), unused_ (nullptr),
+            unusedEnd_ (nullptr), free_ (nullptr), capacity_ (0) {}
+
+        SlabPool (SlabPool const &) = delete;
+        SlabPool & operator= (SlabPool const &) = delete;
+
+        /** \brief
+        Return memory for one object.
+        \throw std::bad_alloc if a new slab is required but cannot be
+            allocated.
+        */
+        void * allocate() {
+            if (free_) {
+                Slot * slot = free_;
+                free_ = slot->next;
+                return slot;
+            }
+            if (unused_ == unusedEnd_) {
+                slabs_.reserve (slabs_.size() + 1);
+                std::unique_ptr <Slot []> slab (new Slot [nextSlabSize_]);
+                unused_ = slab.get();
+                unusedEnd_ = unused_ + nextSlabSize_;
+                capacity_ += nextSlabSize_;
+                slabs_.push_back (std::move (slab));
+                nextSlabSize_ = std::min (nextSlabSize_ * 2, maximumSlabSize);
+            }
+            return unused_ ++;
+        }
+
+        /** \brief
+        Give back memory that allocate() has returned.
+
+        The object in it must have been destructed.
+        */
+        void deallocate (void * memory) {
+            assert (memory);
+            Slot * slot = static_cast <Slot *> (memory);
+            slot->next = free_;
+            free_ = slot;
+        }
+
+        /** \brief
+        Return the number of slabs that have been allocated.
+        */
+        std::size_t slabNum() const { return slabs_.size(); }
+
+        /** \brief
+        Return the number of objects that fit in the slabs that have been
+        allocated.
+        */
+        std::size_t capacity() const { return capacity_; }
+
+        /** \brief
+        Return the number of bytes in the slabs that have been allocated.
+        */
+        std::size_t memory() const { return capacity_ * sizeof (Slot); }
+    };
+
+    template <class Object>
+        std::size_t constexpr SlabPool <Object>::firstSlabSize;
+    template <class Object>
+        std::size_t constexpr SlabPool <Object>::maximumSlabSize;
+
+}} // namespace flipsta::detail
+
+#endif // FLIPSTA_DETAIL_SLAB_POOL_HPP_INCLUDED
@@ -18,8 +18,14 @@ limitations under the License.
 #define FLIPSTA_DETAIL_SOLE_HPP_INCLUDED
 
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <type_traits>
+#include <vector>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -27,9 +33,14 @@ limitations under the License.
 
 #include <boost/functional/hash.hpp>
 
+#include "./slab_pool.hpp"
+#include "./statistics_counter.hpp"
+
 namespace flipsta { namespace detail {
 
     template <class Value> class SoleStore;
+    template <class Value> class SolePtr;
+    template <class Value> class SoleEntry;
 
     struct SoleBaseTag {};
 
@@ -38,6 +49,12 @@ namespace flipsta { namespace detail {
     to other objects in the store.
 
     This makes sure that the same store is used (and saves some memory).
+    Objects of classes derived from this are reference-counted intrusively, and
+    held through SolePtr instead of std::shared_ptr.
+    Their memory comes from slabs that the store owns.
+    This saves the control block and the weak_ptr in the store, and, if the
+    store is not concurrent, the reference count is changed without atomic
+    operations.
 
     Sole needs access to the conversion from and to Value.
     The destructor is not virtual, so it is not safe to cast \a Value to
@@ -51,37 +68,185 @@ namespace flipsta { namespace detail {
 
     private:
         Store * store_;
+        // The number of SolePtr objects that point to this.
+        mutable std::atomic <std::size_t> referenceCount_;
         bool inStore_;
-
-        void setInStore() { inStore_ = true; }
+        // Whether referenceCount_ must be changed with atomic operations.
+        // Objects that are not in a store may be shared between stores, so
+        // this is true for them.
+        bool concurrent_;
+        // The shard of the store that this is in.
+        // This fits in the padding after inStore_.
+        std::uint8_t shard_;
+
+        void setInStore (std::size_t shard, bool concurrent) {
+            inStore_ = true;
+            concurrent_ = concurrent;
+            shard_ = std::uint8_t (shard);
+        }
 
         friend class SoleStore <Value>;
+        friend class SolePtr <Value>;
+        friend class SoleEntry <Value>;
 
-        static std::shared_ptr <Value> construct (
-            Store & store, Value const & value)
+        /**
+        Construct a copy of \a value in memory from the store.
+        The shard must be locked if the store is concurrent.
+        */
+        template <class QValue> static SolePtr <Value> construct (
+            Store & store, QValue && value, std::size_t shard)
         {
             // We must be inserting into the correct store.
             assert (value.store_ == &store);
-            auto sole = std::make_shared <Value> (value);
-            sole->setInStore();
-            return std::move (sole);
+            SlabPool <Value> & pool = store.pool (shard);
+            void * memory = pool.allocate();
+            Value * sole;
+            try {
+                sole = new (memory) Value (std::forward <QValue> (value));
+            } catch (...) {
+                pool.deallocate (memory);
+                throw;
+            }
+            sole->setInStore (shard, store.concurrent());
+            return SolePtr <Value> (sole);
         }
 
-        static std::shared_ptr <Value> construct (
-            Store & store, Value && value)
-        {
-            // We must be inserting into the correct store.
-            assert (value.store_ == &store);
-            auto sole = std::make_shared <Value> (std::move (value));
-            sole->setInStore();
-            return std::move (sole);
+        static void addReference (Value const * object) {
+            SoleBase const & base = *object;
+            if (base.concurrent_) {
+                base.referenceCount_.fetch_add (1, std::memory_order_relaxed);
+            } else {
+                base.referenceCount_.store (
+                    base.referenceCount_.load (std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+            }
+        }
+
+        /**
+        Add a reference to the object unless it has no references left, in
+        which case it is being destructed.
+        \return \c true iff a reference has been added.
+        */
+        static bool tryAddReference (Value const * object) {
+            SoleBase const & base = *object;
+            std::size_t count
+                = base.referenceCount_.load (std::memory_order_relaxed);
+            if (!base.concurrent_) {
+                if (count == 0)
+                    return false;
+                base.referenceCount_.store (
+                    count + 1, std::memory_order_relaxed);
+                return true;
+            }
+            do {
+                if (count == 0)
+                    return false;
+            } while (!base.referenceCount_.compare_exchange_weak (
+                count, count + 1, std::memory_order_relaxed));
+            return true;
+        }
+
+        /**
+        Return whether any references to the object are left.
+        */
+        static bool referenced (Value const * object) {
+            SoleBase const & base = *object;
+            return base.referenceCount_.load (std::memory_order_relaxed) != 0;
+        }
+
+        /**
+        Remove a reference to the object, and destruct it if that was the last
+        one.
+        */
+        static void removeReference (Value const * object) {
+            SoleBase const & base = *object;
+            bool last;
+            if (base.concurrent_) {
+                last = base.referenceCount_.fetch_sub (
+                    1, std::memory_order_acq_rel) == 1;
+            } else {
+                std::size_t count
+                    = base.referenceCount_.load (std::memory_order_relaxed);
+                assert (count != 0);
+                base.referenceCount_.store (
+                    count - 1, std::memory_order_relaxed);
+                last = (count == 1);
+            }
+            if (last)
+                destruct (object);
+        }
+
+        /**
+        Destruct an object that has no references left.
+
+        Destructing an object releases the references it holds, which may
+        destruct other objects, and so on.
+        Doing this recursively would make the depth of the stack proportional
+        to the length of the longest chain of objects, which can overflow the
+        stack.
+        Objects that lose their last reference while another object is being
+        destructed on the same thread are therefore queued, and the outermost
+        call destructs them one at a time.
+        Until then, they remain in the store without references, and compare
+        unequal to any value, so that a new object is made if their value is
+        asked for.
+        */
+        static void destruct (Value const * object) {
+            struct Pending {
+                std::vector <Value const *> objects;
+                bool active;
+                Pending() : active (false) {}
+            };
+            static thread_local Pending pending;
+
+            if (pending.active) {
+                try {
+                    pending.objects.push_back (object);
+                } catch (std::bad_alloc &) {
+                    // Fall back to recursion rather than leak.
+                    destructNow (object);
+                }
+                return;
+            }
+
+            pending.active = true;
+            destructNow (object);
+            while (!pending.objects.empty()) {
+                Value const * next = pending.objects.back();
+                pending.objects.pop_back();
+                destructNow (next);
+            }
+            pending.active = false;
+        }
+
+        static void destructNow (Value const * object) {
+            SoleBase const & base = *object;
+            if (base.inStore_) {
+                // The memory must be given back to the store, which must be
+                // read before the object is destructed.
+                Store * store = base.store_;
+                std::size_t shard = base.shard_;
+                object->~Value();
+                store->deallocate (const_cast <Value *> (object), shard);
+            } else
+                delete object;
         }
 
     protected:
         /** \brief
         Initialise with a pointer to the SoleStore object to use.
         */
-        SoleBase (Store * store) : store_ (store), inStore_ (false) {}
+        SoleBase (Store * store)
+        : store_ (store), referenceCount_ (0), inStore_ (false),
+            concurrent_ (true), shard_ (0) {}
+
+        /** \brief
+        Initialise with the same store as \a that.
+        The new object has no references and is not in the store.
+        */
+        SoleBase (SoleBase const & that)
+        : store_ (that.store_), referenceCount_ (0), inStore_ (false),
+            concurrent_ (true), shard_ (0) {}
 
         /** \brief
         Return a pointer to the store that is used.
@@ -90,11 +255,137 @@ namespace flipsta { namespace detail {
 
     public:
         ~SoleBase() {
+            assert (referenceCount_.load (std::memory_order_relaxed) == 0);
             if (inStore_)
-                store_->removePointer (static_cast <Value const *> (this));
+                store_->removePointer (
+                    static_cast <Value const *> (this), shard_);
+        }
+    };
+
+    /** \brief
+    Pointer to an object derived from SoleBase, which keeps the object alive
+    through its intrusive reference count.
+
+    This behaves like <c>std::shared_ptr \<Value const></c>, but takes the
+    space of only one pointer.
+    It is safe to copy SolePtr objects that point to the same object from
+    multiple threads at the same time only if the object is in a concurrent
+    SoleStore, or is not in a store at all.
+    */
+    template <class Value> class SolePtr {
+        Value const * object_;
+
+    public:
+        SolePtr() : object_ (nullptr) {}
+
+        SolePtr (std::nullptr_t) : object_ (nullptr) {}
+
+        /** \brief
+        Point to \a object.
+
+        \param object
+            The object to point to, or \c nullptr.
+        \param addReference
+            (optional) If \c false, do not add a reference to the object, but
+            take over one that has already been added.
+
+        \pre If \a addReference is \c true, \a object must be kept alive by
+            another reference, or must be new.
+        */
+        explicit SolePtr (Value const * object, bool addReference = true)
+        : object_ (object)
+        {
+            if (object_ && addReference)
+                SoleBase <Value>::addReference (object_);
+        }
+
+        SolePtr (SolePtr const & that) : object_ (that.object_) {
+            if (object_)
+                SoleBase <Value>::addReference (object_);
+        }
+
+        SolePtr (SolePtr && that) : object_ (that.object_)
+        { that.object_ = nullptr; }
+
+        ~SolePtr() { reset(); }
+
+        SolePtr & operator= (SolePtr const & that) {
+            SolePtr (that).swap (*this);
+            return *this;
+        }
+
+        SolePtr & operator= (SolePtr && that) {
+            SolePtr (std::move (that)).swap (*this);
+            return *this;
+        }
+
+        void swap (SolePtr & that) {
+            using std::swap;
+            swap (this->object_, that.object_);
+        }
+
+        /** \brief
+        Release the object, destructing it if this was the last reference.
+        */
+        void reset() {
+            if (object_) {
+                Value const * object = object_;
+                object_ = nullptr;
+                SoleBase <Value>::removeReference (object);
+            }
         }
+
+        Value const * get() const { return object_; }
+
+        Value const & operator* () const { return *object_; }
+        Value const * operator-> () const { return object_; }
+
+        explicit operator bool() const { return object_ != nullptr; }
     };
 
+    template <class Value> inline
+        bool operator== (SolePtr <Value> const & left,
+            SolePtr <Value> const & right)
+    { return left.get() == right.get(); }
+
+    template <class Value> inline
+        bool operator!= (SolePtr <Value> const & left,
+            SolePtr <Value> const & right)
+    { return left.get() != right.get(); }
+
+    template <class Value> inline
+        bool operator== (SolePtr <Value> const & left, std::nullptr_t)
+    { return !left; }
+
+    template <class Value> inline
+        bool operator!= (SolePtr <Value> const & left, std::nullptr_t)
+    { return bool (left); }
+
+    template <class Value> inline
+        bool operator== (std::nullptr_t, SolePtr <Value> const & right)
+    { return !right; }
+
+    template <class Value> inline
+        bool operator!= (std::nullptr_t, SolePtr <Value> const & right)
+    { return bool (right); }
+
+    template <class Value> inline
+        std::size_t hash_value (SolePtr <Value> const & pointer)
+    { return boost::hash <Value const *>() (pointer.get()); }
+
+    /** \brief
+    Construct a new object derived from SoleBase that is not in a store, and
+    return a SolePtr to it.
+
+    This can be useful for singleton values.
+    */
+    template <class Value, class ... Arguments> inline
+        SolePtr <Value> makeSole (Arguments && ... arguments)
+    {
+        return SolePtr <Value> (
+            new Value (std::forward <Arguments> (arguments) ...));
+    }
+
     /** \brief
     Class used internally by SoleStore if Value does not derive from SoleBase.
     */
@@ -103,29 +394,31 @@ namespace flipsta { namespace detail {
 
         typedef SoleStore <Value> Store;
         Store & store_;
+        std::size_t shard_;
 
     public:
-        SoleValue (Store & store, Value const & value)
-        : value_ (std::move (value)), store_ (store) {}
+        SoleValue (Store & store, Value const & value, std::size_t shard)
+        : value_ (std::move (value)), store_ (store), shard_ (shard) {}
 
-        SoleValue (Store & store, Value && value)
-        : value_ (value), store_ (store) {}
+        SoleValue (Store & store, Value && value, std::size_t shard)
+        : value_ (value), store_ (store), shard_ (shard) {}
 
-        ~SoleValue() { store_.removePointer (&value_); }
+        ~SoleValue() { store_.removePointer (&value_, shard_); }
 
         static std::shared_ptr <Value const> construct (
-            Store & store, Value const & value)
+            Store & store, Value const & value, std::size_t shard)
         {
-            auto sole = std::make_shared <SoleValue> (store, value);
+            auto sole = std::make_shared <SoleValue> (store, value, shard);
             // Produce an aliasing pointer to the value.
             return std::shared_ptr <Value const> (
                 std::move (sole), &sole->value_);
         }
 
         static std::shared_ptr <Value const> construct (
-            Store & store, Value && value)
+            Store & store, Value && value, std::size_t shard)
         {
-            auto sole = std::make_shared <SoleValue> (store, std::move (value));
+            auto sole = std::make_shared <SoleValue> (
+                store, std::move (value), shard);
             // Produce an aliasing pointer to the value.
             return std::shared_ptr <Value const> (
                 std::move (sole), &sole->value_);
@@ -138,15 +431,22 @@ namespace flipsta { namespace detail {
     is first destructed.
 
     Its hash is computed as the hash of the object that it points to.
+    This is cached, so that it remains available while the object is being
+    destructed.
     */
     template <class Value> class WeakPtr {
         std::weak_ptr <Value const> object_;
         // This remains even when the object goes out of scope.
         Value const * rawPointer_;
+        std::size_t hash_;
 
     public:
+        typedef Value ValueType;
+        typedef std::shared_ptr <Value const> Pointer;
+
         WeakPtr (std::shared_ptr <Value const> const & object)
-        : object_ (object), rawPointer_ (object.get()) {}
+        : object_ (object), rawPointer_ (object.get()),
+            hash_ (boost::hash <Value>() (*object)) {}
 
         /** \brief
         Get a shared_ptr owning the object.
@@ -155,6 +455,11 @@ namespace flipsta { namespace detail {
         */
         std::shared_ptr <Value const> get() const { return object_.lock(); }
 
+        /** \brief
+        Return whether the object has no owners left.
+        */
+        bool expired() const { return object_.expired(); }
+
         /** \brief
         Return a reference to the object.
 
@@ -167,42 +472,145 @@ namespace flipsta { namespace detail {
         }
 
         Value const * rawPointer() const { return rawPointer_; }
+
+        std::size_t hash() const { return hash_; }
     };
 
-    template <class Value> std::size_t hash_value (WeakPtr <Value> const & p) {
-        boost::hash <Value> hasher;
-        return hasher (p.value());
-    }
+    template <class Value> std::size_t hash_value (WeakPtr <Value> const & p)
+    { return p.hash(); }
 
     template <class Value> bool
         operator== (WeakPtr <Value> const & left, WeakPtr <Value> const & right)
     { return left.rawPointer() == right.rawPointer(); }
 
-    struct EqualToWeakPtr {
-        template <class Value>
-            bool operator() (Value const & left, WeakPtr <Value> const & right)
-            const
-        { return left == right.value(); }
+    /** \brief
+    Entry in a SoleStore for an object derived from SoleBase.
+
+    This holds a raw pointer, which does not keep the object alive.
+    The object removes the entry when it is destructed.
+    The hash is cached, so that it remains available while the object is being
+    destructed.
+    */
+    template <class Value> class SoleEntry {
+        Value const * object_;
+        std::size_t hash_;
+
+    public:
+        typedef Value ValueType;
+        typedef SolePtr <Value> Pointer;
+
+        SoleEntry (SolePtr <Value> const & object)
+        : object_ (object.get()), hash_ (boost::hash <Value>() (*object)) {}
+
+        /** \brief
+        Get a pointer to the object, or a null pointer if the object is being
+        destructed.
+        */
+        SolePtr <Value> get() const {
+            if (SoleBase <Value>::tryAddReference (object_))
+                return SolePtr <Value> (object_, false);
+            return SolePtr <Value>();
+        }
+
+        /** \brief
+        Return whether the object has no references left, so that it is being
+        destructed or is queued for destruction.
+        */
+        bool expired() const
+        { return !SoleBase <Value>::referenced (object_); }
+
+        /** \brief
+        Return a reference to the object.
+
+        This should work until the object gets deleted.
+        */
+        Value const & value() const { return *object_; }
+
+        Value const * rawPointer() const { return object_; }
+
+        std::size_t hash() const { return hash_; }
+    };
+
+    template <class Value>
+        std::size_t hash_value (SoleEntry <Value> const & entry)
+    { return entry.hash(); }
+
+    template <class Value> bool operator== (
+        SoleEntry <Value> const & left, SoleEntry <Value> const & right)
+    { return left.rawPointer() == right.rawPointer(); }
+
+    /**
+    Hash function that returns a hash value that has already been computed.
+    */
+    struct KnownHash {
+        std::size_t hash;
+
+        template <class Value> std::size_t operator() (Value const &) const
+        { return hash; }
+    };
+
+    /**
+    Equality comparison for a SoleStore that is used from one thread.
+
+    Objects that have no references left, which are being destructed or are
+    queued for destruction, compare unequal.
+    */
+    template <class Entry> struct EqualToEntry {
+        typedef typename Entry::ValueType Value;
+
+        bool operator() (Value const & left, Entry const & right) const
+        { return !right.expired() && left == right.value(); }
+
+        bool operator() (Entry const & left, Value const & right) const
+        { return (*this) (right, left); }
+    };
+
+    /**
+    Equality comparison for a SoleStore that is used from multiple threads.
+
+    Objects that are being destructed compare unequal.
+    Objects that are compared are kept alive in \a pinned, so that they are
+    not destructed during the comparison.
+    \a pinned must be cleared only after the store has been unlocked, because
+    clearing it may destruct objects, which will then try to remove themselves
+    from the store.
+    */
+    template <class Entry> struct PinningEqualToEntry {
+        typedef typename Entry::ValueType Value;
+
+        std::vector <typename Entry::Pointer> & pinned;
+
+        bool operator() (Value const & left, Entry const & right) const {
+            auto object = right.get();
+            if (!object)
+                return false;
+            pinned.push_back (std::move (object));
+            return left == *pinned.back();
+        }
 
-        template <class Value>
-            bool operator() (WeakPtr <Value> const & left, Value const & right)
-            const
-        { return left.value() == right; }
+        bool operator() (Entry const & left, Value const & right) const
+        { return (*this) (right, left); }
     };
 
     /** \brief
     Keep track of unique objects for each value.
 
     When a new value is added, it is checked whether it is already in the store,
-    in which case a std::shared_ptr to the previously stored value is returned.
-    When the last std::shared_ptr to the value is destructed, the value is
-    destructed and removed from the store.
-
-    All std::shared_ptr objects to values in the store must therefore be
-    destructed before the store itself is.
-
-    It is possible to add a particular std::shared_ptr to the store if the value
-    is not in the store yet.
+    in which case a pointer to the previously stored value is returned.
+    When the last pointer to the value is destructed, the value is destructed
+    and removed from the store.
+    The type of pointer, \c Pointer, is SolePtr if \a Value derives from
+    SoleBase, and <c>std::shared_ptr \<Value const></c> otherwise.
+    In the first case, the objects are allocated from slabs that the store
+    owns, which improves locality and avoids fragmenting the heap.
+    Memory of objects that are destructed is reused for new objects, and the
+    slabs are released only when the store is destructed.
+
+    All pointers to values in the store must therefore be destructed before the
+    store itself is.
+
+    It is possible to add a particular pointer to the store if the value is not
+    in the store yet.
     This can be useful for adding singleton pointers.
     Such a pointer must be explicitly removed from the store when it is
     destructed.
@@ -213,22 +621,38 @@ namespace flipsta { namespace detail {
     In that case, the objects require access to the store themselves, and then
     they can be derived from SoleBase so they can use the pointer to the store
     which is kept anyway.
-    Note that objects should not keep a std::shared_ptr to themselves, directly
-    or indirectly; as usual, a weak_ptr should be used to break the cycle.
+    Note that objects should not keep a pointer to themselves, directly or
+    indirectly, since that would keep them alive forever.
 
-    This is not guaranteed to be thread-safe.
+    By default, this is not thread-safe.
+    If it is constructed with \c concurrent set to \c true, then it can be used
+    from multiple threads at the same time.
+    The objects are then split into shards by their hash value, each with its
+    own mutex, so that threads that look up different values rarely wait for
+    each other.
+    Equal values still always yield the same object.
 
     \todo A number of optimisations would be possible.
     Areas to think of are:
-    This class makes use of std::shared_ptr and its facilities.
-    A custom pointer could save memory.
-    For example, the weak_ptr is not really necessary if you believe that the
-    program logic is sound.
-    SoleBase could combine its boolean and the pointer to the store in one word.
-    Hashes may be computed more often than necessary.
+    SoleBase could combine its booleans and the pointer to the store in one
+    word.
     */
     template <class Value> class SoleStore {
-        typedef WeakPtr <Value> Pointer;
+        static bool constexpr intrusive
+            = std::is_base_of <SoleBaseTag, Value>::value;
+
+    public:
+        /** \brief
+        The type of pointer to objects in the store.
+        */
+        typedef typename std::conditional <intrusive,
+                SolePtr <Value>, std::shared_ptr <Value const>>::type
+            Pointer;
+
+    private:
+        typedef typename std::conditional <intrusive,
+                SoleEntry <Value>, WeakPtr <Value>>::type
+            Entry;
 
         /*
         Keep objects, indexed by:
@@ -236,74 +660,158 @@ namespace flipsta { namespace detail {
         2. The position of the sole value, so the object can remove itself.
         */
         typedef boost::multi_index_container <
-            Pointer,
+            Entry,
             boost::multi_index::indexed_by <
                 boost::multi_index::hashed_unique <
-                    boost::multi_index::identity <Pointer>>,
+                    boost::multi_index::identity <Entry>>,
                 boost::multi_index::hashed_unique <
                     boost::multi_index::const_mem_fun <
-                        Pointer, Value const *, &Pointer::rawPointer>>
+                        Entry, Value const *, &Entry::rawPointer>>
             >> Objects;
 
-        Objects objects_;
+        struct Shard {
+            std::mutex mutex;
+            Objects objects;
+            // Memory for objects derived from SoleBase.
+            SlabPool <Value> pool;
+        };
+
+        // This must fit in SoleBase::shard_.
+        static std::size_t constexpr concurrentShardNum = 64;
+
+        std::unique_ptr <Shard []> shards_;
+        std::size_t shardNum_;
+        bool concurrent_;
+
+        // Only kept if statisticsEnabled.
+        StatisticsCounter<> insertionNum_;
+        StatisticsCounter<> removalNum_;
+        StatisticsCounter<> peakSize_;
+
+        void countInsertion() {
+            if (statisticsEnabled) {
+                // Read the removals first, so that the difference cannot be
+                // negative.
+                std::size_t removalNum = removalNum_.value();
+                ++ insertionNum_;
+                peakSize_.raise (insertionNum_.value() - removalNum);
+            }
+        }
 
         /**
         The actual type of object that will be allocated.
         */
-        typedef typename std::conditional <
-                std::is_base_of <SoleBaseTag, Value>::value,
+        typedef typename std::conditional <intrusive,
                 SoleBase <Value>, SoleValue <Value>>::type
             SoleType;
 
-    public:
-        SoleStore() {}
+        typedef std::unique_lock <std::mutex> Lock;
 
-        ~SoleStore() {
-            // All objects must have gone from memory or they'll try and remove
-            // themselves when they are deleted.
-            assert (objects_.empty());
+        // Lock the shard, but only if this can be used concurrently.
+        Lock lock (Shard & shard) const {
+            if (concurrent_)
+                return Lock (shard.mutex);
+            else
+                return Lock (shard.mutex, std::defer_lock);
         }
 
-        /** \brief
-        Retrieve the sole object with value \a value.
+        std::size_t shardIndex (std::size_t hash) const {
+            // The hash may have poor low bits, so mix it first.
+            return std::size_t ((std::uint64_t (hash) * 0x9e3779b97f4a7c15ull)
+                >> 32) % shardNum_;
+        }
 
-        If an object with this value is already in the store, return a pointer
-        to that object.
-        If not, return a pointer to a newly allocated object.
-        */
-        std::shared_ptr <Value const> get (Value const & value) {
-            auto existing = objects_.find (value,
-                boost::hash <Value>(), EqualToWeakPtr());
-            if (existing != objects_.end())
-                return existing->get();
+        template <class QValue> Pointer getOrInsert (QValue && value) {
+            std::size_t hash = boost::hash <Value>() (value);
+            std::size_t index = shardIndex (hash);
+            Shard & shard = shards_ [index];
+
+            if (!concurrent_)
+                return getOrInsert (std::forward <QValue> (value), hash, index,
+                    shard, EqualToEntry <Entry>());
+
+            // Another thread may release the last reference to an object in
+            // the store at any time.
+            // The objects that are compared must therefore be kept alive until
+            // after the shard has been unlocked.
+            // "pinned" is declared before the lock, so it is destructed after.
+            std::vector <Pointer> pinned;
+            Lock lock (shard.mutex);
+            return getOrInsert (std::forward <QValue> (value), hash, index,
+                shard, PinningEqualToEntry <Entry> {pinned});
+        }
+
+        template <class QValue, class EqualTo>
+            Pointer getOrInsert (QValue && value,
+                std::size_t hash, std::size_t index, Shard & shard,
+                EqualTo const & equalTo)
+        {
+            // An object that is being destructed in another thread, or that
+            // is queued for destruction, but has not yet removed itself,
+            // compares unequal, so that a new object is inserted for its
+            // value.
+            auto existing = shard.objects.find (value,
+                KnownHash {hash}, equalTo);
+            if (existing != shard.objects.end()) {
+                Pointer result = existing->get();
+                assert (result);
+                return result;
+            }
 
             // The value is not in the store yet; insert it.
-            auto sole = SoleType::construct (*this, value);
-            Pointer newElement (sole);
+            Pointer sole = SoleType::construct (
+                *this, std::forward <QValue> (value), index);
+            Entry newElement (sole);
             // Note that this insertion involves a mere copy of newElement into
             // another place in memory.
             // No objects will therefore be deleted, and no objects will
             // therefore attempt to remove themselves from the store.
-            objects_.insert (std::move (newElement));
+            shard.objects.insert (std::move (newElement));
+            countInsertion();
 
             return sole;
         }
 
-        // Rvalue reference.
-        std::shared_ptr <Value const> get (Value && value) {
-            auto existing = objects_.find (value,
-                boost::hash <Value>(), EqualToWeakPtr());
-            if (existing != objects_.end())
-                return existing->get();
+    public:
+        /** \brief
+        Initialise an empty store.
 
-            // The value is not in the store yet; insert it.
-            auto sole = SoleType::construct (*this, std::move (value));
-            Pointer newElement (sole);
-            objects_.insert (std::move (newElement));
+        \param concurrent
+            (optional) Whether the store should be safe to use from multiple
+            threads at the same time.
+        */
+        explicit SoleStore (bool concurrent = false)
+        : shards_ (new Shard [concurrent ? concurrentShardNum : 1]),
+            shardNum_ (concurrent ? concurrentShardNum : 1),
+            concurrent_ (concurrent) {}
 
-            return sole;
+        ~SoleStore() {
+            // All objects must have gone from memory or they'll try and remove
+            // themselves when they are deleted.
+            for (std::size_t index = 0; index != shardNum_; ++ index)
+                assert (shards_ [index].objects.empty());
         }
 
+        /** \brief
+        Return whether this store can be used from multiple threads at the same
+        time.
+        */
+        bool concurrent() const { return concurrent_; }
+
+        /** \brief
+        Retrieve the sole object with value \a value.
+
+        If an object with this value is already in the store, return a pointer
+        to that object.
+        If not, return a pointer to a newly allocated object.
+        */
+        Pointer get (Value const & value)
+        { return getOrInsert (value); }
+
+        // Rvalue reference.
+        Pointer get (Value && value)
+        { return getOrInsert (std::move (value)); }
+
         /** \brief
         Force the pointer for the object in store to be a specific pointer.
 
@@ -312,47 +820,138 @@ namespace flipsta { namespace detail {
 
         \pre No object with this value is already in the store.
         */
-        void set (std::shared_ptr <Value const> pointer) {
+        void set (Pointer const & pointer) {
+            Shard & shard = shards_ [
+                shardIndex (boost::hash <Value>() (*pointer))];
+            Lock lock = this->lock (shard);
             // The value must not be in the store yet.
-            assert (objects_.find (*pointer,
-                boost::hash <Value>(), EqualToWeakPtr()) == objects_.end());
+            assert (shard.objects.find (*pointer,
+                boost::hash <Value>(), EqualToEntry <Entry>())
+                == shard.objects.end());
 
-            objects_.insert (std::move (pointer));
+            shard.objects.insert (Entry (pointer));
+            countInsertion();
         }
 
         /** \brief
         Remove the object at the pointer from the store.
         */
-        void remove (std::shared_ptr <Value const> pointer) {
-            this->removePointer (pointer.get());
+        void remove (Pointer const & pointer) {
+            this->removePointer (pointer.get(),
+                shardIndex (boost::hash <Value>() (*pointer)));
+        }
+
+        /** \brief
+        Return the number of objects in the store.
+        */
+        std::size_t size() const {
+            std::size_t result = 0;
+            for (std::size_t index = 0; index != shardNum_; ++ index) {
+                Shard & shard = shards_ [index];
+                Lock lock = this->lock (shard);
+                result += shard.objects.size();
+            }
+            return result;
+        }
+
+        /** \brief
+        Return the number of bytes in the slabs that objects deriving from
+        SoleBase are allocated from.
+
+        Since the memory is released only when the store is destructed, this is
+        also the peak.
+        It does not include memory that the objects allocate themselves.
+        */
+        std::size_t memory() const {
+            std::size_t result = 0;
+            for (std::size_t index = 0; index != shardNum_; ++ index) {
+                Shard & shard = shards_ [index];
+                Lock lock = this->lock (shard);
+                result += shard.pool.memory();
+            }
+            return result;
         }
 
+        /** \brief
+        Return the number of objects that have been inserted into the store.
+        This is 0 unless FLIPSTA_SHARED_AUTOMATON_STATISTICS is defined.
+        */
+        std::size_t insertionNum() const { return insertionNum_.value(); }
+
+        /** \brief
+        Return the number of objects that have been removed from the store.
+        This is 0 unless FLIPSTA_SHARED_AUTOMATON_STATISTICS is defined.
+        */
+        std::size_t removalNum() const { return removalNum_.value(); }
+
+        /** \brief
+        Return the largest number of objects that have been in the store at the
+        same time.
+        This is 0 unless FLIPSTA_SHARED_AUTOMATON_STATISTICS is defined.
+        */
+        std::size_t peakSize() const { return peakSize_.value(); }
+
     private:
         friend class SoleBase <Value>;
         friend class SoleValue <Value>;
 
+        /**
+        Return the pool of memory for a shard.
+        The shard must be locked if the store is concurrent.
+        */
+        SlabPool <Value> & pool (std::size_t shardIndex)
+        { return shards_ [shardIndex].pool; }
+
+        /**
+        Give back the memory of an object in the store, after it has been
+        destructed.
+        */
+        void deallocate (Value * object, std::size_t shardIndex) {
+            Shard & shard = shards_ [shardIndex];
+            Lock lock = this->lock (shard);
+            shard.pool.deallocate (object);
+        }
+
         /** \brief
         Remove the object from the store.
 
         This is called by the destructor of SoleBase or SoleValue.
         This may seem dangerous for two reasons:
-        1.  A weak_ptr to an object will be destructed while the shared_ptr and
-            the object itself is being destructed.
-            However, this is a way of implementing std::enable_shared_from_this
-            so this must be supported.
+        1.  The entry for an object will be destructed while the object itself
+            is being destructed.
+            However, the entry does not own the object.
+            For an object derived from SoleBase, the entry is a SoleEntry,
+            which holds a raw pointer and the cached hash, but no reference.
+            The reference count has already dropped to zero, so SoleEntry::get()
+            cannot hand out the object any more, and removing the entry does
+            not touch the count.
+            For other objects, the entry holds a weak_ptr, which has already
+            expired.
         2.  What if this is called in the middle of another operation on
-            objects_?
+            the objects?
             It will not.
             This is simply because this class performs mutating operations on
-            objects_ in only two places.
-            The one here only affects the shared_ptr control block.
-            The one in get() does not affect anything.
+            the objects in only a few places.
+            The one here does not affect the object.
+            The one in getOrInsert() does not affect anything.
+            The shard is locked here only after the object's destructor has
+            started, and getOrInsert() never destructs objects while it holds
+            the lock, so this cannot deadlock.
         So this is actually safe.
+
+        An object with an equal value may have been inserted in the meantime,
+        by another thread if the store is concurrent, or while the object was
+        queued for destruction.
+        It is a different object, so it is left alone.
         */
-        void removePointer (Value const * pointer) {
-           auto numberDeleted = objects_.template get <1>().erase (pointer);
-           assert (numberDeleted == 1);
-           (void) numberDeleted;
+        void removePointer (Value const * pointer, std::size_t shardIndex) {
+            Shard & shard = shards_ [shardIndex];
+            Lock lock = this->lock (shard);
+            auto numberDeleted
+                = shard.objects.template get <1>().erase (pointer);
+            assert (numberDeleted == 1);
+            (void) numberDeleted;
+            ++ removalNum_;
         }
 
     };
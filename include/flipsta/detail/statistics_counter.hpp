@@ -0,0 +1,89 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_DETAIL_STATISTICS_COUNTER_HPP_INCLUDED
+#define FLIPSTA_DETAIL_STATISTICS_COUNTER_HPP_INCLUDED
+
+#include <cstddef>
+#include <atomic>
+
+namespace flipsta { namespace detail {
+
+    /**
+    Whether statistics about operations on SharedAutomaton objects are kept.
+    This is true iff FLIPSTA_SHARED_AUTOMATON_STATISTICS is defined.
+
+    This changes the layout of SoleStore and SharedAutomatonMemo, so every
+    translation unit in a program must agree on it.
+    It should therefore be defined from the build system, for the whole
+    program, and not in a source file.
+    */
+#ifdef FLIPSTA_SHARED_AUTOMATON_STATISTICS
+    static bool constexpr statisticsEnabled = true;
+#else
+    static bool constexpr statisticsEnabled = false;
+#endif
+
+    /** \brief
+    Counter for statistics that can be compiled out.
+
+    If \a enabled is \c true, this keeps a count that can be updated from
+    multiple threads at the same time.
+    The updates use relaxed memory order, so that they are cheap, but a count
+    that is read while other threads are updating it may be slightly out of
+    date.
+
+    If \a enabled is \c false, all operations do nothing, and value() returns
+    0.
+    */
+    template <bool enabled = statisticsEnabled> class StatisticsCounter;
+
+    template <> class StatisticsCounter <true> {
+        std::atomic <std::size_t> value_;
+
+    public:
+        StatisticsCounter() : value_ (0) {}
+
+        StatisticsCounter (StatisticsCounter const &) = delete;
+        StatisticsCounter & operator= (StatisticsCounter const &) = delete;
+
+        void operator++() { value_.fetch_add (1, std::memory_order_relaxed); }
+
+        /**
+        Set the count to \a value if that is greater than the current count.
+        This is useful for keeping track of a maximum.
+        */
+        void raise (std::size_t value) {
+            std::size_t current = value_.load (std::memory_order_relaxed);
+            while (current < value && !value_.compare_exchange_weak (
+                current, value, std::memory_order_relaxed))
+            {}
+        }
+
+        std::size_t value() const
+        { return value_.load (std::memory_order_relaxed); }
+    };
+
+    template <> class StatisticsCounter <false> {
+    public:
+        void operator++() {}
+        void raise (std::size_t) {}
+        std::size_t value() const { return 0; }
+    };
+
+}} // namespace flipsta::detail
+
+#endif // FLIPSTA_DETAIL_STATISTICS_COUNTER_HPP_INCLUDED
@@ -0,0 +1,37 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_DETAIL_THREAD_NUM_HPP_INCLUDED
+#define FLIPSTA_DETAIL_THREAD_NUM_HPP_INCLUDED
+
+#include <cstddef>
+#include <algorithm>
+#include <thread>
+
+namespace flipsta { namespace detail {
+
+    /**
+    Return \a threadNum, or, if it is 0, the number of hardware threads.
+    */
+    inline std::size_t defaultThreadNum (std::size_t threadNum) {
+        if (threadNum != 0)
+            return threadNum;
+        return std::max (1u, std::thread::hardware_concurrency());
+    }
+
+}} // namespace flipsta::detail
+
+#endif // FLIPSTA_DETAIL_THREAD_NUM_HPP_INCLUDED
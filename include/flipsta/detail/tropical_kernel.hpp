@@ -0,0 +1,188 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Kernels for the tropical semiring on arrays of floating-point numbers.
+
+If the compiler targets AVX2 (for example, with -mavx2 or -march=native), and
+FLIPSTA_NO_SIMD is not defined, the kernels for float and double and 32-bit
+indices use AVX2 gather instructions.
+Otherwise, they use scalar code.
+*/
+
+#ifndef FLIPSTA_DETAIL_TROPICAL_KERNEL_HPP_INCLUDED
+#define FLIPSTA_DETAIL_TROPICAL_KERNEL_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#if defined (__AVX2__) && !defined (FLIPSTA_NO_SIMD)
+#   define FLIPSTA_TROPICAL_KERNEL_AVX2 1
+#   include <immintrin.h>
+#endif
+
+namespace flipsta { namespace detail {
+
+    /**
+    Compute the minimum of \a initial and, for all positions from \a begin to
+    \a end, <c>distances [neighbours [arc]] + weights [arc]</c>, where
+    \c arc is <c>arcs [position]</c>, or if \a arcs is null, the position
+    itself.
+
+    This is the "pull" form of relaxing the arcs onto a state in the tropical
+    semiring.
+    Since only one state is written to, there are no conflicts between the
+    arcs, and the arcs can be processed in any order.
+    */
+    template <class Float, class Index> inline
+        Float minPlusScalar (Float initial, Float const * distances,
+            Index const * neighbours, Float const * weights,
+            Index const * arcs, std::size_t begin, std::size_t end)
+    {
+        Float best = initial;
+        if (arcs) {
+            for (std::size_t position = begin; position != end; ++ position) {
+                Index arc = arcs [position];
+                Float value = distances [neighbours [arc]] + weights [arc];
+                if (value < best)
+                    best = value;
+            }
+        } else {
+            for (std::size_t arc = begin; arc != end; ++ arc) {
+                Float value = distances [neighbours [arc]] + weights [arc];
+                if (value < best)
+                    best = value;
+            }
+        }
+        return best;
+    }
+
+    /**
+    Compute the same as minPlusScalar, but use SIMD instructions if they are
+    available for \a Float and \a Index.
+    */
+    template <class Float, class Index> inline
+        Float minPlus (Float initial, Float const * distances,
+            Index const * neighbours, Float const * weights,
+            Index const * arcs, std::size_t begin, std::size_t end)
+    {
+        return minPlusScalar (
+            initial, distances, neighbours, weights, arcs, begin, end);
+    }
+
+#if FLIPSTA_TROPICAL_KERNEL_AVX2
+
+    /*
+    The gather instructions take signed 32-bit indices.
+    The indices are states and arc indices, which the caller asserts to be
+    less than 2^31.
+    */
+
+    inline float minPlus (float initial, float const * distances,
+        std::uint32_t const * neighbours, float const * weights,
+        std::uint32_t const * arcs, std::size_t begin, std::size_t end)
+    {
+        int const * neighbourInts = reinterpret_cast <int const *> (neighbours);
+        __m256 best = _mm256_set1_ps (std::numeric_limits <float>::infinity());
+        std::size_t position = begin;
+        if (arcs) {
+            for (; position + 8 <= end; position += 8) {
+                __m256i arc = _mm256_loadu_si256 (
+                    reinterpret_cast <__m256i const *> (arcs + position));
+                __m256i neighbour = _mm256_i32gather_epi32 (
+                    neighbourInts, arc, 4);
+                __m256 value = _mm256_add_ps (
+                    _mm256_i32gather_ps (distances, neighbour, 4),
+                    _mm256_i32gather_ps (weights, arc, 4));
+                best = _mm256_min_ps (best, value);
+            }
+        } else {
+            for (; position + 8 <= end; position += 8) {
+                __m256i neighbour = _mm256_loadu_si256 (
+                    reinterpret_cast <__m256i const *> (neighbours + position));
+                __m256 value = _mm256_add_ps (
+                    _mm256_i32gather_ps (distances, neighbour, 4),
+                    _mm256_loadu_ps (weights + position));
+                best = _mm256_min_ps (best, value);
+            }
+        }
+        // Horizontal minimum.
+        __m128 half = _mm_min_ps (_mm256_castps256_ps128 (best),
+            _mm256_extractf128_ps (best, 1));
+        half = _mm_min_ps (half, _mm_movehl_ps (half, half));
+        half = _mm_min_ss (half, _mm_shuffle_ps (half, half, 1));
+        float vectorBest = _mm_cvtss_f32 (half);
+        if (vectorBest < initial)
+            initial = vectorBest;
+
+        return minPlusScalar (
+            initial, distances, neighbours, weights, arcs, position, end);
+    }
+
+    inline double minPlus (double initial, double const * distances,
+        std::uint32_t const * neighbours, double const * weights,
+        std::uint32_t const * arcs, std::size_t begin, std::size_t end)
+    {
+        int const * neighbourInts = reinterpret_cast <int const *> (neighbours);
+        __m256d best = _mm256_set1_pd (
+            std::numeric_limits <double>::infinity());
+        // Use the masked gathers, with all lanes enabled: the unmasked ones
+        // cause spurious warnings about uninitialised values on GCC.
+        __m256d const zero = _mm256_setzero_pd();
+        __m256d const all = _mm256_castsi256_pd (_mm256_set1_epi64x (-1));
+        std::size_t position = begin;
+        if (arcs) {
+            for (; position + 4 <= end; position += 4) {
+                __m128i arc = _mm_loadu_si128 (
+                    reinterpret_cast <__m128i const *> (arcs + position));
+                __m128i neighbour = _mm_i32gather_epi32 (
+                    neighbourInts, arc, 4);
+                __m256d value = _mm256_add_pd (
+                    _mm256_mask_i32gather_pd (
+                        zero, distances, neighbour, all, 8),
+                    _mm256_mask_i32gather_pd (zero, weights, arc, all, 8));
+                best = _mm256_min_pd (best, value);
+            }
+        } else {
+            for (; position + 4 <= end; position += 4) {
+                __m128i neighbour = _mm_loadu_si128 (
+                    reinterpret_cast <__m128i const *> (neighbours + position));
+                __m256d value = _mm256_add_pd (
+                    _mm256_mask_i32gather_pd (
+                        zero, distances, neighbour, all, 8),
+                    _mm256_loadu_pd (weights + position));
+                best = _mm256_min_pd (best, value);
+            }
+        }
+        // Horizontal minimum.
+        __m128d half = _mm_min_pd (_mm256_castpd256_pd128 (best),
+            _mm256_extractf128_pd (best, 1));
+        half = _mm_min_sd (half, _mm_unpackhi_pd (half, half));
+        double vectorBest = _mm_cvtsd_f64 (half);
+        if (vectorBest < initial)
+            initial = vectorBest;
+
+        return minPlusScalar (
+            initial, distances, neighbours, weights, arcs, position, end);
+    }
+
+#endif // FLIPSTA_TROPICAL_KERNEL_AVX2
+
+}} // namespace flipsta::detail
+
+#endif // FLIPSTA_DETAIL_TROPICAL_KERNEL_HPP_INCLUDED
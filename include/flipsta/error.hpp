@@ -50,6 +50,12 @@ struct StateExists : virtual Error {};
 */
 struct AutomatonNotAcyclic : virtual Error {};
 
+/**
+\brief Exception that indicates that data that is read is not in the expected
+format.
+*/
+struct FormatError : virtual Error {};
+
 
 /* boost::error_info tags. */
 
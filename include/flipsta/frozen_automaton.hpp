@@ -0,0 +1,579 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_FROZEN_AUTOMATON_HPP_INCLUDED
+#define FLIPSTA_FROZEN_AUTOMATON_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include <boost/mpl/if.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+
+#include "utility/returns.hpp"
+#include "utility/unique_ptr.hpp"
+#include "utility/pointee.hpp"
+
+#include "rime/call_if.hpp"
+
+#include "range/core.hpp"
+#include "range/tuple.hpp"
+#include "range/transform.hpp"
+#include "range/iterator_range.hpp"
+#include "range/std/container.hpp"
+#include "range/std/tuple.hpp"
+#include "range/for_each_macro.hpp"
+
+#include "math/magma.hpp"
+#include "math/cost.hpp"
+#include "math/product.hpp"
+
+#include "core.hpp"
+#include "label.hpp"
+#include "error.hpp"
+#include "arc.hpp"
+#include "map.hpp"
+#include "renumber_states.hpp"
+
+namespace flipsta {
+
+/** \brief
+Array of labels, one for each arc.
+
+By default, this is a std::vector of labels.
+For \c math::product, it is specialised to keep a separate std::vector for
+each component, so that algorithms that need only one component, say the
+weight, can run through contiguous memory that contains only that component.
+For \c math::cost, it is specialised to keep the underlying values, so that
+kernels can use them as an array of \c float or \c double.
+
+\tparam Label The (compressed) label type.
+*/
+template <class Label> class LabelArray {
+    std::vector <Label> labels_;
+
+public:
+    /// \brief Reserve memory for \a size labels.
+    void reserve (std::size_t size) { labels_.reserve (size); }
+
+    /// \brief Return the number of labels.
+    std::size_t size() const { return labels_.size(); }
+
+    /// \brief Append a label at the end.
+    void push_back (Label const & label) { labels_.push_back (label); }
+
+    /// \brief Return the label at \a index.
+    Label const & operator[] (std::size_t index) const
+    { return labels_ [index]; }
+
+    /// \brief Return the underlying vector of labels.
+    std::vector <Label> const & labels() const { return labels_; }
+};
+
+/// \cond DONT_DOCUMENT
+namespace frozen_automaton_detail {
+
+    /**
+    Push component \a index and all subsequent ones of a tuple onto the vector
+    at the same position in a tuple of vectors.
+    */
+    template <std::size_t index, std::size_t size> struct PushComponents {
+        template <class Vectors, class Components>
+            void operator() (Vectors & vectors, Components const & components)
+            const
+        {
+            range::at_c <index> (vectors).push_back (
+                range::at_c <index> (components));
+            PushComponents <index + 1, size>() (vectors, components);
+        }
+    };
+
+    template <std::size_t size> struct PushComponents <size, size> {
+        template <class Vectors, class Components>
+            void operator() (Vectors &, Components const &) const {}
+    };
+
+    template <std::size_t index, std::size_t size> struct ReserveComponents {
+        template <class Vectors>
+            void operator() (Vectors & vectors, std::size_t capacity) const
+        {
+            range::at_c <index> (vectors).reserve (capacity);
+            ReserveComponents <index + 1, size>() (vectors, capacity);
+        }
+    };
+
+    template <std::size_t size> struct ReserveComponents <size, size> {
+        template <class Vectors> void operator() (Vectors &, std::size_t) const
+        {}
+    };
+
+    /// Return the element at a given index in a vector.
+    class ElementAt {
+        std::size_t index_;
+    public:
+        explicit ElementAt (std::size_t index) : index_ (index) {}
+
+        template <class Element> Element const & operator() (
+            std::vector <Element> const & elements) const
+        { return elements [index_]; }
+    };
+
+} // namespace frozen_automaton_detail
+
+/**
+Specialisation for math::cost: keep the values.
+*/
+template <class Value> class LabelArray <math::cost <Value>> {
+    typedef math::cost <Value> Label;
+    std::vector <Value> values_;
+
+public:
+    void reserve (std::size_t size) { values_.reserve (size); }
+
+    std::size_t size() const { return values_.size(); }
+
+    void push_back (Label const & label) { values_.push_back (label.value()); }
+
+    Label operator[] (std::size_t index) const
+    { return Label (values_ [index]); }
+
+    /**
+    Return the std::vector that contains the values of all labels.
+    */
+    std::vector <Value> const & values() const { return values_; }
+};
+
+/**
+Specialisation for math::product: keep the components in separate arrays.
+*/
+template <class ... Components, class Inverses>
+    class LabelArray <math::product <math::over <Components ...>, Inverses>>
+{
+    typedef math::product <math::over <Components ...>, Inverses> Label;
+    typedef range::tuple <std::vector <Components> ...> Vectors;
+    Vectors components_;
+
+public:
+    void reserve (std::size_t size) {
+        frozen_automaton_detail::ReserveComponents <0, sizeof ... (Components)
+            >() (components_, size);
+    }
+
+    std::size_t size() const { return range::first (components_).size(); }
+
+    void push_back (Label const & label) {
+        frozen_automaton_detail::PushComponents <0, sizeof ... (Components)
+            >() (components_, label.components());
+    }
+
+    /**
+    Return the label at \a index.
+    This assembles the label from its components.
+    */
+    Label operator[] (std::size_t index) const {
+        return math::make_product_over <Inverses> (range::transform (
+            components_, frozen_automaton_detail::ElementAt (index)));
+    }
+
+    /**
+    Return the std::vector that contains component \a index of all labels.
+    */
+    template <std::size_t index> auto component() const
+    RETURNS (range::at_c <index> (components_));
+};
+/// \endcond
+
+template <class Label, class TerminalLabel = void,
+    class Index = std::uint32_t>
+class FrozenAutomaton;
+
+struct FrozenAutomatonTag;
+
+/// \cond DONT_DOCUMENT
+template <class Label, class TerminalLabel, class Index>
+    struct AutomatonTagUnqualified <
+        FrozenAutomaton <Label, TerminalLabel, Index>>
+{ typedef FrozenAutomatonTag type; };
+/// \endcond
+
+/** \brief
+An automaton that cannot be changed, and is laid out in memory for fast
+traversal.
+
+This is normally produced by \ref freeze.
+The states are <c>Dense \<Index></c>, numbered consecutively from 0.
+The arcs are kept in compressed sparse row format: they are sorted by source
+state, and for each state, the offset of its first arc is kept.
+For the backward direction, there is a list of arc indices sorted by
+destination state, with offsets in the same way.
+The fields of the arcs are kept in separate arrays: sources, destinations, and
+labels, where the labels are kept in a LabelArray.
+Arcs are produced on the fly when they are requested through
+\c arcsOnCompressed.
+
+Algorithms that know about this class can use arcRange() to find the indices
+of the arcs on a state, and then use destinations(), sources(), and labels()
+directly.
+
+\tparam Label The label type on arcs.
+\tparam TerminalLabel
+    (optional) The label type for initial and final states.
+    If it is not given, it is set to the result type of calling
+    <c>math::one \<Label>()</c>.
+\tparam Index
+    (optional) The integer type used for states and for arc indices.
+    By default, this is \c std::uint32_t.
+*/
+template <class Label_, class TerminalLabel_, class Index_>
+    class FrozenAutomaton
+{
+public:
+    typedef Index_ Index;
+    typedef Dense <Index> State;
+
+    typedef Label_ Label;
+
+    typedef typename boost::mpl::if_ <
+            std::is_same <TerminalLabel_, void>,
+            typename label::GetDefaultTerminalLabel <Label>::type,
+            TerminalLabel_
+        >::type TerminalLabel;
+
+    typedef typename label::DefaultDescriptorFor <Label>::type Descriptor;
+
+    typedef typename label::CompressedLabelType <Descriptor, Label>::type
+        CompressedLabel;
+    typedef typename label::CompressedLabelType <Descriptor, TerminalLabel
+        >::type CompressedTerminalLabel;
+
+    typedef ExplicitArc <State, CompressedLabel> Arc;
+
+private:
+    typedef std::pair <State, CompressedTerminalLabel> TerminalStateLabel;
+
+    Descriptor descriptor_;
+    std::size_t stateNum_;
+
+    // By arc index.
+    std::vector <Index> sources_;
+    std::vector <Index> destinations_;
+    LabelArray <CompressedLabel> labels_;
+
+    // By state: the first arc index; and one more element at the end.
+    std::vector <Index> forwardOffsets_;
+    // By state: the first position in backwardArcs_.
+    std::vector <Index> backwardOffsets_;
+    // Arc indices, sorted by destination state.
+    std::vector <Index> backwardArcs_;
+
+    std::vector <TerminalStateLabel> initialStates_;
+    std::vector <TerminalStateLabel> finalStates_;
+    Map <State, std::size_t, false, false, map_policy::FlatHash>
+        initialPositions_;
+    Map <State, std::size_t, false, false, map_policy::FlatHash>
+        finalPositions_;
+
+    std::vector <TerminalStateLabel> const & terminalStatesContainer (Forward)
+        const
+    { return initialStates_; }
+    std::vector <TerminalStateLabel> const & terminalStatesContainer (Backward)
+        const
+    { return finalStates_; }
+
+    Map <State, std::size_t, false, false, map_policy::FlatHash> const &
+        terminalPositions (Forward) const
+    { return initialPositions_; }
+    Map <State, std::size_t, false, false, map_policy::FlatHash> const &
+        terminalPositions (Backward) const
+    { return finalPositions_; }
+
+    /// Produce the arc with the given index.
+    class MakeArc {
+        FrozenAutomaton const * automaton_;
+    public:
+        explicit MakeArc (FrozenAutomaton const & automaton)
+        : automaton_ (&automaton) {}
+
+        Arc operator() (Index arc) const {
+            return Arc (forward, State (automaton_->sources_ [arc]),
+                State (automaton_->destinations_ [arc]),
+                automaton_->labels_ [arc]);
+        }
+    };
+
+    struct IndexToState {
+        State operator() (Index index) const { return State (index); }
+    };
+
+    typedef boost::counting_iterator <Index> CountingIterator;
+
+    template <class OriginalState, class Automaton, class Direction>
+        void copyTerminalStates (Automaton const & automaton,
+            Direction direction,
+            StateNumbering <OriginalState, Index> const & numbering,
+            std::vector <TerminalStateLabel> & states,
+            Map <State, std::size_t, false, false, map_policy::FlatHash> &
+                positions)
+    {
+        RANGE_FOR_EACH (stateLabel,
+            terminalStatesCompressed (automaton, direction))
+        {
+            State state = numbering.denseState (range::first (stateLabel));
+            positions.set (state, states.size());
+            states.push_back (TerminalStateLabel (
+                state, range::second (stateLabel)));
+        }
+    }
+
+public:
+    /** \brief
+    Copy an automaton, with the states renumbered as in \a numbering.
+
+    Normally, \ref freeze should be used instead.
+
+    \param automaton
+        The automaton to copy.
+        Its descriptor and compressed label types must be the same as those of
+        this class.
+    \param numbering
+        The numbering of the states.
+    \throw StateNotFound
+        If a state in the automaton is not in \a numbering.
+    */
+    template <class Automaton, class OriginalState>
+        FrozenAutomaton (Automaton const & automaton,
+            StateNumbering <OriginalState, Index> const & numbering)
+    : descriptor_ (flipsta::descriptor (automaton)),
+        stateNum_ (numbering.size()),
+        forwardOffsets_ (numbering.size() + 1, 0),
+        backwardOffsets_ (numbering.size() + 1, 0)
+    {
+        auto const & originalStates = numbering.originalStates();
+
+        // Forward: the arcs are sorted by source already.
+        for (std::size_t source = 0; source != stateNum_; ++ source) {
+            RANGE_FOR_EACH (arc, arcsOnCompressed (
+                automaton, forward, originalStates [source]))
+            {
+                assert (sources_.size() < std::numeric_limits <Index>::max());
+                sources_.push_back (Index (source));
+                destinations_.push_back (
+                    numbering.denseState (arc.state (forward)).value());
+                labels_.push_back (arc.label());
+            }
+            forwardOffsets_ [source + 1] = Index (sources_.size());
+        }
+
+        // Backward: counting sort of the arc indices by destination.
+        for (Index destination : destinations_)
+            ++ backwardOffsets_ [destination + 1];
+        for (std::size_t state = 0; state != stateNum_; ++ state)
+            backwardOffsets_ [state + 1] += backwardOffsets_ [state];
+        backwardArcs_.resize (destinations_.size());
+        {
+            std::vector <Index> next (
+                backwardOffsets_.begin(), backwardOffsets_.end() - 1);
+            for (std::size_t arc = 0; arc != destinations_.size(); ++ arc)
+                backwardArcs_ [next [destinations_ [arc]] ++] = Index (arc);
+        }
+
+        copyTerminalStates (automaton, forward, numbering,
+            initialStates_, initialPositions_);
+        copyTerminalStates (automaton, backward, numbering,
+            finalStates_, finalPositions_);
+    }
+
+    /** \brief
+    Return the number of states.
+    The states are numbered from 0 to one less than this.
+    */
+    std::size_t stateNum() const { return stateNum_; }
+
+    /** \brief
+    Return the number of arcs.
+    */
+    std::size_t arcNum() const { return sources_.size(); }
+
+    /** \brief
+    Return the source state of each arc, by arc index.
+    */
+    std::vector <Index> const & sources() const { return sources_; }
+
+    /** \brief
+    Return the destination state of each arc, by arc index.
+    */
+    std::vector <Index> const & destinations() const { return destinations_; }
+
+    /** \brief
+    Return the compressed labels of the arcs, by arc index.
+    */
+    LabelArray <CompressedLabel> const & labels() const { return labels_; }
+
+    /** \brief
+    Return the range of arc indices of the arcs that leave \a state.
+
+    \return A pair with the first index and one past the last one.
+    */
+    std::pair <Index, Index> arcRange (Forward, State const & state) const {
+        assert (state.value() < stateNum_);
+        return std::make_pair (forwardOffsets_ [state.value()],
+            forwardOffsets_ [state.value() + 1]);
+    }
+
+    /** \brief
+    Return the range of positions in backwardArcs() of the arcs that enter
+    \a state.
+
+    \return A pair with the first position and one past the last one.
+    */
+    std::pair <Index, Index> arcRange (Backward, State const & state) const {
+        assert (state.value() < stateNum_);
+        return std::make_pair (backwardOffsets_ [state.value()],
+            backwardOffsets_ [state.value() + 1]);
+    }
+
+    /** \brief
+    Return the arc indices sorted by destination state.
+    */
+    std::vector <Index> const & backwardArcs() const { return backwardArcs_; }
+
+    /* Methods for immutable access. */
+    /// \cond DONT_DOCUMENT
+    Descriptor const & descriptor() const { return descriptor_; }
+
+    auto states() const
+    RETURNS (range::transform (range::make_iterator_range (
+            CountingIterator (0), CountingIterator (Index (stateNum_))),
+        IndexToState()));
+
+    bool hasState (State const & state) const
+    { return std::size_t (state.value()) < stateNum_; }
+
+    template <class Direction>
+        auto terminalStatesCompressed (Direction direction) const
+    RETURNS (range::make_iterator_range (terminalStatesContainer (direction)));
+
+private:
+    /// Return zero in the internal label type.
+    struct ReturnZeroCompressed {
+        template <class Position> auto operator() (Position const &) const
+        RETURNS (math::zero <CompressedTerminalLabel>());
+    };
+
+    /// Return the label at the position.
+    struct GetLabel {
+        std::vector <TerminalStateLabel> const & states_;
+
+        explicit GetLabel (std::vector <TerminalStateLabel> const & states)
+        : states_ (states) {}
+
+        CompressedTerminalLabel const & operator() (
+            std::size_t const * position) const
+        { return states_ [*position].second; }
+    };
+
+public:
+    template <class Direction>
+        typename label::GeneraliseToZero <CompressedTerminalLabel>::type
+            terminalLabelCompressed (Direction direction, State const & state)
+            const
+    {
+        auto const & positions = terminalPositions (direction);
+        std::size_t const * position = positions.contains (state)
+            ? &positions [state] : nullptr;
+        return rime::call_if <math::merge_magma> (position == nullptr,
+            ReturnZeroCompressed(),
+            GetLabel (terminalStatesContainer (direction)), position);
+    }
+
+    auto arcsOnCompressed (Forward, State const & state) const
+    RETURNS (range::transform (range::make_iterator_range (
+            CountingIterator (forwardOffsets_ [state.value()]),
+            CountingIterator (forwardOffsets_ [state.value() + 1])),
+        MakeArc (*this)));
+
+    auto arcsOnCompressed (Backward, State const & state) const
+    RETURNS (range::transform (range::make_iterator_range (
+            backwardArcs_.begin() + backwardOffsets_ [state.value()],
+            backwardArcs_.begin() + backwardOffsets_ [state.value() + 1]),
+        MakeArc (*this)));
+    /// \endcond
+};
+
+/** \brief
+Compute the type of the automaton that \ref freeze returns.
+*/
+template <class AutomatonPtr, class Index = std::uint32_t>
+    struct FrozenAutomatonType
+{
+    typedef typename std::decay <
+        typename utility::pointee <AutomatonPtr>::type>::type Original;
+
+    typedef FrozenAutomaton <typename Original::Label,
+        typename Original::TerminalLabel, Index> type;
+};
+
+/** \brief
+Produce an immutable copy of an automaton that is laid out for fast traversal.
+
+The states are numbered with \a numbering.
+The result has the same descriptor and labels as the original.
+
+\param automaton
+    Pointer to the automaton to copy.
+\param numbering
+    The numbering of the states, normally produced by \ref numberStates.
+    The original states can be retrieved from this.
+
+\pre The descriptor type of the original automaton must be the default
+    descriptor for its label type.
+\throw StateNotFound
+    If a state in the automaton is not in \a numbering.
+*/
+template <class AutomatonPtr, class State, class Index>
+    inline std::unique_ptr <
+        typename FrozenAutomatonType <AutomatonPtr, Index>::type>
+    freeze (AutomatonPtr const & automaton,
+        StateNumbering <State, Index> const & numbering)
+{
+    typedef typename FrozenAutomatonType <AutomatonPtr, Index>::type Result;
+    return utility::make_unique <Result> (*automaton, numbering);
+}
+
+/** \brief
+Produce an immutable copy of an automaton that is laid out for fast traversal.
+
+The states are numbered with \ref numberStates, so that if the automaton is
+acyclic, arcs always go from lower to higher states.
+The mapping to the original states is discarded.
+
+\param automaton
+    Pointer to the automaton to copy.
+*/
+template <class AutomatonPtr>
+    inline std::unique_ptr <typename FrozenAutomatonType <AutomatonPtr>::type>
+    freeze (AutomatonPtr const & automaton)
+{ return freeze (automaton, numberStates (automaton)); }
+
+} // namespace flipsta
+
+#endif // FLIPSTA_FROZEN_AUTOMATON_HPP_INCLUDED
@@ -40,6 +40,8 @@ Define structures related to labels.
 #include "math/sequence.hpp"
 #include "math/alphabet.hpp"
 
+#include "core/dense.hpp"
+
 namespace flipsta {
 
 namespace label {
@@ -166,6 +168,13 @@ namespace label {
     template <class Symbol> struct ChooseAlphabet
     { typedef AlphabetDescriptor <Symbol> type; };
 
+    /*
+    Symbols that are dense integers are used directly as their internal
+    representation, so they do not need an alphabet.
+    */
+    template <class Integer> struct ChooseAlphabet <Dense <Integer>>
+    { typedef NoDescriptor type; };
+
     // Sequences.
     template <class Symbol, class Direction>
         struct DefaultDescriptorFor <math::sequence <Symbol, Direction>>
@@ -17,6 +17,9 @@ limitations under the License.
 #ifndef FLIPSTA_MAP_HPP_INCLUDED
 #define FLIPSTA_MAP_HPP_INCLUDED
 
+#include <cstdint>
+#include <cassert>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -29,15 +32,104 @@ limitations under the License.
 #include "range/for_each.hpp"
 
 #include "core/dense.hpp"
+#include "detail/flat_hash_map.hpp"
 
 namespace flipsta {
 
+/** \brief
+Policies that select how Map stores its data if it cannot use a vector.
+*/
+namespace map_policy {
+
+    /** \brief
+    Use std::unordered_map, which allocates a node for each entry.
+    Pointers to values remain valid until they are removed.
+    */
+    struct NodeHash {};
+
+    /** \brief
+    Use an open-addressing hash table, which stores all entries in one array.
+    This is faster when many keys are inserted and removed.
+    */
+    struct FlatHash {};
+
+    /** \brief
+    For \c Dense keys with a dense cover, pack values into \a bitNum bits
+    each.
+
+    The value type must be an integer or enumeration type whose values fit in
+    \a bitNum bits.
+    This is useful for small values like flags, which would otherwise take up
+    at least one byte per key.
+    For other keys, this falls back to FlatHash.
+
+    \tparam bitNum
+        The number of bits per value.
+        This must be a divisor of 64 smaller than 64.
+    */
+    template <std::size_t bitNum> struct Packed {};
+
+} // namespace map_policy
+
 template <class Key, class Value,
-    bool hasDefault = false, bool alwaysContain = false>
+    bool hasDefault = false, bool alwaysContain = false,
+    class Policy = map_policy::NodeHash>
 class Map;
 
 namespace map_detail {
 
+    /*
+    Storage for Map, with a uniform interface.
+    */
+    template <class Key, class Value, class Policy> class Storage;
+
+    template <class Key, class Value>
+        class Storage <Key, Value, map_policy::NodeHash>
+    {
+        typedef std::unordered_map <Key, Value, boost::hash <Key>> Data;
+        Data data_;
+
+    public:
+        bool contains (Key const & key) const
+        { return data_.count (key) != 0; }
+
+        Value const * find (Key const & key) const {
+            auto position = data_.find (key);
+            if (position == data_.end())
+                return nullptr;
+            return &position->second;
+        }
+
+        Value * find (Key const & key) {
+            auto position = data_.find (key);
+            if (position == data_.end())
+                return nullptr;
+            return &position->second;
+        }
+
+        void set (Key const & key, Value const & value) {
+            // emplace is not implemented on GCC 4.6.
+            auto result = data_.insert (std::make_pair (key, value));
+            if (!result.second)
+                result.first->second = value;
+        }
+
+        void erase (Key const & key) { data_.erase (key); }
+
+        void reserve (std::size_t keyNum) { data_.reserve (keyNum); }
+
+        void clear() { data_.clear(); }
+    };
+
+    template <class Key, class Value>
+        class Storage <Key, Value, map_policy::FlatHash>
+    : public detail::FlatHashMap <Key, Value> {};
+
+    // Values can only be packed for Dense keys, so use FlatHash otherwise.
+    template <class Key, class Value, std::size_t bitNum>
+        class Storage <Key, Value, map_policy::Packed <bitNum>>
+    : public Storage <Key, Value, map_policy::FlatHash> {};
+
     template <class Value, bool hasDefault> struct WithDefault;
 
     template <class Value> struct WithDefault <Value, false> {
@@ -96,7 +188,7 @@ containers, but with a different interface.
 
 All operations are amortised constant time.
 
-Normally this wraps a std::unordered_map.
+Normally this wraps a hash map, which \a Policy selects.
 However, if \a hasDefault and \a alwaysContain are both true, and \a Key is
 \c Dense<>, then a std::vector is used.
 This should be faster by a constant factor in cases where a key space is dense.
@@ -120,11 +212,19 @@ This should be faster by a constant factor in cases where a key space is dense.
     close to zero.
     If \a Key type is dense, this may then use a vector instead of a hash map.
     This gives a constant-factor speedup.
+\tparam Policy
+    map_policy::NodeHash (the default) to use std::unordered_map, or
+    map_policy::FlatHash to use an open-addressing hash map, which does not
+    allocate memory for each entry.
+    map_policy::Packed stores small values for \c Dense keys in a few bits
+    each, if \a hasDefault and \a alwaysContain are both true.
+    In that case, \c operator[] returns values instead of references.
 */
-template <class Key, class Value, bool hasDefault, bool alwaysContain>
+template <class Key, class Value, bool hasDefault, bool alwaysContain,
+    class Policy>
     class Map : map_detail::WithDefault <Value, hasDefault>
 {
-    typedef std::unordered_map <Key, Value, boost::hash <Key>> Data;
+    typedef map_detail::Storage <Key, Value, Policy> Data;
     Data data_;
     typedef map_detail::WithDefault <Value, hasDefault> WithDefault;
     static_assert (!alwaysContain || hasDefault,
@@ -206,7 +306,7 @@ public:
         >::type
     /// \endcond
             contains (Key const & key) const
-    { return data_.count (key) != 0; }
+    { return data_.contains (key); }
 
     /// \cond DONT_DOCUMENT
     template <bool alwaysContain2 = alwaysContain>
@@ -221,12 +321,16 @@ public:
     If the key is not in the map, it is inserted.
     If the key is already in the map, the value is replaced by \a value.
     */
-    void set (Key const & key, Value const &value) {
-        // emplace is not implemented on GCC 4.6.
-        auto result = data_.insert (std::make_pair (key, value));
-        if (!result.second)
-            result.first->second = value;
-    }
+    void set (Key const & key, Value const &value)
+    { data_.set (key, value); }
+
+    /**
+    \brief Prepare the map to contain \a keyNum keys without reallocating.
+
+    For \c Dense keys, this should be the number of keys that is used, so that
+    keys from 0 to <c>keyNum - 1</c> can be set.
+    */
+    void reserve (std::size_t keyNum) { data_.reserve (keyNum); }
 
     /**
     \brief Return a const-reference to the value corresponding to \a key.
@@ -234,10 +338,10 @@ public:
     */
     Value const & operator[] (Key const & key) const {
         auto position = data_.find (key);
-        if (position == data_.end())
+        if (!position)
             return this->defaultValue();
         else
-            return position->second;
+            return *position;
     }
 
     /**
@@ -249,10 +353,10 @@ public:
     */
     typename WithDefault::DefaultReference operator[] (Key const & key) {
         auto position = data_.find (key);
-        if (position == data_.end())
+        if (!position)
             return this->defaultValue();
         else
-            return position->second;
+            return *position;
     }
 
     /**
@@ -262,12 +366,20 @@ public:
     \pre \a key must be in the map.
     */
     void remove (Key const & key) { data_.erase (key); }
+
+    /**
+    \brief Remove all values from the map.
+
+    The default value is retained, and the memory that has been allocated is
+    kept, so that the map can be reused without reallocating.
+    */
+    void clear() { data_.clear(); }
 };
 
 /// \cond DONT_DOCUMENT
 // For Dense <Key> with a dense cover: optimise using a std::vector.
-template <class Key, class Value>
-    class Map <Dense <Key>, Value, true, true>
+template <class Key, class Value, class Policy>
+    class Map <Dense <Key>, Value, true, true, Policy>
 {
     typedef std::vector <Value> Data;
     Data data_;
@@ -287,6 +399,11 @@ public:
     rime::true_type contains (Dense <Key> const & key) const
     { return rime::true_; }
 
+    void reserve (std::size_t keyNum) {
+        if (data_.size() < keyNum)
+            data_.resize (keyNum, defaultValue_);
+    }
+
     void set (Dense <Key> const & key_, Value const & value) {
         std::size_t key (key_.value());
         if (data_.size() <= key)
@@ -309,9 +426,137 @@ public:
             data_ [key] = defaultValue_;
         // Otherwise, it is already explicitly the default value.
     }
+
+    // Keys beyond the end of data_ have the default value, and data_ keeps its
+    // capacity, so this takes constant time however large the map has been.
+    void clear() { data_.clear(); }
+};
+
+// For Dense <Key> with a dense cover and small values: pack the values.
+template <class Key, class Value, std::size_t bitNum>
+    class Map <Dense <Key>, Value, true, true, map_policy::Packed <bitNum>>
+{
+    static_assert (bitNum > 0 && bitNum < 64 && 64 % bitNum == 0,
+        "The number of bits must be a divisor of 64 smaller than 64.");
+    static_assert (std::is_integral <Value>::value
+        || std::is_enum <Value>::value,
+        "Only integers and enumerations can be packed.");
+
+    typedef std::uint64_t Word;
+    static std::size_t constexpr valuesPerWord = 64 / bitNum;
+    static Word constexpr valueMask = (Word (1) << bitNum) - 1;
+
+    std::vector <Word> data_;
+    Value defaultValue_;
+    // The default value repeated to fill a word.
+    Word defaultWord_;
+
+    static Word toBits (Value const & value) {
+        Word bits = static_cast <Word> (value);
+        assert (bits <= valueMask);
+        return bits;
+    }
+
+    static Word repeat (Word bits) {
+        Word word = 0;
+        for (std::size_t i = 0; i != valuesPerWord; ++ i)
+            word |= bits << (i * bitNum);
+        return word;
+    }
+
+public:
+    Map (Value const & defaultValue)
+    : defaultValue_ (defaultValue),
+        defaultWord_ (repeat (toBits (defaultValue))) {}
+
+    template <class Range, class Enable = typename
+        boost::enable_if <range::is_range <Range>>::type>
+    Map (Value const & defaultValue, Range && initialValues)
+    : defaultValue_ (defaultValue),
+        defaultWord_ (repeat (toBits (defaultValue)))
+    {
+        range::for_each (std::forward <Range> (initialValues),
+            map_detail::InsertKeyValue <Map> (*this));
+    }
+
+    rime::true_type contains (Dense <Key> const & key) const
+    { return rime::true_; }
+
+    void reserve (std::size_t keyNum) {
+        std::size_t wordNum = (keyNum + valuesPerWord - 1) / valuesPerWord;
+        if (data_.size() < wordNum)
+            data_.resize (wordNum, defaultWord_);
+    }
+
+    void set (Dense <Key> const & key_, Value const & value) {
+        std::size_t key (key_.value());
+        std::size_t wordIndex = key / valuesPerWord;
+        if (data_.size() <= wordIndex)
+            data_.resize (wordIndex + 1, defaultWord_);
+        std::size_t shift = (key % valuesPerWord) * bitNum;
+        Word & word = data_ [wordIndex];
+        word = (word & ~(valueMask << shift)) | (toBits (value) << shift);
+    }
+
+    Value operator[] (Dense <Key> const & key_) const {
+        std::size_t key (key_.value());
+        std::size_t wordIndex = key / valuesPerWord;
+        if (wordIndex < data_.size()) {
+            std::size_t shift = (key % valuesPerWord) * bitNum;
+            return static_cast <Value> (
+                (data_ [wordIndex] >> shift) & valueMask);
+        } else
+            return defaultValue_;
+    }
+
+    void remove (Dense <Key> const & key_) {
+        if (std::size_t (key_.value()) / valuesPerWord < data_.size())
+            set (key_, defaultValue_);
+        // Otherwise, it is already explicitly the default value.
+    }
+
+    // Keys beyond the end of data_ have the default value.
+    void clear() { data_.clear(); }
 };
 /// \endcond
 
+/** \brief
+Set of states, for example to keep track of which states have been seen.
+
+For \c Dense states, this is a bit set, which takes one bit per state.
+Otherwise, an open-addressing hash map is used.
+*/
+template <class State> class StateSet {
+    Map <State, bool, true, true, map_policy::Packed <1>> contained_;
+
+public:
+    /**
+    \brief Initialise as empty.
+    */
+    StateSet() : contained_ (false) {}
+
+    /**
+    \brief Initialise as empty, but reserve space for \a stateNum states.
+
+    For \c Dense states, this should be the number of states, so that all
+    states can be inserted without reallocation.
+    */
+    explicit StateSet (std::size_t stateNum) : contained_ (false)
+    { contained_.reserve (stateNum); }
+
+    /// \brief Return whether \a state is in the set.
+    bool contains (State const & state) const { return contained_ [state]; }
+
+    /// \brief Insert \a state into the set.
+    void insert (State const & state) { contained_.set (state, true); }
+
+    /// \brief Remove \a state from the set.
+    void remove (State const & state) { contained_.remove (state); }
+
+    /// \brief Remove all states from the set, but keep the memory.
+    void clear() { contained_.clear(); }
+};
+
 } // namespace flipsta
 
 #endif // FLIPSTA_MAP_HPP_INCLUDED
@@ -17,7 +17,10 @@ limitations under the License.
 #ifndef FLIPSTA_QUEUE_HPP_INCLUDED
 #define FLIPSTA_QUEUE_HPP_INCLUDED
 
+#include <cstddef>
 #include <stack>
+#include <queue>
+#include <deque>
 #include <vector>
 
 namespace flipsta {
@@ -70,6 +73,74 @@ public:
         data_.pop();
         return e;
     }
+
+    /** \brief
+    Remove all elements, but keep the memory allocated.
+    */
+    void clear() {
+        while (!data_.empty())
+            data_.pop();
+    }
+};
+
+/**
+\brief First-in, first-out queue.
+
+Elements that are pushed onto this queue first are popped off first.
+*/
+template <class Element> class FifoQueue {
+    std::queue <Element, std::deque <Element>> data_;
+public:
+    /// \brief Return whether this queue is empty.
+    bool empty() const { return data_.empty(); }
+
+    /// \brief Return the number of elements in the queue.
+    std::size_t size() const { return data_.size(); }
+
+    /** \brief
+    Push an element onto the queue.
+    */
+    void push (Element const & element) { return data_.push (element); }
+
+    /** \brief
+    Return the next element that will be returned by pop().
+
+    Does not remove the element.
+
+    \pre \c !empty().
+    */
+    Element const & head() const { return data_.front(); }
+
+    /** \brief
+    Return a reference to the next element that will be returned by pop().
+
+    Does not remove the element.
+
+    \pre \c !empty().
+    */
+    Element & head() { return data_.front(); }
+
+    /**
+    \brief Pop an element off the queue.
+
+    This is the first element that was pushed onto the queue that has not yet
+    been popped off.
+
+    \pre \c !empty().
+    */
+    Element pop() {
+        Element e = data_.front();
+        data_.pop();
+        return e;
+    }
+
+    /** \brief
+    Remove all elements.
+    */
+    void clear() {
+        while (!data_.empty())
+            data_.pop();
+    }
 };
 
 } // namespace flipsta
@@ -0,0 +1,380 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Find reachable states in automata with dense states, using multiple threads.
+*/
+
+#ifndef FLIPSTA_REACHABLE_HPP_INCLUDED
+#define FLIPSTA_REACHABLE_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <system_error>
+#include <type_traits>
+
+#include "utility/pointee.hpp"
+
+#include "range/core.hpp"
+#include "range/for_each_macro.hpp"
+
+#include "core.hpp"
+#include "map.hpp"
+#include "detail/thread_num.hpp"
+
+namespace flipsta {
+
+namespace reachable_detail {
+
+    /**
+    Set of integers from 0 to a given size that can be added to from multiple
+    threads at the same time.
+    */
+    class AtomicBitSet {
+        typedef std::atomic <std::uint64_t> Word;
+        std::unique_ptr <Word []> words_;
+        std::size_t size_;
+
+        static std::size_t wordNum (std::size_t size)
+        { return (size + 63) / 64; }
+
+    public:
+        explicit AtomicBitSet (std::size_t size)
+        : words_ (new Word [wordNum (size)]), size_ (size)
+        {
+            for (std::size_t index = 0; index != wordNum (size); ++ index)
+                words_ [index].store (0, std::memory_order_relaxed);
+        }
+
+        std::size_t size() const { return size_; }
+
+        bool contains (std::size_t index) const {
+            assert (index < size_);
+            return (words_ [index / 64].load (std::memory_order_relaxed)
+                >> (index % 64)) & 1;
+        }
+
+        /**
+        Add \a index to the set.
+        \return \c true iff \a index was not in the set yet.
+        If more than one thread adds the same index at the same time, exactly
+        one of them gets \c true.
+        */
+        bool claim (std::size_t index) {
+            assert (index < size_);
+            std::uint64_t bit = std::uint64_t (1) << (index % 64);
+            Word & word = words_ [index / 64];
+            // Avoid the read-modify-write if possible.
+            if (word.load (std::memory_order_relaxed) & bit)
+                return false;
+            return !(word.fetch_or (bit, std::memory_order_relaxed) & bit);
+        }
+    };
+
+    template <class State> struct DenseIndex {
+        static_assert (!std::is_same <State, State>::value,
+            "Parallel reachability requires Dense states.");
+    };
+
+    template <class Index> struct DenseIndex <Dense <Index>> {
+        std::size_t operator() (Dense <Index> const & state) const
+        { return std::size_t (state.value()); }
+    };
+
+    /**
+    Level-synchronous breadth-first search that uses a number of threads.
+
+    The states in the current frontier are split into chunks, which threads
+    claim one at a time through an atomic cursor, so that threads that get
+    states with fewer arcs take on more chunks.
+    Each thread collects the states it discovers in its own vector.
+    When all threads have finished a level, the last one to arrive
+    concatenates these into the next frontier.
+    */
+    template <class Automaton, class Direction> class ParallelSearch {
+    public:
+        typedef typename Automaton::State State;
+
+    private:
+        static std::size_t constexpr chunkSize = 256;
+
+        Automaton const & automaton_;
+        AtomicBitSet & discovered_;
+
+        std::vector <State> frontier_;
+        std::atomic <std::size_t> cursor_;
+        std::vector <std::vector <State>> nextFrontiers_;
+
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        // All of these are protected by mutex_.
+        std::size_t threadNum_;
+        bool started_;
+        std::size_t arrived_;
+        std::size_t generation_;
+        bool finished_;
+        std::exception_ptr exception_;
+
+        std::atomic <bool> failed_;
+
+        void fail (std::exception_ptr exception) {
+            std::lock_guard <std::mutex> lock (mutex_);
+            if (!exception_)
+                exception_ = exception;
+            failed_.store (true, std::memory_order_relaxed);
+        }
+
+        void processChunks (std::vector <State> & next) {
+            DenseIndex <State> index;
+            while (!failed_.load (std::memory_order_relaxed)) {
+                std::size_t begin = cursor_.fetch_add (chunkSize);
+                if (begin >= frontier_.size())
+                    return;
+                std::size_t end
+                    = std::min (begin + chunkSize, frontier_.size());
+                for (std::size_t position = begin; position != end; ++ position)
+                {
+                    RANGE_FOR_EACH (arc, arcsOnCompressed (
+                        automaton_, Direction(), frontier_ [position]))
+                    {
+                        State state = arc.state (Direction());
+                        if (discovered_.claim (index (state)))
+                            next.push_back (state);
+                    }
+                }
+            }
+        }
+
+        /**
+        Wait until all threads have finished the current level.
+        \return \c true iff there is another level to process.
+        */
+        bool synchronise() {
+            std::unique_lock <std::mutex> lock (mutex_);
+            std::size_t generation = generation_;
+            if (++ arrived_ == threadNum_) {
+                arrived_ = 0;
+                frontier_.clear();
+                try {
+                    for (std::vector <State> & next : nextFrontiers_) {
+                        frontier_.insert (
+                            frontier_.end(), next.begin(), next.end());
+                        next.clear();
+                    }
+                } catch (...) {
+                    if (!exception_)
+                        exception_ = std::current_exception();
+                    failed_.store (true, std::memory_order_relaxed);
+                }
+                cursor_.store (0);
+                finished_ = frontier_.empty()
+                    || failed_.load (std::memory_order_relaxed);
+                ++ generation_;
+                condition_.notify_all();
+            } else {
+                condition_.wait (lock,
+                    [&] { return generation_ != generation; });
+            }
+            return !finished_;
+        }
+
+        void work (std::size_t thread) {
+            {
+                std::unique_lock <std::mutex> lock (mutex_);
+                condition_.wait (lock, [this] { return started_; });
+            }
+            do {
+                try {
+                    processChunks (nextFrontiers_ [thread]);
+                } catch (...) {
+                    fail (std::current_exception());
+                }
+            } while (synchronise());
+        }
+
+    public:
+        ParallelSearch (Automaton const & automaton, AtomicBitSet & discovered)
+        : automaton_ (automaton), discovered_ (discovered), cursor_ (0),
+            threadNum_ (1), started_ (false), arrived_ (0), generation_ (0),
+            finished_ (false), failed_ (false) {}
+
+        /**
+        Add a state to start from.
+        This must be called before run().
+        */
+        void addStart (State const & state) {
+            if (discovered_.claim (DenseIndex <State>() (state)))
+                frontier_.push_back (state);
+        }
+
+        /**
+        Run the search with at most \a threadNum threads, including the calling
+        thread.
+        If fewer threads can be started, the search continues with those.
+        \throw Any exception that one of the threads has thrown.
+        */
+        void run (std::size_t threadNum) {
+            assert (threadNum >= 1);
+            if (frontier_.empty())
+                return;
+            nextFrontiers_.resize (threadNum);
+
+            std::vector <std::thread> threads;
+            threads.reserve (threadNum - 1);
+            try {
+                for (std::size_t thread = 1; thread != threadNum; ++ thread)
+                    threads.emplace_back (&ParallelSearch::work, this, thread);
+            } catch (std::system_error &) {
+                // Carry on with the threads that did start.
+            }
+            {
+                std::lock_guard <std::mutex> lock (mutex_);
+                threadNum_ = threads.size() + 1;
+                started_ = true;
+            }
+            condition_.notify_all();
+
+            work (0);
+            for (std::thread & thread : threads)
+                thread.join();
+
+            if (exception_)
+                std::rethrow_exception (exception_);
+        }
+    };
+
+    template <class Automaton, class Direction>
+        inline void findReachable (Automaton const & automaton,
+            Direction const & direction, AtomicBitSet & discovered,
+            std::size_t threadNum)
+    {
+        ParallelSearch <Automaton, Direction> search (automaton, discovered);
+        RANGE_FOR_EACH (stateLabel,
+            terminalStatesCompressed (automaton, direction))
+            search.addStart (range::first (stateLabel));
+        search.run (threadNum);
+    }
+
+    template <class State> inline StateSet <State>
+        toStateSet (AtomicBitSet const & set)
+    {
+        StateSet <State> result (set.size());
+        for (std::size_t index = 0; index != set.size(); ++ index)
+            if (set.contains (index))
+                result.insert (State (index));
+        return result;
+    }
+
+} // namespace reachable_detail
+
+/** \brief
+Return the set of states that can be reached from the terminal states in
+\a direction, using multiple threads.
+
+This yields the same states as those that \ref traverseBreadthFirst visits.
+However, the states on each level of the breadth-first search are divided
+between threads, which mark states as visited in a bit set with atomic
+operations.
+This pays off only for large automata: for small ones, starting the threads
+takes longer than the search itself.
+
+\pre The automaton must not be changed while this runs, and its
+    \c arcsOnCompressed must be safe to call from multiple threads at the same
+    time.
+
+\param automaton
+    Pointer to the automaton, the states of which must be \c Dense.
+\param direction
+    The direction in which to follow arcs.
+    If this is \c forward, the search starts at the initial states; if it is
+    \c backward, at the final states.
+\param stateNum
+    One more than the highest state in the automaton.
+\param threadNum
+    (optional) The maximum number of threads to use.
+    If this is 0, which is the default, the number of hardware threads is
+    used.
+
+\return A StateSet that contains the reachable states.
+\throw Any exception that is thrown while following arcs.
+*/
+template <class AutomatonPtr, class Direction>
+    inline StateSet <typename PtrStateType <AutomatonPtr>::type>
+    reachableStates (AutomatonPtr const & automaton,
+        Direction const & direction, std::size_t stateNum,
+        std::size_t threadNum = 0)
+{
+    typedef typename PtrStateType <AutomatonPtr>::type State;
+    reachable_detail::AtomicBitSet reachable (stateNum);
+    reachable_detail::findReachable (*automaton, direction, reachable,
+        detail::defaultThreadNum (threadNum));
+    return reachable_detail::toStateSet <State> (reachable);
+}
+
+/** \brief
+Return the set of states that are on a path from an initial state to a final
+state, using multiple threads.
+
+These are the states that are both reachable from an initial state and
+co-reachable from a final state.
+All other states can be removed from the automaton without changing the
+result of any algorithm.
+The searches in both directions are performed as in \ref reachableStates.
+
+\param automaton
+    Pointer to the automaton, the states of which must be \c Dense.
+\param stateNum
+    One more than the highest state in the automaton.
+\param threadNum
+    (optional) The maximum number of threads to use.
+    If this is 0, which is the default, the number of hardware threads is
+    used.
+
+\return A StateSet that contains the states that are connected.
+\throw Any exception that is thrown while following arcs.
+*/
+template <class AutomatonPtr>
+    inline StateSet <typename PtrStateType <AutomatonPtr>::type>
+    connectedStates (AutomatonPtr const & automaton, std::size_t stateNum,
+        std::size_t threadNum = 0)
+{
+    typedef typename PtrStateType <AutomatonPtr>::type State;
+    threadNum = detail::defaultThreadNum (threadNum);
+    reachable_detail::AtomicBitSet reachable (stateNum);
+    reachable_detail::findReachable (*automaton, forward, reachable, threadNum);
+    reachable_detail::AtomicBitSet coReachable (stateNum);
+    reachable_detail::findReachable (
+        *automaton, backward, coReachable, threadNum);
+
+    StateSet <State> result (stateNum);
+    for (std::size_t index = 0; index != stateNum; ++ index)
+        if (reachable.contains (index) && coReachable.contains (index))
+            result.insert (State (index));
+    return result;
+}
+
+} // namespace flipsta
+
+#endif // FLIPSTA_REACHABLE_HPP_INCLUDED
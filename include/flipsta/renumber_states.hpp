@@ -0,0 +1,244 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_RENUMBER_STATES_HPP_INCLUDED
+#define FLIPSTA_RENUMBER_STATES_HPP_INCLUDED
+
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <vector>
+#include <memory>
+#include <type_traits>
+
+#include "utility/unique_ptr.hpp"
+#include "utility/pointee.hpp"
+
+#include "range/core.hpp"
+#include "range/for_each_macro.hpp"
+
+#include "core.hpp"
+#include "error.hpp"
+#include "map.hpp"
+#include "automaton.hpp"
+#include "traverse.hpp"
+
+namespace flipsta {
+
+/** \brief
+Two-way mapping between the states of an automaton and dense integers.
+
+Objects of this class are normally produced by \ref numberStates.
+The dense states are numbered consecutively from 0.
+
+Algorithms that use \c Map with <c>Dense \<></c> keys can then use a vector
+instead of a hash map.
+
+\tparam OriginalState
+    The type of the states of the original automaton.
+\tparam Index
+    The integer type that the dense states wrap.
+*/
+template <class OriginalState, class Index = std::uint32_t>
+    class StateNumbering
+{
+public:
+    typedef Dense <Index> DenseState;
+
+private:
+    Map <OriginalState, DenseState, false, false, map_policy::FlatHash>
+        denseStates_;
+    std::vector <OriginalState> originalStates_;
+
+public:
+    /** \brief
+    Initialise with no states.
+    */
+    StateNumbering() {}
+
+    /** \brief
+    Add a state, and return its dense number.
+
+    If the state is already in the numbering, return the existing number.
+    Otherwise, it is given the next number.
+    */
+    DenseState add (OriginalState const & state) {
+        if (denseStates_.contains (state))
+            return denseStates_ [state];
+        assert (originalStates_.size() < std::numeric_limits <Index>::max());
+        DenseState result (Index (originalStates_.size()));
+        denseStates_.set (state, result);
+        originalStates_.push_back (state);
+        return result;
+    }
+
+    /** \brief
+    Return the number of states.
+    */
+    std::size_t size() const { return originalStates_.size(); }
+
+    /** \brief
+    Return whether \a state has been numbered.
+    */
+    bool contains (OriginalState const & state) const
+    { return denseStates_.contains (state); }
+
+    /** \brief
+    Return the dense state that \a state maps to.
+    \throw StateNotFound iff \a state is not in the numbering.
+    */
+    DenseState denseState (OriginalState const & state) const {
+        if (!denseStates_.contains (state))
+            throw StateNotFound() << errorInfoState <OriginalState> (state);
+        return denseStates_ [state];
+    }
+
+    /** \brief
+    Return the original state that \a state maps to.
+    \throw StateNotFound iff \a state is not in the numbering.
+    */
+    OriginalState const & originalState (DenseState const & state) const {
+        if (state.value() >= originalStates_.size())
+            throw StateNotFound() << errorInfoState <DenseState> (state);
+        return originalStates_ [state.value()];
+    }
+
+    /** \brief
+    Return the original states, indexed by their dense state.
+    */
+    std::vector <OriginalState> const & originalStates() const
+    { return originalStates_; }
+};
+
+/** \brief
+Number the states of an automaton densely, from 0.
+
+The states are numbered in reverse order of finishing a depth-first traversal
+in \a direction (see \ref traverse).
+If the automaton is acyclic, this is a topological order, so that in
+\a direction, arcs always go from a lower number to a higher number.
+Otherwise, states on paths from the initial states still tend to be close
+together.
+
+This takes linear time in the number of arcs, and linear space in the number
+of states.
+
+\param automaton
+    Pointer to the automaton.
+\param direction
+    (optional) The direction in which to traverse the automaton.
+    By default, this is \c forward.
+\tparam Index
+    (optional) The integer type that the dense states wrap.
+    By default, this is \c std::uint32_t.
+*/
+template <class Index = std::uint32_t, class AutomatonPtr,
+    class Direction = Forward>
+inline StateNumbering <typename PtrStateType <AutomatonPtr>::type, Index>
+    numberStates (AutomatonPtr && automaton,
+        Direction const & direction = Direction())
+{
+    typedef typename PtrStateType <AutomatonPtr>::type State;
+    std::vector <State> finished;
+    RANGE_FOR_EACH (report, traverse (
+        std::forward <AutomatonPtr> (automaton), direction))
+    {
+        if (report.event == TraversalEvent::finishVisit)
+            finished.push_back (report.state);
+    }
+
+    StateNumbering <State, Index> numbering;
+    for (auto state = finished.rbegin(); state != finished.rend(); ++ state)
+        numbering.add (*state);
+    return numbering;
+}
+
+/** \brief
+Compute the type of the automaton that \ref renumberStates returns.
+
+This is an explicit Automaton with the same labels as the original, but with
+<c>Dense \<Index></c> as the state type.
+*/
+template <class AutomatonPtr, class Index = std::uint32_t>
+    struct RenumberedAutomatonType
+{
+    typedef typename std::decay <
+        typename utility::pointee <AutomatonPtr>::type>::type Original;
+
+    typedef Automaton <Dense <Index>, typename Original::Label,
+        typename Original::TerminalLabel> type;
+};
+
+/** \brief
+Produce a copy of the automaton with states replaced by dense integers.
+
+The resulting automaton has the same descriptor and the same labels as the
+original.
+Its states are <c>Dense \<Index></c>, so that algorithms on it can use vectors
+instead of hash maps to store information about states.
+
+\param automaton
+    Pointer to the automaton to copy.
+\param numbering
+    The numbering of the states, normally produced by \ref numberStates.
+    The original states can be retrieved from this.
+
+\pre All states of \a automaton must be in \a numbering.
+\pre The descriptor type of the original automaton must be the default
+    descriptor for its label type.
+*/
+template <class AutomatonPtr, class State, class Index>
+inline std::unique_ptr <
+    typename RenumberedAutomatonType <AutomatonPtr, Index>::type>
+    renumberStates (AutomatonPtr && automaton,
+        StateNumbering <State, Index> const & numbering)
+{
+    typedef typename RenumberedAutomatonType <AutomatonPtr, Index>::type
+        Result;
+    typedef Dense <Index> DenseState;
+
+    auto result = utility::make_unique <Result> (
+        flipsta::descriptor (*automaton));
+
+    auto const & originalStates = numbering.originalStates();
+    for (std::size_t index = 0; index != originalStates.size(); ++ index)
+        result->addState (DenseState (Index (index)));
+
+    for (std::size_t index = 0; index != originalStates.size(); ++ index) {
+        DenseState source (Index (index));
+        RANGE_FOR_EACH (arc,
+            flipsta::arcsOn (*automaton, forward, originalStates [index]))
+        {
+            result->addArc (source,
+                numbering.denseState (arc.state (forward)), arc.label());
+        }
+    }
+
+    RANGE_FOR_EACH (stateLabel, flipsta::terminalStates (*automaton, forward))
+        result->setTerminalLabel (forward,
+            numbering.denseState (range::first (stateLabel)),
+            range::second (stateLabel));
+    RANGE_FOR_EACH (stateLabel, flipsta::terminalStates (*automaton, backward))
+        result->setTerminalLabel (backward,
+            numbering.denseState (range::first (stateLabel)),
+            range::second (stateLabel));
+
+    return std::move (result);
+}
+
+} // namespace flipsta
+
+#endif // FLIPSTA_RENUMBER_STATES_HPP_INCLUDED
@@ -17,8 +17,18 @@ limitations under the License.
 #ifndef FLIPSTA_SHARED_AUTOMATON_HPP_INCLUDED
 #define FLIPSTA_SHARED_AUTOMATON_HPP_INCLUDED
 
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <limits>
 #include <map>
+#include <memory>
+#include <queue>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <boost/functional/hash.hpp>
 
@@ -52,6 +62,8 @@ values, so that the hash value of a whole automaton is always fast to compute.
 It has a final weight, the weight assigned to the path ending at this state.
 Arcs out of the state are represented with a sequence of zero or more keys
 (often symbols) with a weight and a destination state attached to them.
+Since the state never changes after construction, the arcs are kept in a
+vector sorted by key, rather than in a node-based container.
 
 The state is determinised with respect to the key by definition, since each
 key can have only one weight and one destination state.
@@ -64,7 +76,7 @@ weight and all the weights attached to keys) must be semiring-one.
 There is a store of states that keeps track of all states.
 Whenever a SharedState is created, it must checked whether a SharedState with
 the same values exists already.
-If such a SharedState exists, the shared_ptr to it is used.
+If such a SharedState exists, the pointer to it is used.
 Otherwise, it is created and kept in the store to be used next time a
 SharedState with the same value is required.
 
@@ -72,12 +84,16 @@ The state is minimised since all states are normalised and then looked up in the
 store.
 Any two states with the same suffix (as it is called) will therefore be the same
 object.
+
+States are held through \ref detail::SolePtr, which uses a reference count
+inside the state, rather than std::shared_ptr.
 */
 template <class Key, class Weight> class SharedState
 : detail::SoleBase <SharedState <Key, Weight>>
 {
     friend class detail::SoleBase <SharedState>;
     friend struct detail::SharedAutomatonOperations <Key, Weight>;
+    friend class SharedAutomatonMemo <Key, Weight>;
 
     typedef detail::SoleBase <SharedState <Key, Weight>> SoleBase;
     typedef typename SoleBase::Store Store;
@@ -86,22 +102,38 @@ template <class Key, class Weight> class SharedState
 public:
     typedef SharedAutomaton <Key, Weight> Automaton;
 
+    /// \brief The type of pointer to a state.
+    typedef detail::SolePtr <SharedState> Pointer;
+
+    /** \brief
+    The type of the outgoing arcs: pairs of key and automaton, sorted by key,
+    with each key appearing at most once.
+    */
+    typedef std::vector <std::pair <Key, Automaton>> Arcs;
+
 private:
-    typedef std::map <Key, Automaton> Arcs;
+    // The shards of the memo that hold unions that this state has been an
+    // argument to, as a bit mask.
+    // Only these shards need to be searched when this is destructed.
+    mutable std::atomic <std::uint64_t> memoShards_;
 
-    Weight const finalWeight_;
-    Arcs const arcs_;
+    // These are not const, so that the move constructor can move them, but
+    // nothing changes them after construction.
+    Weight finalWeight_;
+    Arcs arcs_;
 
     std::size_t hash_;
 
     // The hash is cached, because it becomes slow to compute for a whole
     // automaton.
+    // The hash values of the destination states are cached too, so this takes
+    // time linear in the number of arcs.
     std::size_t computeHash() const {
         std::size_t seed = 0;
-        boost::hash_combine (seed, finalWeight_);
+        detail::combineHash (seed, boost::hash <Weight>() (finalWeight_));
         RANGE_FOR_EACH (arc, arcs_) {
-            boost::hash_combine (seed, arc.first);
-            boost::hash_combine (seed, arc.second);
+            detail::combineHash (seed, boost::hash <Key>() (arc.first));
+            detail::combineHash (seed, hash_value (arc.second));
         }
         return seed;
     }
@@ -111,17 +143,25 @@ private:
         RANGE_FOR_EACH (arc, arcs_)
             sum = sum + arc.second.startWeight();
         assert (math::approximately_equal (sum, math::one <Weight>()));
+        assert (std::adjacent_find (arcs_.begin(), arcs_.end(),
+            [] (typename Arcs::value_type const & left,
+                typename Arcs::value_type const & right)
+            { return !(left.first < right.first); }) == arcs_.end());
     }
 
+    static Arcs fromMap (std::map <Key, Automaton> const & arcs)
+    { return Arcs (arcs.begin(), arcs.end()); }
+
     Memo * memo() const { return static_cast <Memo *> (SoleBase::store()); }
 
 public:
     SharedState (SharedState const & that)
-    : SoleBase (that), finalWeight_ (that.finalWeight_), arcs_ (that.arcs_),
-        hash_ (that.hash_) {}
+    : SoleBase (that), memoShards_ (0), finalWeight_ (that.finalWeight_),
+        arcs_ (that.arcs_), hash_ (that.hash_) {}
 
     SharedState (SharedState && that)
-    : SoleBase (std::move (that)), finalWeight_ (std::move (that.finalWeight_)),
+    : SoleBase (std::move (that)), memoShards_ (0),
+        finalWeight_ (std::move (that.finalWeight_)),
         arcs_ (std::move (that.arcs_)), hash_ (that.hash_) {}
 
     /** \brief
@@ -133,32 +173,48 @@ public:
     \post <c>finalWeight() == math::zero \<Weight>()</c>
     */
     explicit SharedState()
-    : SoleBase (nullptr), finalWeight_ (math::one <Weight>()), arcs_(),
-        hash_ (computeHash())
+    : SoleBase (nullptr), memoShards_ (0),
+        finalWeight_ (math::one <Weight>()), arcs_(), hash_ (computeHash())
     { assertNormalised(); }
 
     /** \brief
     Initialise explicitly, with a final weight and outgoing arcs.
+
+    \pre The arcs are sorted by key, and each key appears at most once.
     */
     SharedState (Memo * memo, Weight const & finalWeight, Arcs const & arcs)
-    : SoleBase (memo), finalWeight_ (finalWeight), arcs_ (arcs),
-        hash_ (computeHash())
+    : SoleBase (memo), memoShards_ (0), finalWeight_ (finalWeight),
+        arcs_ (arcs), hash_ (computeHash())
     { assertNormalised(); }
 
     /** \brief
     Initialise explicitly, with a final weight and outgoing arcs.
 
     The arcs are moved.
+    \pre The arcs are sorted by key, and each key appears at most once.
     */
     SharedState (Memo * memo, Weight const & finalWeight, Arcs && arcs)
-    : SoleBase (memo), finalWeight_ (finalWeight), arcs_ (std::move (arcs)),
-        hash_ (computeHash())
+    : SoleBase (memo), memoShards_ (0), finalWeight_ (finalWeight),
+        arcs_ (std::move (arcs)), hash_ (computeHash())
+    { assertNormalised(); }
+
+    /** \brief
+    Initialise explicitly, with a final weight and outgoing arcs given as a
+    map from key to automaton.
+    */
+    SharedState (Memo * memo, Weight const & finalWeight,
+        std::map <Key, Automaton> const & arcs)
+    : SoleBase (memo), memoShards_ (0), finalWeight_ (finalWeight),
+        arcs_ (fromMap (arcs)), hash_ (computeHash())
     { assertNormalised(); }
 
     ~SharedState() {
         // Remove this state from the memo: it will not be passed to union()
         // anymore now.
-        if (memo())
+        // The last reference has just been released, which synchronises with
+        // the release of any reference that was held while setting
+        // memoShards_.
+        if (memo() && memoShards_.load (std::memory_order_relaxed) != 0)
             memo()->removeStatePointer (this);
     }
 
@@ -169,28 +225,54 @@ public:
     Weight const & finalWeight() const { return finalWeight_; }
 
     /**
-    \return The outgoing arcs, as a sequence of pairs of key and automata.
+    \return The outgoing arcs, as a sequence of pairs of key and automata,
+    sorted by key.
     */
     Arcs const & arcs() const { return arcs_; }
 
     /** \brief
-    Return a \c shared_ptr to the singleton final state.
+    Find the arc with key \a key.
+
+    \return A pointer to the automaton that follows the key, or \c nullptr if
+    there is no arc with the key.
+    */
+    Automaton const * findArc (Key const & key) const {
+        auto position = std::lower_bound (arcs_.begin(), arcs_.end(), key,
+            [] (typename Arcs::value_type const & arc, Key const & key)
+            { return arc.first < key; });
+        if (position == arcs_.end() || key < position->first)
+            return nullptr;
+        return &position->second;
+    }
+
+    /** \brief
+    Return a pointer to the singleton final state.
 
     It is useful for this to be a singleton object so that it can be found
     without any reference to a SoleStore.
     */
-    static std::shared_ptr <SharedState const> finalState() {
-        static std::shared_ptr <SharedState const> state
-            = std::make_shared <SharedState>();
+    static Pointer finalState() {
+        static Pointer state = detail::makeSole <SharedState>();
         return state;
     }
 
     friend std::size_t hash_value (SharedState const & state)
     { return state.hash_; }
 
+    /** \brief
+    Return \c true iff the two states have the same final weight and the same
+    arcs.
+
+    The destination states of the arcs are compared by identity, since equal
+    states are the same object.
+    Therefore, this takes time linear in the number of arcs, and does not
+    recurse.
+    The cached hash values are compared first.
+    */
     bool operator== (SharedState const & that) const {
         return this == &that
-            || (this->finalWeight_ == that.finalWeight_
+            || (this->hash_ == that.hash_
+                && this->finalWeight_ == that.finalWeight_
                 && this->arcs_ == that.arcs_);
     }
 };
@@ -220,7 +302,7 @@ public:
 
 private:
     Weight startWeight_;
-    std::shared_ptr <State const> state_;
+    detail::SolePtr <State> state_;
 
 public:
     // Make sure that the copy and move constructors are defined.
@@ -249,7 +331,7 @@ public:
     Either the start weight must be zero, or the state must be non-null.
     */
     SharedAutomaton (
-        Weight const & startWeight, std::shared_ptr <State const> const & state)
+        Weight const & startWeight, detail::SolePtr <State> const & state)
     : startWeight_ (startWeight),
         state_ (startWeight == math::zero <Weight>() ? nullptr : state)
     {
@@ -282,11 +364,11 @@ public:
     { this->startWeight_ = math::divide <math::left> (this->startWeight_, w); }
 
     /** \brief
-    Return A std::shared_ptr to the state.
+    Return a pointer to the state.
 
-    The shared_ptr is empty iff \c startWeight() is zero.
+    The pointer is null iff \c startWeight() is zero.
     */
-    std::shared_ptr <State const> state() const { return state_; }
+    detail::SolePtr <State> const & state() const { return state_; }
 
     /** \brief
     Return \c true iff the automaton is a null automaton, which allows no
@@ -294,19 +376,32 @@ public:
     */
     bool isNull() const { return startWeight() == math::zero <Weight>(); }
 
+    /** \brief
+    Return \c true iff the two automata have the same start weight and the
+    same state.
+
+    Since equal states in a memo are the same object, the states are compared
+    by identity.
+    This is the same as comparing the automata structurally, as long as their
+    states are in the same memo.
+    */
     bool operator == (SharedAutomaton const & that) const {
         return this->startWeight_ == that.startWeight_
-            && *this->state_ == *that.state_;
+            && this->state_ == that.state_;
     }
+
+    bool operator != (SharedAutomaton const & that) const
+    { return !(*this == that); }
 };
 
 template <class Key, class Weight> inline
     std::size_t hash_value (SharedAutomaton <Key, Weight> const & automaton)
 {
     std::size_t seed = 0;
-    boost::hash_combine (seed, automaton.startWeight());
+    detail::combineHash (
+        seed, boost::hash <Weight>() (automaton.startWeight()));
     if (automaton.state())
-        boost::hash_combine (seed, *automaton.state());
+        detail::combineHash (seed, hash_value (*automaton.state()));
     return seed;
 }
 
@@ -321,12 +416,19 @@ namespace detail {
 
         typedef SharedState <Key, Weight> State;
         typedef SharedAutomaton <Key, Weight> Automaton;
-        typedef std::shared_ptr <State const> StatePtr;
+        typedef detail::SolePtr <State> StatePtr;
 
-        typedef std::map <Key, Automaton> Arcs;
+        typedef typename State::Arcs Arcs;
 
         typedef SharedAutomatonMemo <Key, Weight> Memo;
 
+        /**
+        Return the memo that the state of \a automaton uses, or null if the
+        automaton is null or its state is the final state.
+        */
+        static Memo * memoOf (Automaton const & automaton)
+        { return automaton.isNull() ? nullptr : automaton.state()->memo(); }
+
         /** \brief
         Normalise a start weight and arcs.
 
@@ -372,8 +474,8 @@ namespace detail {
         Compute a union of two automata where one automaton has a start weight
         of one, and its arcs are a temporary.
 
-        This case can be optimised since the arcs of the other automaton can be
-        added to the arcs of the one.
+        This case can be optimised since the arcs of the one automaton can be
+        moved into the result, rather than copied.
 
         The arcs do not have to be normalised.
         */
@@ -382,25 +484,42 @@ namespace detail {
             Weight const & rightPreWeight, Weight const & rightFinalWeight,
             Arcs const & rightArcs)
         {
-            RANGE_FOR_EACH (rightArc, rightArcs) {
-                auto leftArc = arcs.find (rightArc.first);
-                if (leftArc == arcs.end()) {
-                    arcs.insert (std::make_pair (rightArc.first, Automaton (
-                        rightPreWeight * rightArc.second.startWeight(),
-                        rightArc.second.state())));
+            // Merge the two sorted sequences of arcs.
+            Arcs newArcs;
+            newArcs.reserve (arcs.size() + rightArcs.size());
+            auto leftArc = arcs.begin();
+            auto rightArc = rightArcs.begin();
+            while (leftArc != arcs.end() && rightArc != rightArcs.end()) {
+                if (leftArc->first < rightArc->first) {
+                    newArcs.push_back (std::move (*leftArc));
+                    ++ leftArc;
                 } else {
-                    // Left and right arc have the same key.
                     Automaton right (
-                        rightPreWeight * rightArc.second.startWeight(),
-                        rightArc.second.state());
-                    leftArc->second =
-                        union_ (std::move (leftArc->second), std::move (right));
+                        rightPreWeight * rightArc->second.startWeight(),
+                        rightArc->second.state());
+                    if (rightArc->first < leftArc->first) {
+                        newArcs.emplace_back (
+                            rightArc->first, std::move (right));
+                    } else {
+                        // Left and right arc have the same key.
+                        newArcs.emplace_back (leftArc->first, union_ (
+                            std::move (leftArc->second), std::move (right)));
+                        ++ leftArc;
+                    }
+                    ++ rightArc;
                 }
             }
+            for (; leftArc != arcs.end(); ++ leftArc)
+                newArcs.push_back (std::move (*leftArc));
+            for (; rightArc != rightArcs.end(); ++ rightArc) {
+                newArcs.emplace_back (rightArc->first, Automaton (
+                    rightPreWeight * rightArc->second.startWeight(),
+                    rightArc->second.state()));
+            }
 
             return makeAutomaton (memo,
                 leftFinalWeight + rightPreWeight * rightFinalWeight,
-                std::move (arcs));
+                std::move (newArcs));
         }
 
         /** \brief
@@ -443,7 +562,9 @@ namespace detail {
             }
 
             // Merge leftArcs and rightArcs.
+            // Since both are sorted, the result is sorted too.
             Arcs newArcs;
+            newArcs.reserve (leftArcs.size() + rightArcs.size());
             auto leftCurrent = range::view (leftArcs);
             auto rightCurrent = range::view (rightArcs);
             while (!range::empty (leftCurrent) && !range::empty (rightCurrent))
@@ -453,13 +574,13 @@ namespace detail {
 
                 if (leftArc.first < rightArc.first) {
                     // Left arc has the lowest key, so insert it.
-                    newArcs.insert (std::make_pair (leftArc.first,
+                    newArcs.push_back (std::make_pair (leftArc.first,
                         Automaton (leftPreWeight * leftArc.second.startWeight(),
                             leftArc.second.state())));
                     leftCurrent = range::drop (leftCurrent);
                 } else if (rightArc.first < leftArc.first) {
                     // Right arc has the lowest key, so insert it.
-                    newArcs.insert (std::make_pair (rightArc.first,
+                    newArcs.push_back (std::make_pair (rightArc.first,
                         Automaton (
                             rightPreWeight * rightArc.second.startWeight(),
                             rightArc.second.state())));
@@ -472,7 +593,7 @@ namespace detail {
                     Automaton right (
                         rightPreWeight * rightArc.second.startWeight(),
                         rightArc.second.state());
-                    newArcs.insert (std::make_pair (leftArc.first,
+                    newArcs.push_back (std::make_pair (leftArc.first,
                         union_ (std::move (left), std::move (right))));
 
                     leftCurrent = range::drop (leftCurrent);
@@ -481,12 +602,12 @@ namespace detail {
             }
 
             RANGE_FOR_EACH (leftArc, leftCurrent) {
-                newArcs.insert (std::make_pair (leftArc.first,
+                newArcs.push_back (std::make_pair (leftArc.first,
                     Automaton (leftPreWeight * leftArc.second.startWeight(),
                         leftArc.second.state())));
             }
             RANGE_FOR_EACH (rightArc, rightCurrent) {
-                newArcs.insert (std::make_pair (rightArc.first,
+                newArcs.push_back (std::make_pair (rightArc.first,
                     Automaton (rightPreWeight * rightArc.second.startWeight(),
                         rightArc.second.state())));
             }
@@ -499,73 +620,104 @@ namespace detail {
         }
 
         /**
-        \todo The current implementation takes time in the order of the number
-        of paths in the left automaton.
-        This should be the number of distinct states.
-        For the use case of the automaton semiring, this does not make a
-        difference, but for other cases it might.
-
-        A better implementation would either:
-        1.  memoise the result of this; or
-        2.  inside of each call to this, have a closure with the right automaton
-            and a memo call itself recursively.
-            This will be faster than (1) by a constant, and it may save space
-            in practice.
-
-        But maybe we first need to think of a clear use case to make this
-        judgement call.
+        Concatenation of the states of a left automaton with a fixed right
+        automaton.
+        The result for each left state is remembered, so that a state that is
+        shared between paths is concatenated only once, and the time taken is
+        in the order of the number of distinct states in the left automaton,
+        rather than the number of paths.
+
+        The results are kept only for the duration of one call to
+        concatenate(), so no memory is kept afterwards, and the left states
+        stay alive while they are used as keys.
         */
-        static Automaton concatenate (
-            Automaton const & left, Automaton const & right)
-        {
-            // ++ sharedAutomatonOperationCounts().concatenateCalls;
-
-            typedef SharedAutomaton <Key, Weight> Automaton;
-
-            if (left.startWeight() == math::zero <Weight>()
-                    || right.startWeight() == math::zero <Weight>())
-                return Automaton (math::zero <Weight>(), nullptr);
-
-            // If the left sequence is empty: a weighted version of "right".
-            Weight leftEmptyStartWeight =
-                left.state()->finalWeight() * right.startWeight();
+        class Concatenation {
+            Automaton const & right_;
+            std::unordered_map <State const *, Automaton> results_;
+
+            /**
+            Compute the concatenation of the state with start weight one with
+            the right automaton.
+            */
+            Automaton compute (State const & left) {
+                // If the left sequence is empty: a weighted version of "right".
+                Weight leftEmptyStartWeight =
+                    left.finalWeight() * right_.startWeight();
+
+                if (statisticsEnabled) {
+                    Memo * memo = left.memo() ? left.memo() : memoOf (right_);
+                    if (memo) {
+                        ++ memo->counts_.concatenateStates;
+                        if (left.arcs().empty())
+                            ++ memo->counts_.concatenateLeftEmpty;
+                        else if (right_.state()->arcs().empty())
+                            ++ memo->counts_.concatenateRightEmpty;
+                    }
+                }
 
-            if (left.state()->arcs().empty()) {
-                // ++ sharedAutomatonOperationCounts().concatenateLeftEmpty;
-                return Automaton (left.startWeight() * leftEmptyStartWeight,
-                    right.state());
+                if (left.arcs().empty())
+                    return Automaton (leftEmptyStartWeight, right_.state());
+
+                // If the left sequence is not empty: start with each of left's
+                // keys.
+                Arcs newArcs;
+                newArcs.reserve (left.arcs().size());
+                RANGE_FOR_EACH (arc, left.arcs())
+                    newArcs.emplace_back (arc.first, (*this) (arc.second));
+
+                Memo * memo = left.memo();
+                if (leftEmptyStartWeight != math::zero <Weight>()) {
+                    return addAutomaton (memo,
+                        math::zero <Weight>(), std::move (newArcs),
+                        leftEmptyStartWeight,
+                        right_.state()->finalWeight(), right_.state()->arcs());
+                } else {
+                    return makeAutomaton (memo,
+                        math::zero <Weight>(), std::move (newArcs));
+                }
             }
 
-            if (right.state()->arcs().empty()) {
-                // ++ sharedAutomatonOperationCounts().concatenateRightEmpty;
-            }
+        public:
+            explicit Concatenation (Automaton const & right) : right_ (right) {}
 
-            // If the left sequence is not empty: start with each of left's
-            // keys.
-            Arcs newArcs;
-            RANGE_FOR_EACH (arc, left.state()->arcs()) {
-                Key key = arc.first;
-                Automaton const & automaton = arc.second;
-                Automaton newArc = concatenate (automaton, right);
-                newArcs.insert (std::make_pair (key, newArc));
-            }
+            /** \brief
+            Return the concatenation of \a left with the right automaton.
 
-            Memo * memo = left.state()->memo();
-            if (leftEmptyStartWeight != math::zero <Weight>()) {
-                Automaton result = addAutomaton (memo,
-                    math::zero <Weight>(), std::move (newArcs),
-                    leftEmptyStartWeight,
-                    right.state()->finalWeight(), right.state()->arcs());
+            \pre The right automaton is not null.
+            */
+            Automaton operator() (Automaton const & left) {
+                if (left.startWeight() == math::zero <Weight>())
+                    return Automaton (math::zero <Weight>(), nullptr);
 
-                result.premultiply (left.startWeight());
-                return std::move (result);
-            } else {
-                Automaton result = makeAutomaton (memo,
-                    math::zero <Weight>(), std::move (newArcs));
+                State const * key = left.state().get();
+                auto existing = results_.find (key);
+                if (existing == results_.end()) {
+                    Automaton result = compute (*left.state());
+                    existing = results_.insert (
+                        std::make_pair (key, std::move (result))).first;
+                }
 
+                Automaton result = existing->second;
                 result.premultiply (left.startWeight());
                 return std::move (result);
             }
+        };
+
+        static Automaton concatenate (
+            Automaton const & left, Automaton const & right)
+        {
+            if (left.startWeight() == math::zero <Weight>()
+                    || right.startWeight() == math::zero <Weight>())
+                return Automaton (math::zero <Weight>(), nullptr);
+
+            if (statisticsEnabled) {
+                Memo * memo = memoOf (left) ? memoOf (left) : memoOf (right);
+                if (memo)
+                    ++ memo->counts_.concatenateCalls;
+            }
+
+            Concatenation concatenation (right);
+            return concatenation (left);
         }
 
         /** \brief
@@ -615,6 +767,8 @@ namespace detail {
                 assert (memo != nullptr);
             }
 
+            ++ memo->counts_.unionCalls;
+
             typename Memo::UnionArguments arguments (
                 leftStartWeight, left.state(), rightStartWeight, right.state());
 
@@ -659,6 +813,122 @@ namespace detail {
             return std::move (result);
         }
 
+        /**
+        Position in the arcs of one of the automata that unionAll() merges.
+        */
+        struct ArcCursor {
+            typename Arcs::const_iterator current;
+            typename Arcs::const_iterator end;
+            Weight startWeight;
+        };
+
+        /**
+        Order cursors so that the heap has the cursor with the lowest key at
+        the top.
+        */
+        struct LaterKey {
+            bool operator() (ArcCursor const & left, ArcCursor const & right)
+                const
+            { return right.current->first < left.current->first; }
+        };
+
+        /** \brief
+        Compute the union of any number of automata.
+
+        Calling union_() on pairs of automata would create a state for each
+        intermediate result, which is then thrown away.
+        Instead, the arcs of all automata are merged in one pass, with a heap
+        on the next key of each automaton, and only the states of the result
+        are created.
+        The destinations of arcs with the same key are combined recursively in
+        the same way.
+        Where no more than two automata remain, this uses union_(), so that the
+        memo is used.
+        */
+        static Automaton unionAll (std::vector <Automaton> && automata) {
+            if (automata.size() <= 2) {
+                if (automata.empty())
+                    return Automaton (math::zero <Weight>(), nullptr);
+                if (automata.size() == 1)
+                    return std::move (automata.front());
+                return union_ (automata.front(), automata.back());
+            }
+
+            // Remove null automata, and combine automata with the same state.
+            {
+                std::unordered_map <State const *, std::size_t> positions;
+                std::size_t end = 0;
+                for (std::size_t i = 0; i != automata.size(); ++ i) {
+                    if (automata [i].isNull())
+                        continue;
+                    auto inserted = positions.insert (
+                        std::make_pair (automata [i].state().get(), end));
+                    if (inserted.second) {
+                        if (end != i)
+                            automata [end] = std::move (automata [i]);
+                        ++ end;
+                    } else {
+                        Automaton & existing =
+                            automata [inserted.first->second];
+                        existing = Automaton (existing.startWeight()
+                            + automata [i].startWeight(), existing.state());
+                    }
+                }
+                automata.erase (automata.begin() + end, automata.end());
+            }
+            if (automata.size() <= 2)
+                return unionAll (std::move (automata));
+
+            // At most one of the states is the final state, so at least one
+            // has a pointer to the memo.
+            Memo * memo = nullptr;
+            Weight finalWeight = math::zero <Weight>();
+            std::vector <ArcCursor> cursors;
+            cursors.reserve (automata.size());
+            RANGE_FOR_EACH (automaton, automata) {
+                State const & state = *automaton.state();
+                if (state.memo()) {
+                    assert (!memo || memo == state.memo());
+                    memo = state.memo();
+                }
+                finalWeight = finalWeight
+                    + automaton.startWeight() * state.finalWeight();
+                if (!state.arcs().empty()) {
+                    cursors.push_back (ArcCursor {state.arcs().begin(),
+                        state.arcs().end(), automaton.startWeight()});
+                }
+            }
+            assert (memo != nullptr);
+            ++ memo->counts_.unionAllCalls;
+
+            // Merge the arcs of all automata in order of their keys.
+            LaterKey later;
+            std::make_heap (cursors.begin(), cursors.end(), later);
+            Arcs newArcs;
+            while (!cursors.empty()) {
+                Key key = cursors.front().current->first;
+                std::vector <Automaton> destinations;
+                do {
+                    std::pop_heap (cursors.begin(), cursors.end(), later);
+                    ArcCursor & cursor = cursors.back();
+                    Automaton const & destination = cursor.current->second;
+                    destinations.emplace_back (
+                        cursor.startWeight * destination.startWeight(),
+                        destination.state());
+                    ++ cursor.current;
+                    if (cursor.current == cursor.end)
+                        cursors.pop_back();
+                    else
+                        std::push_heap (cursors.begin(), cursors.end(), later);
+                } while (!cursors.empty()
+                    && !(key < cursors.front().current->first));
+
+                newArcs.emplace_back (key, unionAll (std::move (destinations)));
+            }
+
+            return makeAutomaton (memo, finalWeight, std::move (newArcs));
+        }
+
         static void writeAttAutomaton (
             std::ostream & stream, Automaton const & automaton)
         {
@@ -713,22 +983,24 @@ namespace detail {
             }
         }
 
+        /**
+        Call \a callBack for every path.
+        \a keys contains the keys on the path so far, and is restored before
+        this returns.
+        */
         template <class CallBack> static void enumerate (
-            std::vector <Key> const & previousKeys,
-            Weight const & previousWeight,
+            std::vector <Key> & keys, Weight const & previousWeight,
             Automaton const & automaton, CallBack && callBack)
         {
             Weight currentWeight = previousWeight * automaton.startWeight();
             if (currentWeight != math::zero <Weight>()) {
                 auto const & state = *automaton.state();
                 if (state.finalWeight() != math::zero <Weight>())
-                    callBack (previousKeys,
-                        currentWeight * state.finalWeight());
+                    callBack (keys, currentWeight * state.finalWeight());
                 RANGE_FOR_EACH (arc, state.arcs()) {
-                    std::vector <Key> currentKeys = previousKeys;
-                    currentKeys.push_back (arc.first);
-                    enumerate (currentKeys, currentWeight, arc.second,
-                        callBack);
+                    keys.push_back (arc.first);
+                    enumerate (keys, currentWeight, arc.second, callBack);
+                    keys.pop_back();
                 }
             }
         }
@@ -758,6 +1030,142 @@ namespace detail {
 
 } // namespace detail
 
+/** \brief
+Lazy range with the paths through a SharedAutomaton, in order of their weights,
+best first.
+
+This is returned by bestPaths().
+Each element is a pair with the sequence of keys and the weight of the path.
+
+The paths are found with a best-first search, which keeps a priority queue of
+partial paths.
+Since SharedState is normalised, the weights are pushed towards the start, and
+the weight of the best path through a state is semiring-one.
+The weight of a partial path is therefore exactly the weight of its best
+completion, and a path can be returned as soon as it is at the top of the
+queue.
+Only the part of the automaton that leads to the paths that are returned is
+visited.
+Partial paths share their prefixes, so the keys are not copied on every arc.
+
+The weights must be in an idempotent semiring, in which \c math::plus picks
+the better of two weights, as in the tropical semiring.
+*/
+template <class Key, class Weight> class BestPathRange {
+public:
+    typedef std::pair <std::vector <Key>, Weight> Path;
+
+private:
+    typedef SharedAutomaton <Key, Weight> Automaton;
+    typedef detail::SolePtr <SharedState <Key, Weight>> StatePtr;
+
+    // Keys on a partial path, in a linked list from the last one back, so
+    // that partial paths can share their prefixes.
+    struct KeyNode {
+        Key key;
+        std::shared_ptr <KeyNode const> previous;
+        std::size_t length;
+    };
+    typedef std::shared_ptr <KeyNode const> KeyList;
+
+    // A complete path, if state is null, or a partial path.
+    struct Hypothesis {
+        Weight weight;
+        StatePtr state;
+        KeyList keys;
+    };
+
+    // Order hypotheses so that the best one is at the top of the queue.
+    struct Worse {
+        bool operator() (Hypothesis const & left, Hypothesis const & right)
+            const
+        { return better (right.weight, left.weight); }
+    };
+
+    std::priority_queue <Hypothesis, std::vector <Hypothesis>, Worse> queue_;
+    std::size_t remaining_;
+    Weight threshold_;
+
+    /**
+    Return \c true iff \a left is strictly better than \a right.
+    */
+    static bool better (Weight const & left, Weight const & right) {
+        return math::equal (left + right, left)
+            && !math::equal (left, right);
+    }
+
+    void push (Weight const & weight, StatePtr const & state, KeyList keys) {
+        if (weight != math::zero <Weight>())
+            queue_.push (Hypothesis {weight, state, std::move (keys)});
+    }
+
+    /**
+    Expand partial paths until a complete path is at the top of the queue, or
+    no path is left that is good enough.
+    */
+    void settle() {
+        while (!queue_.empty()) {
+            if (better (threshold_, queue_.top().weight)) {
+                // Any remaining path would be worse than the threshold.
+                queue_ = decltype (queue_)();
+                return;
+            }
+            if (!queue_.top().state)
+                return;
+
+            Hypothesis hypothesis = queue_.top();
+            queue_.pop();
+            auto const & state = *hypothesis.state;
+            push (hypothesis.weight * state.finalWeight(), nullptr,
+                hypothesis.keys);
+            RANGE_FOR_EACH (arc, state.arcs()) {
+                std::size_t length
+                    = hypothesis.keys ? hypothesis.keys->length + 1 : 1;
+                push (hypothesis.weight * arc.second.startWeight(),
+                    arc.second.state(), std::make_shared <KeyNode> (
+                        KeyNode {arc.first, hypothesis.keys, length}));
+            }
+        }
+    }
+
+public:
+    BestPathRange (Automaton const & automaton, std::size_t maxCount,
+        Weight const & threshold)
+    : remaining_ (maxCount), threshold_ (threshold)
+    {
+        if (remaining_ != 0)
+            push (automaton.startWeight(), automaton.state(), nullptr);
+        settle();
+    }
+
+    bool empty (::direction::front) const { return queue_.empty(); }
+
+    /** \brief
+    Return the next best path.
+    */
+    Path chop_in_place (::direction::front) {
+        assert (!queue_.empty());
+        Hypothesis hypothesis = queue_.top();
+        queue_.pop();
+
+        std::vector <Key> keys (
+            hypothesis.keys ? hypothesis.keys->length : 0);
+        auto position = keys.rbegin();
+        for (KeyNode const * node = hypothesis.keys.get(); node;
+                node = node->previous.get(), ++ position)
+            *position = node->key;
+
+        -- remaining_;
+        if (remaining_ == 0)
+            queue_ = decltype (queue_)();
+        else
+            settle();
+        return Path (std::move (keys), std::move (hypothesis.weight));
+    }
+};
+
+struct BestPathRangeTag {};
+
 // Accessor functions.
 // These should probably all be more general.
 
@@ -779,6 +1187,40 @@ template <class Key, class Weight> inline
         left, right);
 }
 
+/** \brief
+Compute the union of all automata in \a automata.
+
+This gives the same result as applying union_() to pairs of automata in turn,
+but for more than two automata it is faster, since it does not create the
+states for intermediate results.
+
+\param automata
+    Range of SharedAutomaton objects, or a \c std::vector of them, which will
+    be moved from if it is an rvalue.
+\return The union, which is the null automaton if \a automata is empty.
+*/
+template <class Key, class Weight> inline
+    SharedAutomaton <Key, Weight> unionAll (
+        std::vector <SharedAutomaton <Key, Weight>> && automata)
+{
+    return detail::SharedAutomatonOperations <Key, Weight>::unionAll (
+        std::move (automata));
+}
+
+/// \cond DONT_DOCUMENT
+template <class Automata> inline
+    typename std::decay <decltype (
+        range::first (std::declval <Automata>()))>::type
+    unionAll (Automata && automata)
+{
+    std::vector <typename std::decay <decltype (
+        range::first (std::declval <Automata>()))>::type> copy;
+    RANGE_FOR_EACH (automaton, std::forward <Automata> (automata))
+        copy.push_back (automaton);
+    return unionAll (std::move (copy));
+}
+/// \endcond
+
 template <class Key, class Weight> inline
     void writeAttAutomaton (
         std::ostream & stream, SharedAutomaton <Key, Weight> const & automaton)
@@ -791,10 +1233,38 @@ template <class Key, class Weight, class CallBack> inline
     void enumerate (
         SharedAutomaton <Key, Weight> const & automaton, CallBack && callBack)
 {
+    std::vector <Key> keys;
     detail::SharedAutomatonOperations <Key, Weight>::enumerate (
-        std::vector <Key>(), math::one <Weight>(), automaton, callBack);
+        keys, math::one <Weight>(), automaton, callBack);
 }
 
+/** \brief
+Return a lazy range with the paths through \a automaton, best first.
+
+Each element is a pair with the sequence of keys, as a \c std::vector, and
+the weight of the path.
+The weights must be in an idempotent semiring, such as the tropical semiring,
+where \c math::plus picks the better of two weights.
+
+\param automaton
+    The automaton.
+    The states stay alive while the range is used.
+\param maxCount
+    (optional) The maximum number of paths to return.
+\param threshold
+    (optional) The worst weight of paths to return.
+    By default, this is <c>math::zero \<Weight>()</c>, so that all paths are
+    returned.
+
+\sa BestPathRange
+*/
+template <class Key, class Weight> inline
+    BestPathRange <Key, Weight> bestPaths (
+        SharedAutomaton <Key, Weight> const & automaton,
+        std::size_t maxCount = std::numeric_limits <std::size_t>::max(),
+        Weight const & threshold = math::zero <Weight>())
+{ return BestPathRange <Key, Weight> (automaton, maxCount, threshold); }
+
 template <class Key, class Weight> inline
     void print (std::ostream & stream,
         SharedAutomaton <Key, Weight> const & automaton)
@@ -805,4 +1275,12 @@ template <class Key, class Weight> inline
 
 } // namespace flipsta
 
+namespace range {
+
+    template <class Key, class Weight>
+        struct tag_of_qualified <flipsta::BestPathRange <Key, Weight>>
+    { typedef flipsta::BestPathRangeTag type; };
+
+} // namespace range
+
 #endif // FLIPSTA_SHARED_AUTOMATON_HPP_INCLUDED
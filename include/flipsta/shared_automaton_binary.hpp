@@ -0,0 +1,241 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Read and write SharedAutomaton objects in a compact binary format.
+*/
+
+#ifndef FLIPSTA_SHARED_AUTOMATON_BINARY_HPP_INCLUDED
+#define FLIPSTA_SHARED_AUTOMATON_BINARY_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "math/cost.hpp"
+#include "math/log-float.hpp"
+
+#include "error.hpp"
+#include "shared_automaton.hpp"
+
+namespace flipsta {
+
+/** \brief
+Describe how to read and write a value of type \a Type in binary form.
+
+Specialisations must define:
+\li <c>static void write (std::ostream &, Type const &)</c>.
+\li <c>static Type read (std::istream &)</c>, which throws FormatError if the
+    value cannot be read.
+
+Specialisations are provided for arithmetic types, which are written in the
+native byte order, and for \c math::cost and \c math::log_float.
+*/
+template <class Type, class Enable = void> struct BinaryFormat;
+
+template <class Type> struct BinaryFormat <Type,
+    typename std::enable_if <std::is_arithmetic <Type>::value>::type>
+{
+    static void write (std::ostream & stream, Type const & value)
+    { stream.write (reinterpret_cast <char const *> (&value), sizeof (Type)); }
+
+    static Type read (std::istream & stream) {
+        Type value;
+        if (!stream.read (reinterpret_cast <char *> (&value), sizeof (Type)))
+            throw FormatError();
+        return value;
+    }
+};
+
+template <class Value> struct BinaryFormat <math::cost <Value>> {
+    static void write (std::ostream & stream, math::cost <Value> const & cost)
+    { BinaryFormat <Value>::write (stream, cost.value()); }
+
+    static math::cost <Value> read (std::istream & stream)
+    { return math::cost <Value> (BinaryFormat <Value>::read (stream)); }
+};
+
+template <class Exponent> struct BinaryFormat <math::log_float <Exponent>> {
+    static void write (std::ostream & stream,
+        math::log_float <Exponent> const & value)
+    { BinaryFormat <Exponent>::write (stream, value.exponent()); }
+
+    static math::log_float <Exponent> read (std::istream & stream) {
+        return math::log_float <Exponent> (
+            BinaryFormat <Exponent>::read (stream), math::as_exponent());
+    }
+};
+
+namespace shared_automaton_binary_detail {
+
+    static char const magic [4] = {'F', 'S', 'A', 'B'};
+    static char const version = 1;
+
+    inline void writeNumber (std::ostream & stream, std::size_t number)
+    { BinaryFormat <std::uint64_t>::write (stream, std::uint64_t (number)); }
+
+    inline std::size_t readNumber (std::istream & stream)
+    { return std::size_t (BinaryFormat <std::uint64_t>::read (stream)); }
+
+} // namespace shared_automaton_binary_detail
+
+/** \brief
+Write \a automaton to \a stream in a compact binary format.
+
+Each distinct state is written once, after all states that its arcs lead to,
+so that structure that is shared within the automaton is kept.
+The keys and weights are written with BinaryFormat.
+
+The stream should be opened in binary mode.
+Errors while writing are reported through the state of the stream, as usual.
+
+\sa readBinaryAutomaton
+*/
+template <class Key, class Weight> inline
+    void writeBinaryAutomaton (std::ostream & stream,
+        SharedAutomaton <Key, Weight> const & automaton)
+{
+    using namespace shared_automaton_binary_detail;
+    typedef SharedState <Key, Weight> State;
+
+    // Number the states in depth-first post-order.
+    // Index 0 is reserved for the null automaton, and index 1 for the final
+    // state, which is not written.
+    std::unordered_map <State const *, std::size_t> indices;
+    std::vector <State const *> order;
+    indices [State::finalState().get()] = 1;
+
+    if (!automaton.isNull()) {
+        // Each state on the stack has the position of the next arc to visit.
+        std::vector <std::pair <State const *, std::size_t>> stack;
+        auto visit = [&] (State const * state) {
+            // The automaton is acyclic, so a state that has been seen but is
+            // not yet numbered is never reached again.
+            if (indices.insert (std::make_pair (state, 0)).second)
+                stack.push_back (std::make_pair (state, 0));
+        };
+        visit (automaton.state().get());
+        while (!stack.empty()) {
+            State const * state = stack.back().first;
+            std::size_t arc = stack.back().second;
+            if (arc != state->arcs().size()) {
+                ++ stack.back().second;
+                visit (state->arcs() [arc].second.state().get());
+            } else {
+                stack.pop_back();
+                order.push_back (state);
+                indices [state] = order.size() + 1;
+            }
+        }
+    }
+
+    stream.write (magic, sizeof (magic));
+    stream.write (&version, 1);
+    writeNumber (stream, order.size());
+    for (State const * state : order) {
+        BinaryFormat <Weight>::write (stream, state->finalWeight());
+        writeNumber (stream, state->arcs().size());
+        RANGE_FOR_EACH (arc, state->arcs()) {
+            BinaryFormat <Key>::write (stream, arc.first);
+            BinaryFormat <Weight>::write (stream, arc.second.startWeight());
+            writeNumber (stream, indices.at (arc.second.state().get()));
+        }
+    }
+
+    BinaryFormat <Weight>::write (stream, automaton.startWeight());
+    writeNumber (stream, automaton.isNull()
+        ? 0 : indices.at (automaton.state().get()));
+}
+
+/** \brief
+Read an automaton from \a stream that was written by writeBinaryAutomaton.
+
+The states are retrieved through \a memo, so that they are shared with any
+equal states that are already in it, just like states that are computed.
+Reading the same automaton twice therefore yields the same states.
+
+\throw FormatError
+    If the data is not in the right format, or ends prematurely.
+    States that have been read already may remain in the memo as long as
+    something else refers to them.
+*/
+template <class Key, class Weight> inline
+    SharedAutomaton <Key, Weight> readBinaryAutomaton (
+        std::istream & stream, SharedAutomatonMemo <Key, Weight> & memo)
+{
+    using namespace shared_automaton_binary_detail;
+    typedef SharedState <Key, Weight> State;
+    typedef SharedAutomaton <Key, Weight> Automaton;
+    typedef typename State::Arcs Arcs;
+
+    char header [sizeof (magic) + 1];
+    if (!stream.read (header, sizeof (header))
+            || !std::equal (magic, magic + sizeof (magic), header)
+            || header [sizeof (magic)] != version)
+        throw FormatError();
+
+    std::size_t stateNum = readNumber (stream);
+    std::vector <typename State::Pointer> states;
+    // Do not trust the number of states too much before reading them.
+    states.reserve (std::min <std::size_t> (stateNum, 1 << 16) + 2);
+    // Index 0 stands for the null automaton.
+    states.push_back (nullptr);
+    states.push_back (State::finalState());
+
+    for (std::size_t index = 0; index != stateNum; ++ index) {
+        Weight finalWeight = BinaryFormat <Weight>::read (stream);
+        Weight sum = finalWeight;
+        std::size_t arcNum = readNumber (stream);
+        Arcs arcs;
+        for (std::size_t arc = 0; arc != arcNum; ++ arc) {
+            Key key = BinaryFormat <Key>::read (stream);
+            Weight weight = BinaryFormat <Weight>::read (stream);
+            std::size_t destination = readNumber (stream);
+            // The destination must have been read already, and the arcs must
+            // be sorted by key.
+            if (destination == 0 || destination >= states.size()
+                    || weight == math::zero <Weight>()
+                    || (!arcs.empty() && !(arcs.back().first < key)))
+                throw FormatError();
+            sum = sum + weight;
+            arcs.emplace_back (key, Automaton (weight, states [destination]));
+        }
+        // The state must be normalised.
+        if (!math::approximately_equal (sum, math::one <Weight>()))
+            throw FormatError();
+        states.push_back (
+            memo.get (State (&memo, finalWeight, std::move (arcs))));
+    }
+
+    Weight startWeight = BinaryFormat <Weight>::read (stream);
+    std::size_t start = readNumber (stream);
+    // The start weight is zero exactly for the null automaton, which has
+    // index 0.
+    bool isNull = (startWeight == math::zero <Weight>());
+    if (start >= states.size() || isNull != (start == 0))
+        throw FormatError();
+    return Automaton (startWeight, states [start]);
+}
+
+} // namespace flipsta
+
+#endif // FLIPSTA_SHARED_AUTOMATON_BINARY_HPP_INCLUDED
@@ -22,8 +22,12 @@ Shortest-distance algorithms.
 #ifndef FLIPSTA_SHORTEST_DISTANCE_HPP_INCLUDED
 #define FLIPSTA_SHORTEST_DISTANCE_HPP_INCLUDED
 
+#include <cassert>
+#include <deque>
+#include <limits>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <boost/utility/enable_if.hpp>
 
@@ -31,15 +35,22 @@ Shortest-distance algorithms.
 #include "utility/unique_ptr.hpp"
 
 #include "range/core.hpp"
+#include "range/for_each.hpp"
 #include "range/for_each_macro.hpp"
 #include "range/transform.hpp"
 #include "range/tuple.hpp"
 
 #include "math/magma.hpp"
+#include "math/cost.hpp"
+#include "math/log-float.hpp"
 
 #include "core.hpp"
 #include "label.hpp"
 #include "topological_order.hpp"
+#include "traverse.hpp"
+#include "workspace.hpp"
+#include "detail/tropical_kernel.hpp"
+#include "detail/log_sum_exp.hpp"
 
 namespace flipsta {
 
@@ -47,6 +58,53 @@ namespace flipsta {
 template <class AutomatonPtr, class Direction>
     class ShortestDistanceAcyclicRange;
 
+template <class Label, class TerminalLabel, class Index>
+    class FrozenAutomaton;
+
+template <class Key, class Weight> class AutomatonSemiring;
+
+/** \brief
+Describe labels that are in the log semiring, that is, that are stored as
+logarithms, and are added by computing log (exp (a) + exp (b)).
+
+The shortest-distance algorithm on a FrozenAutomaton with such labels uses
+detail::logSumExp to add up the contributions of all arcs into a state in one
+go.
+
+Specialisations must define:
+\li \c isLogSemiring: \c true.
+\li \c Value: the floating-point type of the logarithm.
+\li \c accuracy: a LogAddAccuracy.
+\li <c>static Value toLog (Label const &)</c>.
+\li <c>static Label fromLog (Value)</c>.
+
+A specialisation for \c math::log_float over floating-point types is
+provided.
+Its accuracy is LogAddAccuracy::exact, unless FLIPSTA_FAST_LOG_ADD is defined,
+in which case it is LogAddAccuracy::fast.
+*/
+template <class Label, class Enable = void> struct LogSemiringTraits {
+    static bool constexpr isLogSemiring = false;
+};
+
+template <class Exponent> struct LogSemiringTraits <math::log_float <Exponent>,
+    typename std::enable_if <std::is_floating_point <Exponent>::value>::type>
+{
+    static bool constexpr isLogSemiring = true;
+    typedef Exponent Value;
+#ifdef FLIPSTA_FAST_LOG_ADD
+    static LogAddAccuracy constexpr accuracy = LogAddAccuracy::fast;
+#else
+    static LogAddAccuracy constexpr accuracy = LogAddAccuracy::exact;
+#endif
+
+    static Value toLog (math::log_float <Exponent> const & label)
+    { return label.exponent(); }
+
+    static math::log_float <Exponent> fromLog (Value value)
+    { return math::log_float <Exponent> (value, math::as_exponent()); }
+};
+
 namespace callable {
 
     struct ShortestDistanceAcyclic;
@@ -99,7 +157,8 @@ namespace callable {
                         typename std::decay <AutomatonPtr>::type, Direction>
                     operator() (AutomatonPtr && automaton,
                         InitialStates && initialStates,
-                        Direction const & direction) const
+                        Direction const & direction,
+                        Workspace * workspace = nullptr) const
             {
                 static_assert (range::is_range <InitialStates>::value,
                     "InitialStates must be a range of (state, label).");
@@ -107,7 +166,7 @@ namespace callable {
                 return ShortestDistanceAcyclicRange <
                         typename std::decay <AutomatonPtr>::type, Direction> (
                     std::forward <AutomatonPtr> (automaton),
-                    std::forward <InitialStates> (initialStates));
+                    std::forward <InitialStates> (initialStates), workspace);
             }
         };
 
@@ -120,7 +179,8 @@ namespace callable {
                     typename std::decay <AutomatonPtr>::type, Direction>
                 operator() (AutomatonPtr && automaton,
                     typename PtrStateType <AutomatonPtr>::type const & state,
-                    Direction const & direction)
+                    Direction const & direction,
+                    Workspace * workspace = nullptr)
                 const
             {
                 auto one = math::one <
@@ -128,7 +188,8 @@ namespace callable {
                 return ShortestDistanceAcyclicRange <
                     typename std::decay <AutomatonPtr>::type, Direction> (
                     std::forward <AutomatonPtr> (automaton),
-                    range::make_tuple (range::make_tuple (state, one)));
+                    range::make_tuple (range::make_tuple (state, one)),
+                    workspace);
             }
         };
 
@@ -142,7 +203,8 @@ namespace callable {
                 AcyclicShortestDistanceResult <AutomatonPtr, Direction>::type
                     operator() (AutomatonPtr && automaton,
                         InitialStates && initialStates,
-                        Direction const & direction) const
+                        Direction const & direction,
+                        Workspace * workspace = nullptr) const
             {
                 static_assert (range::is_range <InitialStates>::value,
                     "InitialStates must be a range of (state, label).");
@@ -160,7 +222,8 @@ namespace callable {
                     implementation;
                 return transformation::TransformLabelsForStates() (expand,
                     implementation (std::forward <AutomatonPtr> (automaton),
-                        std::move (compressedInitialStates), direction));
+                        std::move (compressedInitialStates), direction,
+                        workspace));
             }
         };
 
@@ -173,7 +236,8 @@ namespace callable {
                     AutomatonPtr, Direction>::type
                 operator() (AutomatonPtr && automaton,
                     typename PtrStateType <AutomatonPtr>::type const & state,
-                    Direction const & direction)
+                    Direction const & direction,
+                    Workspace * workspace = nullptr)
                 const
             {
                 // Use the descriptor before moving the automaton pointer.
@@ -182,7 +246,7 @@ namespace callable {
                     implementation;
                 return transformation::TransformLabelsForStates() (expand,
                     implementation (std::forward <AutomatonPtr> (automaton),
-                        state, direction));
+                        state, direction, workspace));
             }
         };
 
@@ -199,6 +263,14 @@ namespace callable {
                 auto operator() (Arguments && ... arguments) const
             RETURNS (apply <Arguments ...>() (
                 std::forward <Arguments> (arguments) ...));
+
+            // With a workspace as the last argument.
+            template <class AutomatonPtr, class Initial, class Direction>
+                auto operator() (AutomatonPtr && automaton, Initial && initial,
+                    Direction const & direction, Workspace & workspace) const
+            RETURNS (apply <AutomatonPtr, Initial, Direction>() (
+                std::forward <AutomatonPtr> (automaton),
+                std::forward <Initial> (initial), direction, &workspace));
         };
 
     } // namespace shortest_distance_detail
@@ -263,6 +335,12 @@ However, traversal of the states uses topological order, which by default uses
 
 \param direction
     The direction in which to traverse the automaton.
+
+\param workspace
+    (optional) Workspace to borrow scratch memory from.
+    It must outlive the range that is returned.
+    When the shortest distances for many small automata are computed in turn,
+    this prevents memory from being allocated for each.
 */
 static auto constexpr shortestDistanceAcyclic =
     callable::ShortestDistanceAcyclic();
@@ -281,11 +359,388 @@ in an acyclic automaton.
 
 \param direction
     The direction in which to traverse the automaton.
+
+\param workspace
+    (optional) Workspace to borrow scratch memory from.
 */
 static auto constexpr shortestDistanceAcyclicFrom =
     callable::ShortestDistanceAcyclicFrom();
 
 
+namespace shortest_distance_detail {
+
+    /**
+    Keep the intermediate distances to states during shortest-distance
+    computation in topological order.
+
+    This general implementation keeps distances in a hash map, and pushes the
+    distance to a state along its arcs once it is known.
+    */
+    template <class Automaton, class Direction, class Enable = void>
+        class Relaxation
+    {
+        typedef typename StateType <Automaton>::type State;
+    public:
+        typedef typename label::GeneraliseSemiring <
+            typename Automaton::CompressedLabel>::type Label;
+
+    private:
+        // denseCover is set to false, because we will remove distances as
+        // soon as we can.
+        typedef Map <State, Label, true, false, map_policy::FlatHash>
+            Distances;
+        Borrowed <Distances> distances;
+
+    public:
+        template <class InitialStates> Relaxation (Automaton const &,
+            InitialStates && initialStates, Workspace * workspace)
+        : distances (Workspace::borrowFrom <Distances> (
+            workspace, math::zero <Label>()))
+        {
+            range::for_each (std::forward <InitialStates> (initialStates),
+                map_detail::InsertKeyValue <Distances> (*distances));
+        }
+
+        /**
+        Return the distance to \a state, which must be the next state in
+        topological order.
+        */
+        Label finish (Automaton const & automaton, State const & state) {
+            // Save distance temporarily.
+            Label stateDistance = (*distances) [state];
+            // After relaxing all arcs out of this state, we do not need the
+            // distance to this state any more, so remove it to save memory.
+            distances->remove (state);
+            RANGE_FOR_EACH (arc,
+                arcsOnCompressed (automaton, Direction(), state))
+            {
+                // Relax this arc.
+                State next = arc.state (Direction());
+                auto newLabel = times (Direction(), stateDistance, arc.label());
+                distances->set (next, (*distances) [next] + newLabel);
+            }
+            return stateDistance;
+        }
+    };
+
+    /**
+    Specialisation for frozen automata with labels in the tropical semiring
+    over floating-point numbers.
+
+    Distances are kept in an array indexed by state.
+    Instead of pushing the distance to a state along its arcs, the distance is
+    pulled in from the arcs that lead to the state, using
+    detail::minPlus.
+    This reads the weights and the neighbouring states from contiguous arrays,
+    and can use SIMD instructions.
+    */
+    template <class Value, class TerminalLabel, class Index, class Direction>
+        class Relaxation <FrozenAutomaton <
+            math::cost <Value>, TerminalLabel, Index>, Direction,
+            typename std::enable_if <
+                std::is_floating_point <Value>::value>::type>
+    {
+        typedef FrozenAutomaton <math::cost <Value>, TerminalLabel, Index>
+            Automaton;
+        typedef typename Automaton::State State;
+    public:
+        typedef typename label::GeneraliseSemiring <
+            typename Automaton::CompressedLabel>::type Label;
+
+    private:
+        Borrowed <std::vector <Value>> distances;
+
+        // Pull along the arcs that end in the state.
+        Value pull (Automaton const & automaton, Forward, State const & state,
+            Value initial) const
+        {
+            auto arcRange = automaton.arcRange (backward, state);
+            return detail::minPlus (initial, distances->data(),
+                automaton.sources().data(),
+                automaton.labels().values().data(),
+                automaton.backwardArcs().data(),
+                arcRange.first, arcRange.second);
+        }
+
+        // Pull along the arcs that start in the state.
+        Value pull (Automaton const & automaton, Backward, State const & state,
+            Value initial) const
+        {
+            auto arcRange = automaton.arcRange (forward, state);
+            return detail::minPlus (initial, distances->data(),
+                automaton.destinations().data(),
+                automaton.labels().values().data(),
+                static_cast <Index const *> (nullptr),
+                arcRange.first, arcRange.second);
+        }
+
+    public:
+        template <class InitialStates> Relaxation (Automaton const & automaton,
+            InitialStates && initialStates, Workspace * workspace)
+        : distances (Workspace::borrowFrom <std::vector <Value>> (workspace))
+        {
+            distances->assign (automaton.stateNum(),
+                std::numeric_limits <Value>::infinity());
+            // The gather instructions take signed 32-bit indices.
+            assert (automaton.stateNum() < (std::size_t (1) << 31));
+            assert (automaton.arcNum() < (std::size_t (1) << 31));
+            RANGE_FOR_EACH (stateLabel,
+                std::forward <InitialStates> (initialStates))
+            {
+                Label label = range::second (stateLabel);
+                (*distances) [range::first (stateLabel).value()]
+                    = label.value();
+            }
+        }
+
+        Label finish (Automaton const & automaton, State const & state) {
+            Value & distance = (*distances) [state.value()];
+            distance = pull (automaton, Direction(), state, distance);
+            return Label (distance);
+        }
+    };
+
+    /**
+    Specialisation for frozen automata with labels in the log semiring, as
+    indicated by LogSemiringTraits.
+
+    As for the tropical semiring, distances are kept in an array indexed by
+    state, and pulled in from the arcs that lead to the state.
+    The logarithms of the contributions of all arcs are first collected in a
+    buffer, and then added with detail::logSumExp, which computes one
+    logarithm per state rather than one per arc, and can use SIMD
+    instructions.
+    */
+    template <class Label_, class TerminalLabel, class Index, class Direction>
+        class Relaxation <FrozenAutomaton <Label_, TerminalLabel, Index>,
+            Direction, typename std::enable_if <
+                LogSemiringTraits <Label_>::isLogSemiring>::type>
+    {
+        typedef FrozenAutomaton <Label_, TerminalLabel, Index> Automaton;
+        typedef typename Automaton::State State;
+        typedef LogSemiringTraits <Label_> Traits;
+        typedef typename Traits::Value Value;
+    public:
+        typedef typename label::GeneraliseSemiring <
+            typename Automaton::CompressedLabel>::type Label;
+
+    private:
+        Borrowed <std::vector <Value>> distances;
+        // Reused between calls to avoid allocating memory for every state.
+        // This has the same type as distances; since it is declared later, it
+        // is given back to the workspace first, and distances will get the
+        // larger vector again next time.
+        Borrowed <std::vector <Value>> buffer;
+
+        void collect (Automaton const & automaton, Index arc, Index neighbour)
+        {
+            buffer->push_back ((*distances) [neighbour]
+                + Traits::toLog (automaton.labels() [arc]));
+        }
+
+        // Pull along the arcs that end in the state.
+        void pull (Automaton const & automaton, Forward, State const & state) {
+            auto arcRange = automaton.arcRange (backward, state);
+            for (Index position = arcRange.first;
+                position != arcRange.second; ++ position)
+            {
+                Index arc = automaton.backwardArcs() [position];
+                collect (automaton, arc, automaton.sources() [arc]);
+            }
+        }
+
+        // Pull along the arcs that start in the state.
+        void pull (Automaton const & automaton, Backward, State const & state)
+        {
+            auto arcRange = automaton.arcRange (forward, state);
+            for (Index arc = arcRange.first; arc != arcRange.second; ++ arc)
+                collect (automaton, arc, automaton.destinations() [arc]);
+        }
+
+    public:
+        template <class InitialStates> Relaxation (Automaton const & automaton,
+            InitialStates && initialStates, Workspace * workspace)
+        : distances (Workspace::borrowFrom <std::vector <Value>> (workspace)),
+            buffer (Workspace::borrowFrom <std::vector <Value>> (workspace))
+        {
+            distances->assign (automaton.stateNum(),
+                -std::numeric_limits <Value>::infinity());
+            RANGE_FOR_EACH (stateLabel,
+                std::forward <InitialStates> (initialStates))
+            {
+                (*distances) [range::first (stateLabel).value()]
+                    = Traits::toLog (range::second (stateLabel));
+            }
+        }
+
+        Label finish (Automaton const & automaton, State const & state) {
+            Value & distance = (*distances) [state.value()];
+            buffer->clear();
+            buffer->push_back (distance);
+            pull (automaton, Direction(), state);
+            distance = detail::logSumExp (
+                buffer->data(), buffer->size(), Traits::accuracy);
+            return Traits::fromLog (distance);
+        }
+    };
+
+    template <class Label> struct IsAutomatonSemiring : std::false_type {};
+
+    template <class Key, class Weight>
+        struct IsAutomatonSemiring <AutomatonSemiring <Key, Weight>>
+    : std::true_type {};
+
+    /**
+    Specialisation for automata with labels in the AutomatonSemiring.
+
+    Adding up the distances one at a time would create a new state in the
+    memo for each intermediate sum, which is then thrown away.
+    Instead, the contributions to each state are collected until the state is
+    finished, and then added up in one go with unionAll.
+    */
+    template <class Automaton, class Direction>
+        class Relaxation <Automaton, Direction, typename std::enable_if <
+            IsAutomatonSemiring <typename label::GeneraliseSemiring <
+                typename Automaton::CompressedLabel>::type>::value>::type>
+    {
+        typedef typename StateType <Automaton>::type State;
+    public:
+        typedef typename label::GeneraliseSemiring <
+            typename Automaton::CompressedLabel>::type Label;
+
+    private:
+        typedef typename Label::Automaton SharedAutomaton;
+        typedef std::vector <SharedAutomaton> Contributions;
+        typedef Map <State, Contributions, false, false, map_policy::FlatHash>
+            Pending;
+        Borrowed <Pending> pending;
+
+        void add (State const & state, SharedAutomaton const & automaton) {
+            if (automaton.isNull())
+                return;
+            if (!pending->contains (state))
+                pending->set (state, Contributions());
+            (*pending) [state].push_back (automaton);
+        }
+
+    public:
+        template <class InitialStates> Relaxation (Automaton const &,
+            InitialStates && initialStates, Workspace * workspace)
+        : pending (Workspace::borrowFrom <Pending> (workspace))
+        {
+            RANGE_FOR_EACH (stateLabel,
+                std::forward <InitialStates> (initialStates))
+            {
+                Label label = range::second (stateLabel);
+                add (range::first (stateLabel), label.automaton());
+            }
+        }
+
+        Label finish (Automaton const & automaton, State const & state) {
+            Label stateDistance = math::zero <Label>();
+            if (pending->contains (state)) {
+                stateDistance = Label (
+                    unionAll (std::move ((*pending) [state])));
+                pending->remove (state);
+            }
+            if (stateDistance.automaton().isNull())
+                return stateDistance;
+            RANGE_FOR_EACH (arc,
+                arcsOnCompressed (automaton, Direction(), state))
+            {
+                // Relax this arc.
+                State next = arc.state (Direction());
+                auto newLabel = times (Direction(), stateDistance, arc.label());
+                add (next, newLabel.automaton());
+            }
+            return stateDistance;
+        }
+    };
+
+    struct BorrowedTopologicalOrderTag {};
+
+    /**
+    Topological order, kept in a vector that is borrowed from a workspace.
+    The vector contains the states in the reverse order, so that the next
+    state is at the back.
+    */
+    template <class State> class BorrowedTopologicalOrder {
+        Borrowed <std::vector <State>> reverseOrder_;
+
+    public:
+        BorrowedTopologicalOrder (Borrowed <std::vector <State>> && order)
+        : reverseOrder_ (std::move (order)) {}
+
+        bool empty (::direction::front) const
+        { return reverseOrder_->empty(); }
+
+        State chop_in_place (::direction::front) {
+            State state = reverseOrder_->back();
+            reverseOrder_->pop_back();
+            return state;
+        }
+    };
+
+    /**
+    Produce the topological order that ShortestDistanceAcyclicRange uses.
+    In general, this is the result of topologicalOrder.
+    */
+    template <class AutomatonPtr, class Direction, class Enable = void>
+        struct TopologicalOrderSource
+    {
+        typedef typename std::decay <decltype (topologicalOrder (
+                std::declval <AutomatonPtr>(), std::declval <Direction>()))
+            >::type type;
+
+        static type make (AutomatonPtr const & automaton, Workspace *)
+        { return topologicalOrder (automaton, Direction()); }
+    };
+
+    /**
+    If topologicalOrder would use the automatic implementation, do the same
+    thing here, but borrow the memory from the workspace.
+    */
+    template <class AutomatonPtr, class Direction>
+        struct TopologicalOrderSource <AutomatonPtr, Direction,
+            typename std::enable_if <std::is_same <
+                typename std::decay <decltype (topologicalOrder (
+                    std::declval <AutomatonPtr>(), std::declval <Direction>()))
+                >::type,
+                range::view_of_shared <std::deque <
+                    typename PtrStateType <AutomatonPtr>::type>>
+            >::value>::type>
+    {
+        typedef typename PtrStateType <AutomatonPtr>::type State;
+        typedef BorrowedTopologicalOrder <State> type;
+
+        template <class Traversal> static void collect (
+            Traversal && traversal, std::vector <State> & reverseOrder)
+        {
+            RANGE_FOR_EACH (report, std::forward <Traversal> (traversal)) {
+                if (report.event == TraversalEvent::finishVisit)
+                    reverseOrder.push_back (report.state);
+                else if (report.event == TraversalEvent::backState)
+                    throw AutomatonNotAcyclic()
+                        << errorInfoState <State> (report.state);
+            }
+        }
+
+        static type make (AutomatonPtr const & automaton,
+            Workspace * workspace)
+        {
+            auto reverseOrder =
+                Workspace::borrowFrom <std::vector <State>> (workspace);
+            if (workspace)
+                collect (traverse (automaton, Direction(), *workspace),
+                    *reverseOrder);
+            else
+                collect (traverse (automaton, Direction()), *reverseOrder);
+            return type (std::move (reverseOrder));
+        }
+    };
+
+} // namespace shortest_distance_detail
+
 /** \brief
 A lazy list of states and the shortest distances to them.
 
@@ -295,6 +750,14 @@ The automaton is traversed in topological order.
 For each state, the arcs going out of it are "relaxed", that is, the
 intermediate shortest distances to the destinations are updated.
 After that, the state can be forgotten.
+
+For a FrozenAutomaton with \c math::cost<float> or \c math::cost<double>
+labels, a specialised kernel is used instead, which keeps all distances in an
+array and computes the distance to each state from the arcs that lead to it.
+The same holds for labels in the log semiring, as indicated by
+LogSemiringTraits.
+For labels in the AutomatonSemiring, the distances that arrive at a state are
+added up with unionAll once the state is reached.
 */
 template <class AutomatonPtr, class Direction>
     class ShortestDistanceAcyclicRange
@@ -315,9 +778,9 @@ private:
         "It needs to be shared internally. "
         "You may want to use, say, std::shared_ptr.");
 
-    typedef typename std::decay <decltype (topologicalOrder (
-            std::declval <AutomatonPtr>(), std::declval <Direction>()))>::type
-        Order;
+    typedef shortest_distance_detail::TopologicalOrderSource <
+        AutomatonPtr, Direction> OrderSource;
+    typedef typename OrderSource::type Order;
 
     static_assert (range::is_homogeneous <Order>::value,
         "Only implemented for homogeneous topologicalOrder.");
@@ -326,14 +789,13 @@ private:
 
     typedef typename StateType <Automaton>::type State;
 
-    typedef typename label::GeneraliseSemiring <
-        typename std::decay <Automaton>::type::CompressedLabel>::type Label;
+    typedef shortest_distance_detail::Relaxation <
+        typename std::decay <Automaton>::type, Direction> Relaxation;
+    typedef typename Relaxation::Label Label;
 
     AutomatonPtr automaton;
     Order order;
-    // denseCover is set to false, because we will remove distances as soon as
-    // we can.
-    Map <State, Label, true, false> distances;
+    Relaxation relaxation;
 
     /**
     Functor that returns any pair (state, weight) as-is, but throws if the
@@ -363,17 +825,21 @@ public:
     \param initialStates
         Initial weights for states.
         This is used only once, during construction.
+    \param workspace
+        (optional) Workspace to borrow scratch memory from, or null.
 
     \throw AutomatonNotFound
         iff any state in \a initialStates is not in the automaton.
     */
     template <class InitialStates> ShortestDistanceAcyclicRange (
-            AutomatonPtr const & automaton, InitialStates && initialStates)
+            AutomatonPtr const & automaton, InitialStates && initialStates,
+            Workspace * workspace = nullptr)
     : automaton (automaton),
-        order (topologicalOrder (automaton, Direction())),
-        distances (math::zero <Label>(),
+        order (OrderSource::make (automaton, workspace)),
+        relaxation (*automaton,
             range::transform (std::forward <InitialStates> (initialStates),
-                PassThroughIfStateExists (automaton))) {}
+                PassThroughIfStateExists (automaton)),
+            workspace) {}
 
     bool empty (::direction::front) const
     { return range::empty (order); }
@@ -382,19 +848,8 @@ public:
     Return the next state and the shortest distance to it.
     */
     std::pair <State, Label> chop_in_place (::direction::front) {
-        // Save state and distance temporarily.
         State state = range::chop_in_place (order);
-        Label stateDistance = distances [state];
-        // After relaxing all arcs out of this state, we do not need the
-        // distance to this state any more, so remove it to save memory.
-        distances.remove (state);
-        RANGE_FOR_EACH (arc, arcsOnCompressed (*automaton, Direction(), state))
-        {
-            // Relax this arc.
-            State next = arc.state (Direction());
-            auto newLabel = times (Direction(), stateDistance, arc.label());
-            distances.set (next, distances [next] + newLabel);
-        }
+        Label stateDistance = relaxation.finish (*automaton, state);
         return std::make_pair (state, std::move (stateDistance));
     }
 };
@@ -405,6 +860,13 @@ struct ShortestDistanceAcyclicRangeTag {};
 
 namespace range {
 
+    template <class State> struct tag_of_qualified <
+        flipsta::shortest_distance_detail::BorrowedTopologicalOrder <State>>
+    {
+        typedef flipsta::shortest_distance_detail::BorrowedTopologicalOrderTag
+            type;
+    };
+
     // Mark ShortestDistanceAcyclicRange as a range.
     template <class AutomatonPtr, class Direction>
         struct tag_of_qualified <
@@ -0,0 +1,238 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Compute shortest distances on many acyclic automata, using multiple threads.
+*/
+
+#ifndef FLIPSTA_SHORTEST_DISTANCE_BATCH_HPP_INCLUDED
+#define FLIPSTA_SHORTEST_DISTANCE_BATCH_HPP_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <system_error>
+#include <type_traits>
+
+#include "range/core.hpp"
+#include "range/for_each_macro.hpp"
+
+#include "core.hpp"
+#include "shortest_distance.hpp"
+#include "workspace.hpp"
+#include "detail/thread_num.hpp"
+
+namespace flipsta {
+
+namespace shortest_distance_batch_detail {
+
+    template <class AutomatonPtrs> struct ElementPtr {
+        typedef typename std::decay <decltype (
+            range::first (std::declval <AutomatonPtrs>()))>::type type;
+    };
+
+    /**
+    The type of the shortest distance to one state, as a pair
+    <c>(state, label)</c>.
+    */
+    template <class AutomatonPtr, class Direction> struct DistanceType {
+        typedef decltype (shortestDistanceAcyclic (
+                std::declval <AutomatonPtr const &>(),
+                terminalStates (std::declval <AutomatonPtr const &>(),
+                    std::declval <Direction const &>()),
+                std::declval <Direction const &>()))
+            Range;
+        typedef typename std::decay <decltype (range::chop_in_place (
+            std::declval <Range &>()))>::type Element;
+
+        typedef std::pair <
+                typename std::decay <decltype (
+                    range::first (std::declval <Element const &>()))>::type,
+                typename std::decay <decltype (
+                    range::second (std::declval <Element const &>()))>::type>
+            type;
+    };
+
+    /**
+    Compute the shortest distances for a list of automata, with threads that
+    each take the next automaton that has not been claimed yet.
+
+    Since the jobs are independent, a single atomic cursor balances the load
+    as well as per-thread queues with work stealing would, without the
+    bookkeeping.
+    */
+    template <class AutomatonPtr, class Direction> class Batch {
+    public:
+        typedef typename DistanceType <AutomatonPtr, Direction>::type
+            Distance;
+
+    private:
+        std::vector <AutomatonPtr> const & automata_;
+        std::vector <std::vector <Distance>> & results_;
+
+        std::atomic <std::size_t> cursor_;
+        std::atomic <bool> failed_;
+
+        std::mutex mutex_;
+        // Protected by mutex_.
+        std::size_t exceptionIndex_;
+        std::exception_ptr exception_;
+
+        void fail (std::size_t index, std::exception_ptr exception) {
+            std::lock_guard <std::mutex> lock (mutex_);
+            if (!exception_ || index < exceptionIndex_) {
+                exceptionIndex_ = index;
+                exception_ = exception;
+            }
+            failed_.store (true, std::memory_order_relaxed);
+        }
+
+        static void compute (AutomatonPtr const & automaton,
+            std::vector <Distance> & result, Workspace & workspace)
+        {
+            auto distances = shortestDistanceAcyclic (automaton,
+                terminalStates (automaton, Direction()), Direction(),
+                workspace);
+            while (!range::empty (distances)) {
+                auto distance = range::chop_in_place (distances);
+                result.emplace_back (range::first (distance),
+                    range::second (distance));
+            }
+        }
+
+        void work() {
+            // Scratch memory for this thread, reused between automata.
+            Workspace workspace;
+            while (!failed_.load (std::memory_order_relaxed)) {
+                std::size_t index = cursor_.fetch_add (1);
+                if (index >= automata_.size())
+                    return;
+                try {
+                    compute (automata_ [index], results_ [index], workspace);
+                } catch (...) {
+                    fail (index, std::current_exception());
+                }
+            }
+        }
+
+    public:
+        Batch (std::vector <AutomatonPtr> const & automata,
+            std::vector <std::vector <Distance>> & results)
+        : automata_ (automata), results_ (results), cursor_ (0),
+            failed_ (false), exceptionIndex_ (0)
+        { assert (automata_.size() == results_.size()); }
+
+        /**
+        Run with at most \a threadNum threads, including the calling thread.
+        If fewer threads can be started, the computation continues with those.
+        \throw The exception thrown for the automaton with the lowest index of
+            those that have failed.
+        */
+        void run (std::size_t threadNum) {
+            assert (threadNum >= 1);
+            if (threadNum > automata_.size())
+                threadNum = std::max <std::size_t> (automata_.size(), 1);
+
+            std::vector <std::thread> threads;
+            threads.reserve (threadNum - 1);
+            try {
+                for (std::size_t thread = 1; thread != threadNum; ++ thread)
+                    threads.emplace_back (&Batch::work, this);
+            } catch (std::system_error &) {
+                // Carry on with the threads that did start.
+            }
+
+            work();
+            for (std::thread & thread : threads)
+                thread.join();
+
+            if (exception_)
+                std::rethrow_exception (exception_);
+        }
+    };
+
+} // namespace shortest_distance_batch_detail
+
+/** \brief
+Compute the shortest distances to all states in each of a list of acyclic
+automata, using multiple threads.
+
+For each automaton, this computes the same as
+<c>shortestDistanceAcyclic (automaton, terminalStates (automaton, direction),
+direction)</c>, and collects the result in a vector.
+The automata are handed out to threads one at a time, so that the work is
+balanced even if the automata differ in size.
+The threads are started once for the whole batch, and each has a Workspace
+from which the computations borrow their scratch memory.
+This is useful for large numbers of small automata, such as lattices, for
+which starting a thread would take longer than the computation itself.
+
+\pre The automata must not be changed while this runs.
+    If the same automaton appears more than once, or automata share
+    structure, their \c arcsOnCompressed must be safe to call from multiple
+    threads at the same time.
+
+\param automata
+    Range of pointers to the automata.
+    The pointers must be copyable, and therefore cannot be \c unique_ptr.
+\param direction
+    The direction in which to traverse the automata.
+\param threadNum
+    (optional) The maximum number of threads to use.
+    If this is 0, which is the default, the number of hardware threads is
+    used.
+
+\return A vector with, for each automaton, in the order of \a automata, a
+    vector of pairs <c>(state, label)</c> in topological order.
+\throw Any exception that \c shortestDistanceAcyclic throws, such as
+    AutomatonNotAcyclic.
+    If this happens for more than one automaton, the exception for the first
+    one in \a automata is thrown, but only automata that have been started
+    are considered.
+*/
+template <class AutomatonPtrs, class Direction>
+    inline std::vector <std::vector <typename
+        shortest_distance_batch_detail::DistanceType <typename
+            shortest_distance_batch_detail::ElementPtr <AutomatonPtrs>::type,
+            Direction>::type>>
+    shortestDistanceBatch (AutomatonPtrs && automata,
+        Direction const & direction, std::size_t threadNum = 0)
+{
+    typedef typename shortest_distance_batch_detail::ElementPtr <
+        AutomatonPtrs>::type AutomatonPtr;
+    typedef shortest_distance_batch_detail::Batch <AutomatonPtr, Direction>
+        Batch;
+
+    std::vector <AutomatonPtr> pointers;
+    RANGE_FOR_EACH (automaton, std::forward <AutomatonPtrs> (automata))
+        pointers.push_back (automaton);
+
+    std::vector <std::vector <typename Batch::Distance>> results (
+        pointers.size());
+    Batch batch (pointers, results);
+    batch.run (detail::defaultThreadNum (threadNum));
+    return results;
+}
+
+} // namespace flipsta
+
+#endif // FLIPSTA_SHORTEST_DISTANCE_BATCH_HPP_INCLUDED
@@ -30,6 +30,7 @@ limitations under the License.
 
 #include "map.hpp"
 #include "queue.hpp"
+#include "workspace.hpp"
 
 namespace flipsta {
 
@@ -97,6 +98,53 @@ RETURNS (DepthFirstTraversalRange <
     typename std::decay <AutomatonPtr>::type, Direction> (
         std::forward <AutomatonPtr> (automaton)));
 
+/** \brief
+Traverse the automaton, reserving space for \a stateNum states.
+
+This is the same as the version of \ref traverse without \a stateNum, but it
+allocates the memory for keeping track of visited states in one go.
+If the states are \c Dense, this takes two bits per state, so that the status
+of even large automata fits in a few megabytes.
+
+\param automaton
+    Pointer to the automaton to traverse.
+\param direction
+    The direction in which to traverse the automaton.
+\param stateNum
+    The number of states in the automaton.
+    For \c Dense states, this should be one more than the highest state.
+*/
+template <class AutomatonPtr, class Direction> inline
+    auto traverse (AutomatonPtr && automaton, Direction direction,
+        std::size_t stateNum)
+RETURNS (DepthFirstTraversalRange <
+    typename std::decay <AutomatonPtr>::type, Direction> (
+        std::forward <AutomatonPtr> (automaton), stateNum));
+
+/** \brief
+Traverse the automaton, borrowing scratch memory from \a workspace.
+
+This is the same as the version of \ref traverse without \a workspace, but
+the containers that keep track of the traversal are borrowed from
+\a workspace, and given back when the range is destructed.
+When many small automata are traversed in turn, this avoids allocating memory
+for each of them.
+
+\param automaton
+    Pointer to the automaton to traverse.
+\param direction
+    The direction in which to traverse the automaton.
+\param workspace
+    The workspace to borrow containers from.
+    This must outlive the range that is returned.
+*/
+template <class AutomatonPtr, class Direction> inline
+    auto traverse (AutomatonPtr && automaton, Direction direction,
+        Workspace & workspace)
+RETURNS (DepthFirstTraversalRange <
+    typename std::decay <AutomatonPtr>::type, Direction> (
+        std::forward <AutomatonPtr> (automaton), workspace));
+
 /**
 Indicate the meaning of the state during depth-first traversal.
 */
@@ -238,8 +286,11 @@ private:
     The last possibility is of vital importance for cycle detection.
     Spanning trees are visited recursively, so if a state is being visited and
     it is found again, then the graph is cyclic.
+    For Dense states, this uses two bits per state.
     */
-    Map <State, VisitStatus, true, true> visitStatus;
+    typedef Map <State, VisitStatus, true, true, map_policy::Packed <2>>
+        VisitStatusMap;
+    Borrowed <VisitStatusMap> visitStatus;
 
     /**
     Keep track of which states are being visited and which arcs are being
@@ -249,11 +300,11 @@ private:
     This is the representation of the call stack in the code of "generateFrom"
     above.
     */
-    LifoQueue <Position> queue;
+    Borrowed <LifoQueue <Position>> queue;
 
     void assertInvariants() const {
-        assert (!queue.empty() || range::empty (roots) ||
-            visitStatus [range::first (roots)] == unvisited);
+        assert (!queue->empty() || range::empty (roots) ||
+            (*visitStatus) [range::first (roots)] == unvisited);
     }
 
 public:
@@ -261,7 +312,33 @@ public:
     DepthFirstTraversalRange (QAutomatonPtr && automaton)
     : automaton_ (std::forward <QAutomatonPtr> (automaton)),
         roots (range::view (states (this->automaton()))),
-        visitStatus (unvisited), queue()
+        visitStatus (Workspace::borrowFrom <VisitStatusMap> (
+            nullptr, unvisited)),
+        queue (Workspace::borrowFrom <LifoQueue <Position>> (nullptr))
+    { assertInvariants(); }
+
+    template <class QAutomatonPtr>
+    DepthFirstTraversalRange (QAutomatonPtr && automaton, std::size_t stateNum)
+    : automaton_ (std::forward <QAutomatonPtr> (automaton)),
+        roots (range::view (states (this->automaton()))),
+        visitStatus (Workspace::borrowFrom <VisitStatusMap> (
+            nullptr, unvisited)),
+        queue (Workspace::borrowFrom <LifoQueue <Position>> (nullptr))
+    {
+        visitStatus->reserve (stateNum);
+        assertInvariants();
+    }
+
+    /**
+    Initialise, borrowing the containers that keep track of the traversal from
+    \a workspace.
+    */
+    template <class QAutomatonPtr>
+    DepthFirstTraversalRange (QAutomatonPtr && automaton, Workspace & workspace)
+    : automaton_ (std::forward <QAutomatonPtr> (automaton)),
+        roots (range::view (states (this->automaton()))),
+        visitStatus (workspace.borrow <VisitStatusMap> (unvisited)),
+        queue (workspace.borrow <LifoQueue <Position>>())
     { assertInvariants(); }
 
     DepthFirstTraversalRange (DepthFirstTraversalRange const &) = delete;
@@ -283,7 +360,7 @@ public:
     }
 
     bool empty (::direction::front) const
-    { return queue.empty() && range::empty (roots); }
+    { return queue->empty() && range::empty (roots); }
 
     /**
     Return the next element.
@@ -298,20 +375,20 @@ public:
         assertInvariants();
         assert (!empty (front));
 
-        if (queue.empty()) {
+        if (queue->empty()) {
             // The first element of "roots" must be a state that has not
             // been seen yet, so push it onto the queue.
             auto root = range::chop_in_place (roots);
-            queue.push (Position (automaton(), root));
+            queue->push (Position (automaton(), root));
             return Report (root, TraversalEvent::newRoot);
         }
 
         while (true) {
             // If necessary, report that a new state is being visited.
-            Position & position = queue.head();
+            Position & position = queue->head();
             if (!position.visiting) {
                 position.visiting = true;
-                visitStatus.set (position.state, visiting);
+                visitStatus->set (position.state, visiting);
                 return Report (position.state, TraversalEvent::visit);
             }
 
@@ -321,17 +398,17 @@ public:
                 if (range::empty (position.arcs)) {
                     // Save state because it will go out of scope.
                     State state = position.state;
-                    visitStatus.set (state, visited);
-                    queue.pop();
+                    visitStatus->set (state, visited);
+                    queue->pop();
 
-                    if (queue.empty()) {
+                    if (queue->empty()) {
                         // The current tree is empty.
                         // Before returning, we need to get "roots" in valid
                         // state, with as its first element a root that has not
                         // been seen yet, or empty.
                         while (!range::empty (roots)) {
                             auto root = range::first (roots);
-                            if (visitStatus [root] == unvisited)
+                            if ((*visitStatus) [root] == unvisited)
                                 // roots now starts with a good start state.
                                 break;
                             range::chop_in_place (roots);
@@ -344,11 +421,11 @@ public:
                 // Consider the state that the next arc leads to.
                 auto && arc = range::chop_in_place (position.arcs);
                 auto && next = arc.state (Direction());
-                auto status = visitStatus [next];
+                auto status = (*visitStatus) [next];
                 if (status == unvisited) {
                     assert (status == unvisited);
                     // Visit the next state.
-                    queue.push (Position (automaton(), next));
+                    queue->push (Position (automaton(), next));
                     // Start from the top to deal with the new head of the
                     // queue.
                     break;
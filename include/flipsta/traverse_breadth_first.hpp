@@ -0,0 +1,403 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLIPSTA_TRAVERSE_BREADTH_FIRST_HPP_INCLUDED
+#define FLIPSTA_TRAVERSE_BREADTH_FIRST_HPP_INCLUDED
+
+#include <cassert>
+#include <vector>
+#include <type_traits>
+
+#include <boost/optional.hpp>
+
+#include "utility/pointee.hpp"
+
+#include "range/core.hpp"
+#include "range/for_each_macro.hpp"
+
+#include "core.hpp"
+
+#include "map.hpp"
+#include "queue.hpp"
+// For TraversedState and TraversalEvent.
+#include "traverse.hpp"
+
+namespace flipsta {
+
+template <class AutomatonPtr, class Direction>
+    class BreadthFirstTraversalRange;
+
+/** \brief
+Traverse the automaton breadth-first and return (lazily) a range of states
+marked with their meaning.
+
+The automaton must remain unchanged while the resulting range is being used.
+The range is non-copyable but it is moveable.
+
+The traversal starts from the terminal states in \a direction, i.e. the initial
+states if \a direction is \c forward and the final states if it is
+\c backward.
+States that cannot be reached from there are not visited.
+The elements of the resulting range are of type <c>TraversedState \<State></c>,
+as for \ref traverse, but the events are used slightly differently:
+\li \c newRoot is emitted once for each start state, before anything else.
+\li \c visit is emitted exactly once for each state that is reachable from the
+    start states, when the arcs from it start being followed.
+    The states are visited in order of the number of arcs from the nearest
+    start state.
+\li \c finishVisit is emitted after all arcs from the state have been followed.
+\li \c forwardOrCrossState is emitted when an arc leads to a state that has
+    already been discovered.
+\li \c backState is never emitted, since breadth-first search cannot tell
+    whether the state is on the path to the current state.
+
+The time complexity is linear in the number of reachable states and arcs.
+
+\param automaton
+    Pointer to the automaton to traverse.
+    A copy of the pointer will be kept, and destructed when the range is
+    destructed.
+    The automaton must have \c terminalStatesCompressed and
+    \c arcsOnCompressed.
+\param direction
+    The direction in which to traverse the automaton.
+*/
+template <class AutomatonPtr, class Direction> inline
+    auto traverseBreadthFirst (AutomatonPtr && automaton, Direction direction)
+RETURNS (BreadthFirstTraversalRange <
+    typename std::decay <AutomatonPtr>::type, Direction> (
+        std::forward <AutomatonPtr> (automaton)));
+
+/** \brief
+Traverse the automaton breadth-first, starting from the states in
+\a startStates.
+
+This is the same as the version of \ref traverseBreadthFirst without
+\a startStates, except for where the traversal starts.
+
+\param automaton
+    Pointer to the automaton to traverse.
+\param direction
+    The direction in which to traverse the automaton.
+\param startStates
+    Range of states to start from.
+    This is used only during construction.
+*/
+template <class AutomatonPtr, class Direction, class StartStates> inline
+    auto traverseBreadthFirst (AutomatonPtr && automaton, Direction direction,
+        StartStates && startStates)
+RETURNS (BreadthFirstTraversalRange <
+    typename std::decay <AutomatonPtr>::type, Direction> (
+        std::forward <AutomatonPtr> (automaton),
+        std::forward <StartStates> (startStates)));
+
+namespace operation {
+    struct BreadthFirstTraversalRangeTag {};
+} // namespace operation
+
+/** \brief
+Lazy range that contains elements of type <c>TraversedState \<State></c> that
+arise while traversing the automaton in a breadth-first search.
+
+This is non-copyable but it is moveable.
+*/
+template <class AutomatonPtr, class Direction>
+    class BreadthFirstTraversalRange
+{
+public:
+    static_assert (std::is_same <AutomatonPtr,
+        typename std::decay <AutomatonPtr>::type>::value,
+        "AutomatonPtr must be unqualified.");
+    typedef typename utility::pointee <AutomatonPtr>::type Automaton;
+    typedef typename Automaton::State State;
+    typedef TraversedState <State> Report;
+
+private:
+    typedef typename DecayedResultOf <
+            range::callable::view (
+                callable::ArcsOnCompressed (Automaton, Direction, State))
+        >::type Arcs;
+
+    /**
+    The state being visited and the arcs from it that are still to be
+    followed.
+    */
+    struct Position {
+        State state;
+        Arcs arcs;
+
+        Position (Automaton const & automaton, State const & state)
+        : state (state),
+            arcs (arcsOnCompressed (automaton, Direction(), state)) {}
+    };
+
+    /*
+    This is what this class would do if there were such a thing as a "yield"
+    statement.
+
+    void generate (Automaton && automaton) {
+        RANGE_FOR_EACH (root, startStates) {
+            if (!discovered.contains (root)) {
+                discovered.insert (root);
+                yield Report (root, TraversalEvent::newRoot);
+                queue.push (root);
+            }
+        }
+        while (!queue.empty()) {
+            State state = queue.pop();
+            yield Report (state, TraversalEvent::visit);
+            RANGE_FOR_EACH (arc, arcsOnCompressed (
+                automaton, Direction(), state))
+            {
+                State next = arc.state (Direction());
+                if (!discovered.contains (next)) {
+                    discovered.insert (next);
+                    queue.push (next);
+                } else
+                    yield Report (next, TraversalEvent::forwardOrCrossState);
+            }
+            yield Report (state, TraversalEvent::finishVisit);
+        }
+    }
+    */
+
+    AutomatonPtr automaton_;
+    Automaton const & automaton() const { return *automaton_; }
+
+    /// The start states, which are reported first.
+    std::vector <State> roots_;
+    /// The number of start states that have been reported.
+    std::size_t rootsReported_;
+
+    /// The states that have been discovered.
+    StateSet <State> discovered_;
+
+    /// States that have been discovered but not visited yet.
+    FifoQueue <State> queue_;
+
+    /// The state that is being visited, if any.
+    boost::optional <Position> current_;
+
+    void addRoot (State const & state) {
+        if (!discovered_.contains (state)) {
+            discovered_.insert (state);
+            roots_.push_back (state);
+            queue_.push (state);
+        }
+    }
+
+public:
+    template <class QAutomatonPtr>
+    explicit BreadthFirstTraversalRange (QAutomatonPtr && automaton)
+    : automaton_ (std::forward <QAutomatonPtr> (automaton)), rootsReported_ (0)
+    {
+        RANGE_FOR_EACH (stateLabel,
+            terminalStatesCompressed (this->automaton(), Direction()))
+            addRoot (range::first (stateLabel));
+    }
+
+    template <class QAutomatonPtr, class StartStates>
+    BreadthFirstTraversalRange (QAutomatonPtr && automaton,
+        StartStates && startStates)
+    : automaton_ (std::forward <QAutomatonPtr> (automaton)), rootsReported_ (0)
+    {
+        RANGE_FOR_EACH (state, std::forward <StartStates> (startStates))
+            addRoot (state);
+    }
+
+    BreadthFirstTraversalRange (BreadthFirstTraversalRange const &) = delete;
+    BreadthFirstTraversalRange & operator= (
+        BreadthFirstTraversalRange const &) = delete;
+
+    BreadthFirstTraversalRange (BreadthFirstTraversalRange && that)
+    : automaton_ (std::move (that.automaton_)),
+        roots_ (std::move (that.roots_)),
+        rootsReported_ (that.rootsReported_),
+        discovered_ (std::move (that.discovered_)),
+        queue_ (std::move (that.queue_)),
+        current_ (std::move (that.current_)) {}
+
+    BreadthFirstTraversalRange & operator= (
+        BreadthFirstTraversalRange && that)
+    {
+        this->automaton_ = std::move (that.automaton_);
+        this->roots_ = std::move (that.roots_);
+        this->rootsReported_ = that.rootsReported_;
+        this->discovered_ = std::move (that.discovered_);
+        this->queue_ = std::move (that.queue_);
+        this->current_ = std::move (that.current_);
+        return *this;
+    }
+
+    bool empty (::direction::front) const {
+        return rootsReported_ == roots_.size() && !current_
+            && queue_.empty();
+    }
+
+    /**
+    Return the next element.
+    \internal
+    As for DepthFirstTraversalRange, this is written to restart just after the
+    previous "yield" statement in the code above.
+    */
+    Report chop_in_place (::direction::front const & front) {
+        assert (!empty (front));
+
+        if (rootsReported_ != roots_.size()) {
+            Report report (roots_ [rootsReported_], TraversalEvent::newRoot);
+            ++ rootsReported_;
+            return report;
+        }
+
+        while (true) {
+            if (!current_) {
+                State state = queue_.pop();
+                current_ = Position (automaton(), state);
+                return Report (state, TraversalEvent::visit);
+            }
+
+            Position & position = *current_;
+            if (range::empty (position.arcs)) {
+                State state = position.state;
+                current_ = boost::none;
+                return Report (state, TraversalEvent::finishVisit);
+            }
+
+            auto && arc = range::chop_in_place (position.arcs);
+            State next = arc.state (Direction());
+            if (!discovered_.contains (next)) {
+                discovered_.insert (next);
+                queue_.push (next);
+                // Carry on with the next arc.
+            } else
+                return Report (next, TraversalEvent::forwardOrCrossState);
+        }
+    }
+};
+
+namespace operation {
+
+    template <class Range>
+        inline auto implement_chop (BreadthFirstTraversalRangeTag,
+            Range && range, direction::front const & direction)
+    RETURNS (range::helper::chop_by_chop_in_place (
+        std::forward <Range> (range), direction));
+
+} // namespace operation
+
+namespace traverse_breadth_first_detail {
+
+    /**
+    Expand the frontier by one step in \a direction.
+    \return \c true iff a state was found that has been discovered from the
+        other side.
+    */
+    template <class Automaton, class Direction, class State>
+        inline bool expandFrontier (
+            Automaton const & automaton, Direction const & direction,
+            std::vector <State> & frontier,
+            StateSet <State> & discovered, StateSet <State> const & other)
+    {
+        std::vector <State> nextFrontier;
+        for (State const & state : frontier) {
+            RANGE_FOR_EACH (arc,
+                arcsOnCompressed (automaton, direction, state))
+            {
+                State next = arc.state (direction);
+                if (other.contains (next))
+                    return true;
+                if (!discovered.contains (next)) {
+                    discovered.insert (next);
+                    nextFrontier.push_back (next);
+                }
+            }
+        }
+        frontier.swap (nextFrontier);
+        return false;
+    }
+
+} // namespace traverse_breadth_first_detail
+
+/** \brief
+Return whether any state in \a destinations can be reached from any state in
+\a sources.
+
+This runs a breadth-first search from both ends at the same time, each time
+expanding the smaller frontier by one step, until the two searches meet.
+This normally explores far fewer states than a search from one end.
+
+The automaton must allow arcsOnCompressed in both directions.
+
+\param automaton
+    Pointer to the automaton.
+\param sources
+    Range of states to start from.
+\param destinations
+    Range of states to reach.
+*/
+template <class AutomatonPtr, class Sources, class Destinations>
+    inline bool isReachable (AutomatonPtr const & automaton,
+        Sources && sources, Destinations && destinations)
+{
+    typedef typename PtrStateType <AutomatonPtr>::type State;
+
+    StateSet <State> discoveredForward;
+    StateSet <State> discoveredBackward;
+    std::vector <State> forwardFrontier;
+    std::vector <State> backwardFrontier;
+
+    RANGE_FOR_EACH (state, std::forward <Sources> (sources)) {
+        if (!discoveredForward.contains (state)) {
+            discoveredForward.insert (state);
+            forwardFrontier.push_back (state);
+        }
+    }
+    RANGE_FOR_EACH (state, std::forward <Destinations> (destinations)) {
+        if (discoveredForward.contains (state))
+            return true;
+        if (!discoveredBackward.contains (state)) {
+            discoveredBackward.insert (state);
+            backwardFrontier.push_back (state);
+        }
+    }
+
+    while (!forwardFrontier.empty() && !backwardFrontier.empty()) {
+        if (forwardFrontier.size() <= backwardFrontier.size()) {
+            if (traverse_breadth_first_detail::expandFrontier (
+                    *automaton, forward, forwardFrontier,
+                    discoveredForward, discoveredBackward))
+                return true;
+        } else {
+            if (traverse_breadth_first_detail::expandFrontier (
+                    *automaton, backward, backwardFrontier,
+                    discoveredBackward, discoveredForward))
+                return true;
+        }
+    }
+    return false;
+}
+
+} // namespace flipsta
+
+namespace range {
+
+    template <class AutomatonPtr, class Direction> struct tag_of_qualified <
+        flipsta::BreadthFirstTraversalRange <AutomatonPtr, Direction>>
+    { typedef flipsta::operation::BreadthFirstTraversalRangeTag type; };
+
+} // namespace range
+
+#endif // FLIPSTA_TRAVERSE_BREADTH_FIRST_HPP_INCLUDED
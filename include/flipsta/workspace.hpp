@@ -0,0 +1,184 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Scratch memory that algorithms can reuse between calls.
+*/
+
+#ifndef FLIPSTA_WORKSPACE_HPP_INCLUDED
+#define FLIPSTA_WORKSPACE_HPP_INCLUDED
+
+#include <cassert>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+
+namespace flipsta {
+
+class Workspace;
+
+/** \brief
+Container that an algorithm has borrowed from a Workspace.
+
+When this is destructed, the container is cleared and given back to the
+workspace, so that its memory can be reused.
+If the container was not borrowed from a workspace, it is simply destructed.
+
+This is not copyable, but it is movable.
+Access the container with \c * and \c ->.
+*/
+template <class Container> class Borrowed {
+    Workspace * workspace_;
+    Container container_;
+
+    friend class Workspace;
+
+    Borrowed (Workspace * workspace, Container && container)
+    : workspace_ (workspace), container_ (std::move (container)) {}
+
+    void giveBack();
+
+public:
+    Borrowed (Borrowed const &) = delete;
+    Borrowed & operator= (Borrowed const &) = delete;
+
+    Borrowed (Borrowed && that)
+    : workspace_ (that.workspace_), container_ (std::move (that.container_))
+    { that.workspace_ = nullptr; }
+
+    Borrowed & operator= (Borrowed && that) {
+        if (this != &that) {
+            giveBack();
+            workspace_ = that.workspace_;
+            container_ = std::move (that.container_);
+            that.workspace_ = nullptr;
+        }
+        return *this;
+    }
+
+    ~Borrowed() { giveBack(); }
+
+    Container & operator* () { return container_; }
+    Container const & operator* () const { return container_; }
+
+    Container * operator-> () { return &container_; }
+    Container const * operator-> () const { return &container_; }
+};
+
+/** \brief
+Pool of containers that algorithms use for scratch memory.
+
+Algorithms that are passed a workspace borrow their containers from it
+instead of constructing new ones, and give them back when they are finished
+with them.
+The containers are then cleared, but keep the memory they have allocated.
+When an algorithm is run on many small automata with the same workspace,
+after the first few runs the containers have grown large enough, and no more
+memory is allocated.
+
+Containers are kept by type.
+The arguments passed to borrow() are used only when no container of the type
+is available, and a new one is constructed.
+Containers of the same type must therefore always be constructed with the
+same arguments.
+For example, a Map of a given type must always have the same default value.
+
+A workspace can be used by one thread at a time.
+It must outlive all containers that are borrowed from it.
+*/
+class Workspace {
+    struct PoolBase {
+        virtual ~PoolBase() {}
+    };
+
+    template <class Container> struct Pool : PoolBase {
+        std::vector <Container> spare;
+    };
+
+    std::unordered_map <std::type_index, std::unique_ptr <PoolBase>> pools_;
+
+    template <class Container> Pool <Container> & pool() {
+        std::unique_ptr <PoolBase> & pool = pools_ [typeid (Container)];
+        if (!pool)
+            pool.reset (new Pool <Container>);
+        return static_cast <Pool <Container> &> (*pool);
+    }
+
+    template <class Container> friend class Borrowed;
+
+    template <class Container> void giveBack (Container && container) {
+        container.clear();
+        pool <Container>().spare.push_back (std::move (container));
+    }
+
+public:
+    Workspace() = default;
+
+    Workspace (Workspace const &) = delete;
+    Workspace & operator= (Workspace const &) = delete;
+
+    /** \brief
+    Borrow a container of type \a Container.
+
+    If the workspace holds a spare container of this type, that is returned.
+    Otherwise, a new one is constructed from \a arguments.
+    */
+    template <class Container, class ... Arguments>
+        Borrowed <Container> borrow (Arguments && ... arguments)
+    {
+        std::vector <Container> & spare = pool <Container>().spare;
+        if (spare.empty())
+            return Borrowed <Container> (
+                this, Container (std::forward <Arguments> (arguments) ...));
+        Borrowed <Container> result (this, std::move (spare.back()));
+        spare.pop_back();
+        return result;
+    }
+
+    /** \brief
+    Return a container of type \a Container from \a workspace, or, if
+    \a workspace is null, a new one that will not be given back.
+    */
+    template <class Container, class ... Arguments>
+        static Borrowed <Container> borrowFrom (
+            Workspace * workspace, Arguments && ... arguments)
+    {
+        if (workspace)
+            return workspace->borrow <Container> (
+                std::forward <Arguments> (arguments) ...);
+        return Borrowed <Container> (
+            nullptr, Container (std::forward <Arguments> (arguments) ...));
+    }
+};
+
+template <class Container> inline void Borrowed <Container>::giveBack() {
+    if (workspace_) {
+        Workspace * workspace = workspace_;
+        workspace_ = nullptr;
+        try {
+            workspace->giveBack (std::move (container_));
+        } catch (...) {
+            // The container is not kept for later, which is not a problem.
+        }
+    }
+}
+
+} // namespace flipsta
+
+#endif // FLIPSTA_WORKSPACE_HPP_INCLUDED
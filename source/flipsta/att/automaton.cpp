@@ -23,6 +23,8 @@ http://www2.research.att.com/~fsmtools/fsm/man/fsm.5.html
 #include <string>
 #include <functional>
 
+#include <boost/optional.hpp>
+
 #include "parse_ll/core.hpp"
 #include "parse_ll/number/unsigned.hpp"
 #include "parse_ll/number/float.hpp"
@@ -51,9 +53,9 @@ Once that has seen a revamp, redo this.
 Mostly, the processing of arcs and states should be done one level higher,
 instead of with these mutating closures.
 
-Also, of course, the weights should be read as strings and then passed to
-something that converts them into actual weights, instead of assuming they are
-floating-point values.
+Also, the weights are read as floating-point values, and converted into the
+actual weight type in the header.
+It would be more general to read them as strings.
 */
 
 namespace {
@@ -73,18 +75,32 @@ struct convertToStdString {
 
 struct Nothing {};
 
+typedef math::optional_sequence <IntegerSymbol> IntegerOptionalSequence;
+
+/**
+Convert the optional weight that the parser produces into a
+boost::optional <double>.
+*/
+template <class Representation>
+    boost::optional <double> getWeight (Representation const & representation)
+{
+    boost::optional <double> weight;
+    if (representation)
+        weight = representation.get();
+    return weight;
+}
+
 class AddArc {
-    AutomatonWrapper & automaton_;
+    AutomatonWrapper <OptionalSequence> & automaton_;
     SymbolTable const & inputSymbolTable_;
     SymbolTable const & outputSymbolTable_;
-    mutable bool seenState;
 
 public:
-    AddArc (AutomatonWrapper & automaton,
+    AddArc (AutomatonWrapper <OptionalSequence> & automaton,
         SymbolTable const & inputSymbolTable,
         SymbolTable const & outputSymbolTable)
     : automaton_ (automaton), inputSymbolTable_ (inputSymbolTable),
-        outputSymbolTable_ (outputSymbolTable), seenState (false) {}
+        outputSymbolTable_ (outputSymbolTable) {}
 
     OptionalSequence getSymbol (SymbolTable const & table,
         std::string const & symbolName) const
@@ -95,81 +111,88 @@ public:
     }
 
     template <class Tuple> Nothing operator() (Tuple const & tuple) const {
-        auto source = at_c <0> (tuple);
-        auto destination = at_c <1> (tuple);
+        State source = at_c <0> (tuple);
+        State destination = at_c <1> (tuple);
         auto inputSymbol = at_c <2> (tuple);
         auto outputSymbol = at_c <3> (tuple);
-        auto weightRepresentation = at_c <4> (tuple);
-
-        boost::any weight;
-        if (weightRepresentation)
-            weight = automaton_.weight (weightRepresentation.get());
-        else
-            weight = automaton_.one();
-
-        if (!automaton_.hasState (source))
-            automaton_.addState (source);
-        if (!seenState) {
-            // The first state is automatically the start state.
-            automaton_.setStartState (source);
-            seenState = true;
-        }
-        if (!automaton_.hasState (destination))
-            automaton_.addState (destination);
-
-        OptionalSequence input = getSymbol (inputSymbolTable_, inputSymbol);
-        OptionalSequence output = getSymbol (outputSymbolTable_, outputSymbol);
-
-        automaton_.addArc (source, destination, input, output, weight);
+
+        automaton_.addArc (source, destination,
+            getSymbol (inputSymbolTable_, inputSymbol),
+            getSymbol (outputSymbolTable_, outputSymbol),
+            getWeight (at_c <4> (tuple)));
         return Nothing();
     }
 };
 
-struct AddFinalState {
-    AutomatonWrapper & automaton_;
+/**
+Add an arc with symbols that are integers.
+0 indicates the empty symbol.
+*/
+class AddIntegerArc {
+    AutomatonWrapper <IntegerOptionalSequence> & automaton_;
 
-    AddFinalState (AutomatonWrapper & automaton)
+public:
+    AddIntegerArc (AutomatonWrapper <IntegerOptionalSequence> & automaton)
     : automaton_ (automaton) {}
 
+    static IntegerOptionalSequence getSymbol (unsigned symbol) {
+        if (symbol == 0)
+            return IntegerOptionalSequence();
+        return IntegerOptionalSequence (IntegerSymbol (symbol));
+    }
+
     template <class Tuple> Nothing operator() (Tuple const & tuple) const {
-        State state = at_c <0> (tuple);
-        auto weightRepresentation = at_c <1> (tuple);
+        State source = at_c <0> (tuple);
+        State destination = at_c <1> (tuple);
+        unsigned inputSymbol = at_c <2> (tuple);
+        unsigned outputSymbol = at_c <3> (tuple);
+
+        automaton_.addArc (source, destination,
+            getSymbol (inputSymbol), getSymbol (outputSymbol),
+            getWeight (at_c <4> (tuple)));
+        return Nothing();
+    }
+};
+
+template <class Wrapper> struct AddFinalState {
+    Wrapper & automaton_;
 
-        boost::any weight;
-        if (weightRepresentation)
-            weight = automaton_.weight (weightRepresentation.get());
-        else
-            weight = automaton_.one();
+    AddFinalState (Wrapper & automaton)
+    : automaton_ (automaton) {}
 
-        if (!automaton_.hasState (state))
-            automaton_.addState (state);
-        automaton_.setFinalState (state, weight);
+    template <class Tuple> Nothing operator() (Tuple const & tuple) const {
+        State state = at_c <0> (tuple);
+        automaton_.addFinalState (state, getWeight (at_c <1> (tuple)));
         return Nothing();
     }
 };
 
-void readAutomatonFrom (
-    TextFileRange && fileRange, AutomatonWrapper & automaton,
-    SymbolTable const & inputSymbolTable,
-    SymbolTable const & outputSymbolTable)
+/**
+Parse the lines of the file.
+\param symbolName
+    The parser for the input and output symbols.
+\param addArc
+    The function to be called with the result of an arc line.
+\param addFinalState
+    The function to be called with the result of a final-state line.
+*/
+template <class SymbolName, class AddArc, class AddFinalState>
+    void parseLines (TextFileRange && fileRange, SymbolName const & symbolName,
+        AddArc const & addArc, AddFinalState const & addFinalState)
 {
-    PARSE_LL_DEFINE_NAMED_PARSER (ch, char_ - one_whitespace);
-
-    PARSE_LL_DEFINE_NAMED_PARSER (symbolName,
-        no_skip [(+ch) [convertToStdString()]]);
     PARSE_LL_DEFINE_NAMED_PARSER (stateName, unsigned_as <State>());
     PARSE_LL_DEFINE_NAMED_PARSER (weight, float_as <double>());
 
     // PARSE_LL_DEFINE_NAMED_PARSER (transition,
     //     (stateName >> stateName >> symbolName >> symbolName >> -weight)
-    //     [AddArc (automaton)]);
+    //     [addArc]);
     rule <TextFileRange, Nothing> transition =
         (stateName >> stateName >> symbolName >> symbolName >> -weight)
-        [AddArc (automaton, inputSymbolTable, outputSymbolTable)];
+        [addArc];
     // PARSE_LL_DEFINE_NAMED_PARSER (finalState, (stateName >> -weight)
-    //     [AddFinalState (automaton)]);
+    //     [addFinalState]);
     rule <TextFileRange, Nothing> finalState = (stateName >> -weight)
-        [AddFinalState (automaton)];
+        [addFinalState];
 
     auto line = transition | finalState;
 
@@ -190,10 +213,37 @@ void readAutomatonFrom (
         throw parse_ll::error() << error_at (rest (outcome));
 }
 
+void readAutomatonFrom (TextFileRange && fileRange,
+    AutomatonWrapper <OptionalSequence> & automaton,
+    SymbolTable const & inputSymbolTable,
+    SymbolTable const & outputSymbolTable)
+{
+    PARSE_LL_DEFINE_NAMED_PARSER (ch, char_ - one_whitespace);
+
+    PARSE_LL_DEFINE_NAMED_PARSER (symbolName,
+        no_skip [(+ch) [convertToStdString()]]);
+
+    parseLines (std::move (fileRange), symbolName,
+        AddArc (automaton, inputSymbolTable, outputSymbolTable),
+        AddFinalState <AutomatonWrapper <OptionalSequence>> (automaton));
+}
+
+void readIntegerAutomatonFrom (TextFileRange && fileRange,
+    AutomatonWrapper <IntegerOptionalSequence> & automaton)
+{
+    PARSE_LL_DEFINE_NAMED_PARSER (symbolName, unsigned_as <unsigned>());
+
+    parseLines (std::move (fileRange), symbolName,
+        AddIntegerArc (automaton),
+        AddFinalState <AutomatonWrapper <IntegerOptionalSequence>> (
+            automaton));
+}
+
 } // namespace
 
 void readAutomaton (
-    std::string const & fileName, AutomatonWrapper & wrapper,
+    std::string const & fileName,
+    AutomatonWrapper <OptionalSequence> & wrapper,
     SymbolTable const & inputSymbolTable,
     SymbolTable const & outputSymbolTable)
 {
@@ -204,6 +254,16 @@ void readAutomaton (
         fileName);
 }
 
+void readAutomaton (
+    std::string const & fileName,
+    AutomatonWrapper <IntegerOptionalSequence> & wrapper)
+{
+    return readTextFile (
+        std::bind <void> (readIntegerAutomatonFrom,
+            std::placeholders::_1, std::ref (wrapper)),
+        fileName);
+}
+
 } // namespace detail
 
 }} // namespace flipsta::att
@@ -22,10 +22,14 @@ http://www2.research.att.com/~fsmtools/fsm/man/fsm.5.html
 
 #include "flipsta/att/symbol_table.hpp"
 
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <functional>
+
 #include <boost/exception/all.hpp>
 
 #include <boost/format.hpp>
-#include <boost/bimap.hpp>
 
 #include "utility/unique_ptr.hpp"
 
@@ -104,70 +108,103 @@ std::unique_ptr <SymbolTable> readSymbolTableFrom (TextFileRange && file_range)
     // The output must be in memory explicitly...!
     auto && o = output (outcome);
 
-    typedef boost::bimap <std::string, Index> mappings_type;
-    typedef typename mappings_type::value_type mapping_type;
+    /*
+    Since the indices must be dense, they can be used directly to put the names
+    in a vector.
+    With n mappings, valid indices are between 0 and n inclusive.
+    This detects duplicate indices in constant time, and leaves the names
+    sorted by index, so they can be added to the alphabet in one go.
+    */
+    std::size_t mappingNum = 0;
+    RANGE_FOR_EACH (mapping, range::first (o)) {
+        (void) mapping;
+        ++ mappingNum;
+    }
+
+    std::vector <std::string> names (mappingNum + 1);
+    std::vector <bool> present (mappingNum + 1, false);
 
-    mappings_type mappings;
     RANGE_FOR_EACH (mapping, range::first (o)) {
-        // Check for duplicate index.
-        auto same_index = mappings.right.find (second (mapping));
-        if (same_index != mappings.right.end())
+        Index index = second (mapping);
+        if (index > mappingNum)
             throw parse_ll::error()
-                << parse_ll::error_description (boost::str (boost::format (
-                    "Duplicate index: %i (for %s and %s)") %
-                    second (mapping) % same_index->second % first (mapping)));
+                << parse_ll::error_description ((
+                    boost::format ("The values in the symbol table must "
+                        "start at 0 or 1 and be dense, i.e. all 1 apart, so "
+                        "%i (for %s) cannot be in a table with %i symbols.")
+                    % index % first (mapping) % mappingNum).str());
 
-        // Check for duplicate symbol name.
-        auto same_name = mappings.left.find (first (mapping));
-        if (same_name != mappings.left.end())
+        // Check for duplicate index.
+        if (present [index])
             throw parse_ll::error()
                 << parse_ll::error_description (boost::str (boost::format (
-                    "Duplicate name: %s (with %i and %i)") %
-                    first (mapping) % same_name->second % second (mapping)));
+                    "Duplicate index: %i (for %s and %s)") %
+                    index % names [index] % first (mapping)));
 
-        mappings.insert (mapping_type (first (mapping), second (mapping)));
+        names [index] = first (mapping);
+        present [index] = true;
     }
 
-    auto mappingsView = range::make_iterator_range (mappings.right);
-
-    if (empty (mappingsView))
-        return result;
-
-    // Check that we start with 0 or 1.
-    Index lowestIndex = first (mappingsView).first;
-    if (lowestIndex != 0 && lowestIndex != 1) {
-
-        throw parse_ll::error()
-            << parse_ll::error_description ((boost::format (
-                "The lowest index in symbol table must be 0 or 1, "
-                "not %i (for %s).")
-                % lowestIndex % first (mappingsView).second).str());
+    // Check for duplicate symbol names.
+    {
+        struct HashPointee {
+            std::size_t operator() (std::string const * name) const
+            { return std::hash <std::string>() (*name); }
+        };
+        struct EqualPointee {
+            bool operator() (std::string const * left,
+                std::string const * right) const
+            { return *left == *right; }
+        };
+        std::unordered_map <std::string const *, Index,
+            HashPointee, EqualPointee> indices (mappingNum);
+
+        for (Index index = 0; index != names.size(); ++ index) {
+            if (!present [index])
+                continue;
+            auto inserted = indices.insert (
+                std::make_pair (&names [index], index));
+            if (!inserted.second)
+                throw parse_ll::error()
+                    << parse_ll::error_description (boost::str (boost::format (
+                        "Duplicate name: %s (with %i and %i)") %
+                        names [index] % inserted.first->second % index));
+        }
     }
 
-    if (first (mappingsView).first == 0) {
-        result->setEmptySymbol (first (mappingsView).second);
-        mappingsView = drop (mappingsView);
-    }
+    if (mappingNum == 0)
+        return result;
 
-    // Check that values are adjacent.
-    Index previousIndex = 0;
-    RANGE_FOR_EACH (mapping, mappingsView) {
-        if (previousIndex + 1 != mapping.first) {
+    if (present [0])
+        result->setEmptySymbol (std::move (names [0]));
+
+    /*
+    Check that values are adjacent.
+    Since the indices are unique and between 0 and mappingNum, exactly one
+    index in that range is not present.
+    If it is 0, the indices start at 1 and are dense.
+    Otherwise, the indices start at 0 and the missing one must be the last.
+    */
+    Index lastIndex = present [0] ? mappingNum - 1 : mappingNum;
+    for (Index index = 1; index <= lastIndex; ++ index) {
+        if (!present [index]) {
+            Index nextIndex = index + 1;
             throw parse_ll::error()
                 << parse_ll::error_description ((
                     boost::format ("The values in the symbol table must be "
                         "dense, i.e. all 1 apart, which %i and %i (for %s) "
                         "are not.")
-                    % previousIndex % mapping.first % mapping.second).str());
+                    % (index - 1) % nextIndex % names [nextIndex]).str());
         }
-        previousIndex = mapping.first;
     }
 
-    RANGE_FOR_EACH (mapping, mappingsView) {
-        auto index = result->alphabet()->add_symbol (mapping.second);
+    for (Index index = 1; index <= lastIndex; ++ index) {
+        auto symbol = result->alphabet()->add_symbol (names [index]);
         // The symbol table starts numbering non-empty symbols from 1.
-        assert (index.id() == mapping.first - 1);
-        (void) index;
+        assert (symbol.id() == index - 1);
+        (void) symbol;
+        // Release the memory straight away.
+        std::string().swap (names [index]);
     }
 
     return std::move (result);
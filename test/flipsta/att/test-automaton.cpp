@@ -15,9 +15,14 @@ limitations under the License.
 */
 
 /** \file
-Test readAutomaton.
-The first argument must be the file name of a symbol table, and the second
-the file name of the automaton.
+Test readAutomaton and readAutomatonWithIntegerSymbols.
+The first argument must be the file name of an automaton with symbols written
+as integers (reference-integer.txt), the second the file name of an automaton
+with the same structure with symbols written as names (reference.txt), and the
+third the file name of its symbol table (symbols.txt).
+Boost.Build requires the input files of a test to be listed in the Jamfile
+sorted by name, and passes them in that order, so an input file that is added
+may change the numbering of the arguments.
 
 This currently merely checks only one automaton.
 Then again, since reading the automaton is about reading different lines and
@@ -32,11 +37,14 @@ currently.
 
 #include <iostream>
 #include <ostream>
+#include <type_traits>
 
 #include <boost/exception/all.hpp>
 
 #include "range/walk_size.hpp"
 
+#include "math/cost.hpp"
+
 using flipsta::hasState;
 using flipsta::arcsOn;
 using flipsta::forward;
@@ -54,10 +62,10 @@ BOOST_AUTO_TEST_CASE (from_example) {
     char ** argv = boost::unit_test::framework::master_test_suite().argv;
 
     // Otherwise there are no files to test on.
-    BOOST_REQUIRE_EQUAL (argc, 3);
+    BOOST_REQUIRE_EQUAL (argc, 4);
 
     try {
-        auto symbolTable = flipsta::att::readSymbolTable (argv [1]);
+        auto symbolTable = flipsta::att::readSymbolTable (argv [3]);
         auto automaton = flipsta::att::readAutomaton (argv [2],
             *symbolTable, *symbolTable);
 
@@ -155,4 +163,143 @@ BOOST_AUTO_TEST_CASE (from_example) {
     }
 }
 
+/*
+Read the same automaton with a different weight type.
+*/
+BOOST_AUTO_TEST_CASE (from_example_float) {
+    int argc = boost::unit_test::framework::master_test_suite().argc;
+    char ** argv = boost::unit_test::framework::master_test_suite().argv;
+
+    BOOST_REQUIRE_EQUAL (argc, 4);
+
+    typedef math::cost <float> Weight;
+
+    try {
+        auto symbolTable = flipsta::att::readSymbolTable (argv [3]);
+        auto automaton = flipsta::att::readAutomaton <Weight> (argv [2],
+            *symbolTable, *symbolTable);
+
+        static_assert (std::is_same <
+            typename std::decay <decltype (third (
+                first (arcsOn (*automaton, forward, 0)).label().components()))
+            >::type, Weight>::value,
+            "The weight type should be the one passed in.");
+
+        BOOST_CHECK (hasState (*automaton, std::size_t (4)));
+
+        // Start state.
+        {
+            auto startStates = flipsta::terminalStates (
+                *automaton, flipsta::forward);
+            BOOST_CHECK_EQUAL (range::walk_size (startStates), 1u);
+            BOOST_CHECK_EQUAL (first (first (startStates)), 0);
+        }
+
+        // The final weight of state 4.
+        {
+            auto endStates = flipsta::terminalStates (
+                *automaton, flipsta::backward);
+            RANGE_FOR_EACH (endState, endStates) {
+                if (first (endState) == 4) {
+                    auto finalLabel = second (endState).components();
+                    BOOST_CHECK_EQUAL (third (finalLabel).value(), 2.f);
+                }
+            }
+        }
+
+        // The arc from state 2 to 3 has weight 7.
+        {
+            auto arcs = flipsta::arcsOn (*automaton, forward, 2);
+            BOOST_CHECK_EQUAL (walk_size (arcs), 1);
+            auto arc = first (arcs);
+            BOOST_CHECK_EQUAL (arc.state (forward), 3);
+            BOOST_CHECK_EQUAL (
+                third (arc.label().components()).value(), 7.f);
+        }
+    } catch (boost::exception &e) {
+        std::cerr << "Unexpected error while parsing AT&T-style automaton.\n";
+        flipsta::explainException (std::cerr, e);
+
+        BOOST_FAIL ("No exception should have been thrown.");
+    }
+}
+
+/*
+Read an automaton with integer symbols, without a symbol table.
+*/
+BOOST_AUTO_TEST_CASE (from_example_integer) {
+    int argc = boost::unit_test::framework::master_test_suite().argc;
+    char ** argv = boost::unit_test::framework::master_test_suite().argv;
+
+    BOOST_REQUIRE_EQUAL (argc, 4);
+
+    typedef flipsta::Dense <unsigned> Symbol;
+
+    try {
+        auto automaton = flipsta::att::readAutomatonWithIntegerSymbols (
+            argv [1]);
+
+        static_assert (std::is_same <
+            typename std::decay <decltype (first (
+                first (arcsOn (*automaton, forward, 0)).label().components()))
+            >::type, math::optional_sequence <Symbol>>::value,
+            "The symbols should be integers.");
+
+        BOOST_CHECK (hasState (*automaton, std::size_t (0)));
+        BOOST_CHECK (hasState (*automaton, std::size_t (4)));
+
+        // Start state.
+        {
+            auto startStates = flipsta::terminalStates (
+                *automaton, flipsta::forward);
+            BOOST_CHECK_EQUAL (range::walk_size (startStates), 1u);
+            BOOST_CHECK_EQUAL (first (first (startStates)), 0);
+        }
+
+        // Two end states.
+        {
+            auto endStates = flipsta::terminalStates (
+                *automaton, flipsta::backward);
+            BOOST_CHECK_EQUAL (range::walk_size (endStates), 2u);
+        }
+
+        // From state 0: symbol 4 ("a").
+        {
+            auto arcs = flipsta::arcsOn (*automaton, forward, 0);
+            BOOST_CHECK_EQUAL (walk_size (arcs), 1);
+            auto arc = first (arcs);
+            BOOST_CHECK_EQUAL (arc.state (forward), 1);
+            auto components = arc.label().components();
+            BOOST_CHECK (first (components).symbol().get() == Symbol (4));
+            BOOST_CHECK (second (components).symbol().get() == Symbol (4));
+            BOOST_CHECK_EQUAL (third (components).value(), 0);
+        }
+
+        // Into state 2: symbols 5 and 6, and on one arc 0, i.e. empty.
+        {
+            auto arcs = flipsta::arcsOn (*automaton, backward, 2);
+            BOOST_CHECK_EQUAL (walk_size (arcs), 2);
+            RANGE_FOR_EACH (arc, arcs) {
+                auto components = arc.label().components();
+                BOOST_CHECK_EQUAL (arc.state (backward), 1);
+                if (first (components).symbol().get() == Symbol (5)) {
+                    BOOST_CHECK (
+                        second (components).symbol().get() == Symbol (5));
+                    BOOST_CHECK_EQUAL (third (components).value(), 2);
+                } else {
+                    BOOST_CHECK (
+                        first (components).symbol().get() == Symbol (6));
+                    BOOST_CHECK (!second (components).symbol());
+                    BOOST_CHECK_EQUAL (third (components).value(), 0);
+                }
+            }
+        }
+    } catch (boost::exception &e) {
+        std::cerr << "Unexpected error while parsing AT&T-style automaton.\n";
+        flipsta::explainException (std::cerr, e);
+
+        BOOST_FAIL ("No exception should have been thrown.");
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
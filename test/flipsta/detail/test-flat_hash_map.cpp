@@ -0,0 +1,126 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_detail_flat_hash_map
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/detail/flat_hash_map.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <random>
+
+BOOST_AUTO_TEST_SUITE(test_suite_flipsta_detail_flat_hash_map)
+
+using flipsta::detail::FlatHashMap;
+
+BOOST_AUTO_TEST_CASE (testFlatHashMapSimple) {
+    FlatHashMap <int, std::string> map;
+    BOOST_CHECK (map.empty());
+    BOOST_CHECK (!map.contains (5));
+    BOOST_CHECK (!map.find (5));
+    BOOST_CHECK (!map.erase (5));
+
+    map.set (5, "five");
+    BOOST_CHECK (!map.empty());
+    BOOST_CHECK_EQUAL (map.size(), 1u);
+    BOOST_CHECK (map.contains (5));
+    BOOST_CHECK_EQUAL (*map.find (5), "five");
+
+    map.set (5, "vijf");
+    BOOST_CHECK_EQUAL (map.size(), 1u);
+    BOOST_CHECK_EQUAL (*map.find (5), "vijf");
+
+    *map.find (5) = "cinq";
+    BOOST_CHECK_EQUAL (*map.find (5), "cinq");
+
+    map.set (7, "seven");
+    BOOST_CHECK_EQUAL (map.size(), 2u);
+
+    // Copy and move.
+    {
+        FlatHashMap <int, std::string> copy (map);
+        BOOST_CHECK_EQUAL (copy.size(), 2u);
+        BOOST_CHECK_EQUAL (*copy.find (7), "seven");
+
+        FlatHashMap <int, std::string> moved (std::move (copy));
+        BOOST_CHECK_EQUAL (moved.size(), 2u);
+        BOOST_CHECK_EQUAL (*moved.find (5), "cinq");
+
+        moved.set (8, "eight");
+        map = moved;
+        BOOST_CHECK_EQUAL (map.size(), 3u);
+    }
+
+    BOOST_CHECK (map.erase (5));
+    BOOST_CHECK (!map.contains (5));
+    BOOST_CHECK_EQUAL (map.size(), 2u);
+    BOOST_CHECK_EQUAL (*map.find (7), "seven");
+    BOOST_CHECK_EQUAL (*map.find (8), "eight");
+
+    map.clear();
+    BOOST_CHECK (map.empty());
+    BOOST_CHECK (!map.contains (7));
+    map.set (7, "zeven");
+    BOOST_CHECK_EQUAL (*map.find (7), "zeven");
+}
+
+/**
+Compare the behaviour with that of std::unordered_map on random operations.
+The range of keys is varied so that the map is sometimes nearly full, and
+sometimes sparse.
+*/
+BOOST_AUTO_TEST_CASE (testFlatHashMapRandom) {
+    std::mt19937 generator (12);
+    for (int keyNum : {4, 30, 500, 10000}) {
+        FlatHashMap <int, int> map;
+        std::unordered_map <int, int> reference;
+        std::uniform_int_distribution <int> keyDistribution (0, keyNum - 1);
+        std::uniform_int_distribution <int> operationDistribution (0, 2);
+
+        for (int i = 0; i != 20000; ++ i) {
+            int key = keyDistribution (generator);
+            switch (operationDistribution (generator)) {
+            case 0:
+                map.set (key, i);
+                reference [key] = i;
+                break;
+            case 1:
+                BOOST_CHECK_EQUAL (map.erase (key),
+                    reference.erase (key) != 0);
+                break;
+            default:
+                {
+                    int const * value = map.find (key);
+                    auto position = reference.find (key);
+                    BOOST_CHECK_EQUAL (!!value, position != reference.end());
+                    if (value && position != reference.end())
+                        BOOST_CHECK_EQUAL (*value, position->second);
+                }
+            }
+            BOOST_CHECK_EQUAL (map.size(), reference.size());
+        }
+
+        std::size_t count = 0;
+        map.forEach ([&] (int key, int value) {
+            ++ count;
+            BOOST_CHECK_EQUAL (reference [key], value);
+        });
+        BOOST_CHECK_EQUAL (count, reference.size());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
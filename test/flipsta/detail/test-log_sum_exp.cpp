@@ -0,0 +1,105 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_detail_log_sum_exp
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/detail/log_sum_exp.hpp"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using flipsta::LogAddAccuracy;
+using flipsta::detail::fastExp;
+using flipsta::detail::logSumExp;
+
+BOOST_AUTO_TEST_SUITE(test_suite_log_sum_exp)
+
+template <class Float> void checkFastExp (Float tolerance) {
+    for (Float x = -80; x <= 0; x += Float (.01)) {
+        Float exact = std::exp (x);
+        BOOST_CHECK (std::fabs (fastExp (x) - exact) <= tolerance * exact);
+    }
+    BOOST_CHECK_EQUAL (fastExp (Float (0)), Float (1));
+}
+
+BOOST_AUTO_TEST_CASE (test_fast_exp) {
+    checkFastExp <float> (3e-7f);
+    checkFastExp <double> (1e-12);
+}
+
+/**
+Compare logSumExp with a straightforward computation, for arrays of all lengths
+up to 40, so that both the SIMD code and the remainder are exercised.
+*/
+template <class Float> void checkLogSumExp (
+    LogAddAccuracy accuracy, Float tolerance)
+{
+    std::vector <Float> values;
+    for (int size = 0; size != 40; ++ size) {
+        double sum = 0;
+        for (Float const & value : values)
+            sum += std::exp (double (value));
+        double expected = std::log (sum);
+
+        Float result = logSumExp (values.data(), values.size(), accuracy);
+        if (values.empty())
+            BOOST_CHECK (std::isinf (result) && result < 0);
+        else
+            BOOST_CHECK (std::fabs (result - expected) < tolerance);
+
+        values.push_back (Float ((size * 37) % 23) / 3 - 5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_log_sum_exp) {
+    checkLogSumExp <float> (LogAddAccuracy::exact, 1e-5f);
+    checkLogSumExp <float> (LogAddAccuracy::fast, 1e-5f);
+    checkLogSumExp <double> (LogAddAccuracy::exact, 1e-12);
+    checkLogSumExp <double> (LogAddAccuracy::fast, 1e-11);
+}
+
+template <class Float> void checkSpecialValues (LogAddAccuracy accuracy) {
+    Float const infinity = std::numeric_limits <Float>::infinity();
+
+    // Without subtracting the maximum, exp would overflow or underflow.
+    std::vector <Float> large {1000, 1000};
+    BOOST_CHECK (std::fabs (logSumExp (large.data(), 2, accuracy)
+        - (1000 + std::log (Float (2)))) < Float (1e-3));
+    std::vector <Float> small {-1000, -1000};
+    BOOST_CHECK (std::fabs (logSumExp (small.data(), 2, accuracy)
+        - (-1000 + std::log (Float (2)))) < Float (1e-3));
+
+    // Minus infinity is the additive identity.
+    std::vector <Float> zeros {-infinity, -infinity, -infinity};
+    BOOST_CHECK_EQUAL (logSumExp (zeros.data(), 3, accuracy), -infinity);
+    std::vector <Float> withZero {-infinity, Float (2.5), -infinity};
+    BOOST_CHECK (std::fabs (logSumExp (withZero.data(), 3, accuracy)
+        - Float (2.5)) < Float (1e-6));
+
+    std::vector <Float> withInfinity {1, infinity};
+    BOOST_CHECK_EQUAL (logSumExp (withInfinity.data(), 2, accuracy), infinity);
+}
+
+BOOST_AUTO_TEST_CASE (test_log_sum_exp_special) {
+    checkSpecialValues <float> (LogAddAccuracy::exact);
+    checkSpecialValues <float> (LogAddAccuracy::fast);
+    checkSpecialValues <double> (LogAddAccuracy::exact);
+    checkSpecialValues <double> (LogAddAccuracy::fast);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
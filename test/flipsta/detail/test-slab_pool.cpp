@@ -0,0 +1,70 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_slab_pool
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/detail/slab_pool.hpp"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+using flipsta::detail::SlabPool;
+
+BOOST_AUTO_TEST_SUITE(test_suite_slab_pool)
+
+struct Big {
+    double values [5];
+};
+
+BOOST_AUTO_TEST_CASE (testSlabPool) {
+    SlabPool <Big> pool;
+    BOOST_CHECK_EQUAL (pool.slabNum(), 0u);
+    BOOST_CHECK_EQUAL (pool.capacity(), 0u);
+
+    std::vector <void *> memory;
+    std::set <void *> distinct;
+    for (int i = 0; i != 1000; ++ i) {
+        void * object = pool.allocate();
+        BOOST_CHECK_EQUAL (
+            reinterpret_cast <std::uintptr_t> (object) % alignof (Big), 0u);
+        memory.push_back (object);
+        distinct.insert (object);
+        // Check that the memory can be written to.
+        new (object) Big();
+    }
+    BOOST_CHECK_EQUAL (distinct.size(), 1000u);
+    BOOST_CHECK (pool.capacity() >= 1000);
+    BOOST_CHECK (pool.memory() >= pool.capacity() * sizeof (Big));
+    std::size_t slabNum = pool.slabNum();
+    // The slabs grow, so there should be few of them.
+    BOOST_CHECK (slabNum < 10);
+
+    // Memory that is given back is reused first.
+    pool.deallocate (memory [10]);
+    pool.deallocate (memory [20]);
+    BOOST_CHECK_EQUAL (pool.allocate(), memory [20]);
+    BOOST_CHECK_EQUAL (pool.allocate(), memory [10]);
+
+    for (void * object : memory)
+        pool.deallocate (object);
+    for (int i = 0; i != 1000; ++ i)
+        BOOST_CHECK (distinct.count (pool.allocate()) == 1);
+    BOOST_CHECK_EQUAL (pool.slabNum(), slabNum);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
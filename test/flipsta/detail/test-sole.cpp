@@ -23,6 +23,7 @@ limitations under the License.
 #include <string>
 #include <iostream>
 #include <ostream>
+#include <thread>
 
 #include <boost/functional/hash.hpp>
 
@@ -31,6 +32,7 @@ limitations under the License.
 
 using flipsta::detail::SoleStore;
 using flipsta::detail::SoleBase;
+using flipsta::detail::SolePtr;
 
 using range::view;
 using range::empty;
@@ -63,7 +65,7 @@ class SimpleState : SoleBase <SimpleState> {
 
     char symbol_;
     bool final_;
-    std::vector <std::shared_ptr <SimpleState const>> successors_;
+    std::vector <SolePtr <SimpleState>> successors_;
 
     void addSuccessor_ (SimpleState const & s) {
         successors_.push_back (store()->get (s));
@@ -111,6 +113,74 @@ std::size_t hash_value (SimpleState const & s) {
     return hasher (s.symbol());
 }
 
+/**
+Element of a singly linked list, which holds on to the next element.
+*/
+class Link : SoleBase <Link> {
+    typedef SoleBase <Link> SoleType;
+    friend class SoleBase <Link>;
+
+    int index_;
+    SolePtr <Link> next_;
+
+public:
+    Link (Store * store, int index, SolePtr <Link> next)
+    : SoleType (store), index_ (index), next_ (std::move (next)) {}
+
+    int index() const { return index_; }
+    SolePtr <Link> const & next() const { return next_; }
+};
+
+bool operator== (Link const & left, Link const & right)
+{ return left.index() == right.index() && left.next() == right.next(); }
+
+std::size_t hash_value (Link const & link)
+{ return std::size_t (link.index()); }
+
+/**
+Element of a linked list that, once it is armed, retrieves an element from the
+store after it has released its successor.
+*/
+class RetrievingLink : SoleBase <RetrievingLink> {
+    typedef SoleBase <RetrievingLink> SoleType;
+    friend class SoleBase <RetrievingLink>;
+
+    struct Retrieve {
+        Store * store;
+        int index;
+        bool const * armed;
+        SolePtr <RetrievingLink> * result;
+
+        ~Retrieve() {
+            if (armed && *armed)
+                *result = store->get (
+                    RetrievingLink (store, index, nullptr));
+        }
+    };
+
+    int index_;
+    // This is destructed after next_.
+    Retrieve retrieve_;
+    SolePtr <RetrievingLink> next_;
+
+public:
+    RetrievingLink (Store * store, int index, SolePtr <RetrievingLink> next,
+        bool const * armed = nullptr, int retrieveIndex = 0,
+        SolePtr <RetrievingLink> * result = nullptr)
+    : SoleType (store), index_ (index),
+        retrieve_ {store, retrieveIndex, armed, result},
+        next_ (std::move (next)) {}
+
+    int index() const { return index_; }
+    SolePtr <RetrievingLink> const & next() const { return next_; }
+};
+
+bool operator== (RetrievingLink const & left, RetrievingLink const & right)
+{ return left.index() == right.index() && left.next() == right.next(); }
+
+std::size_t hash_value (RetrievingLink const & link)
+{ return std::size_t (link.index()); }
+
 BOOST_AUTO_TEST_SUITE(test_suite_sore)
 
 BOOST_AUTO_TEST_CASE (test_sole_simple) {
@@ -191,7 +261,7 @@ BOOST_AUTO_TEST_CASE (test_flipsta_multiple) {
 BOOST_AUTO_TEST_CASE (test_sole_derived) {
     SoleStore <SimpleState> states;
 
-    auto singletonQ = std::make_shared <SimpleState> (nullptr, 'q');
+    auto singletonQ = flipsta::detail::makeSole <SimpleState> (nullptr, 'q');
 
     states.set (singletonQ);
 
@@ -203,7 +273,7 @@ BOOST_AUTO_TEST_CASE (test_sole_derived) {
 
         SimpleState qState (&states, 'q');
         auto soleQ = states.get (qState);
-        BOOST_CHECK_EQUAL (singletonQ, soleQ);
+        BOOST_CHECK (singletonQ == soleQ);
 
         auto bFinal = states.get (SimpleState (&states, 'b', true));
         auto bNonFinal = states.get (SimpleState (&states, 'b', false));
@@ -246,8 +316,149 @@ BOOST_AUTO_TEST_CASE (test_sole_derived) {
             BOOST_CHECK_EQUAL (chop_in_place (s), "abcd");
             BOOST_CHECK (empty (s));
         }
+
+        // q, a, final b, b, c, final d.
+        BOOST_CHECK_EQUAL (states.size(), 6u);
+        BOOST_CHECK (states.memory() >= 5 * sizeof (SimpleState));
     }
+    BOOST_CHECK_EQUAL (states.size(), 1u);
+    // The memory is kept for reuse.
+    BOOST_CHECK (states.memory() >= 5 * sizeof (SimpleState));
     states.remove (singletonQ);
+    BOOST_CHECK_EQUAL (states.size(), 0u);
+}
+
+// Releasing a long chain of objects must not destruct them recursively, which
+// would overflow the stack.
+BOOST_AUTO_TEST_CASE (test_sole_long_chain) {
+    SoleStore <Link> links;
+    int const length = 1000000;
+    {
+        SolePtr <Link> head;
+        for (int index = 0; index != length; ++ index)
+            head = links.get (Link (&links, index, std::move (head)));
+        BOOST_CHECK_EQUAL (links.size(), std::size_t (length));
+        BOOST_CHECK_EQUAL (head->index(), length - 1);
+        BOOST_CHECK_EQUAL (head->next()->index(), length - 2);
+    }
+    BOOST_CHECK_EQUAL (links.size(), 0u);
+}
+
+// An object that is queued for destruction must not be returned when its value
+// is retrieved from the store.
+BOOST_AUTO_TEST_CASE (test_sole_retrieve_queued) {
+    SoleStore <RetrievingLink> links;
+    bool armed = false;
+    SolePtr <RetrievingLink> retrieved;
+    {
+        auto second = links.get (RetrievingLink (&links, 1, nullptr));
+        auto first = links.get (
+            RetrievingLink (&links, 0, second, &armed, 1, &retrieved));
+        armed = true;
+        second.reset();
+        // When "first" is released, "second" is queued for destruction, and
+        // then "first" retrieves a link equal to "second".
+    }
+    BOOST_REQUIRE (retrieved);
+    BOOST_CHECK_EQUAL (retrieved->index(), 1);
+    BOOST_CHECK (!retrieved->next());
+    BOOST_CHECK_EQUAL (links.size(), 1u);
+    BOOST_CHECK (links.get (RetrievingLink (&links, 1, nullptr)) == retrieved);
+    armed = false;
+    retrieved.reset();
+    BOOST_CHECK_EQUAL (links.size(), 0u);
+}
+
+// Use the store from multiple threads at the same time.
+BOOST_AUTO_TEST_CASE (test_sole_concurrent) {
+    SoleStore <int> ints (true);
+    BOOST_CHECK (ints.concurrent());
+    BOOST_CHECK (!SoleStore <int>().concurrent());
+
+    // These objects stay alive throughout.
+    std::vector <std::shared_ptr <int const>> kept;
+    for (int i = 0; i != 100; ++ i)
+        kept.push_back (ints.get (i));
+
+    std::size_t const threadNum = 8;
+    std::vector <int> failures (threadNum, 0);
+    {
+        std::vector <std::thread> threads;
+        for (std::size_t thread = 0; thread != threadNum; ++ thread) {
+            threads.emplace_back ([&, thread]() {
+                for (int round = 0; round != 20000; ++ round) {
+                    int i = int ((round * 7 + thread) % 200);
+                    // Values from 100 are created and destructed all the time,
+                    // by all threads.
+                    auto sole = ints.get (i);
+                    if (*sole != i)
+                        ++ failures [thread];
+                    if (i < 100 && sole != kept [i])
+                        ++ failures [thread];
+                }
+            });
+        }
+        for (std::thread & thread : threads)
+            thread.join();
+    }
+    for (int failureNum : failures)
+        BOOST_CHECK_EQUAL (failureNum, 0);
+
+    // Only the objects in "kept" should be left.
+    auto sole150 = ints.get (150);
+    std::weak_ptr <int const> weak150 (sole150);
+    BOOST_CHECK (ints.get (150) == sole150);
+    sole150.reset();
+    BOOST_CHECK (weak150.expired());
+    BOOST_CHECK (ints.get (5) == kept [5]);
+}
+
+// Objects derived from SoleBase in a concurrent store.
+BOOST_AUTO_TEST_CASE (test_sole_derived_concurrent) {
+    SoleStore <SimpleState> states (true);
+
+    // These objects stay alive throughout.
+    std::vector <SolePtr <SimpleState>> kept;
+    for (char symbol = 'a'; symbol != 'k'; ++ symbol)
+        kept.push_back (states.get (SimpleState (&states, symbol)));
+
+    {
+        // Copies point to the same object.
+        SolePtr <SimpleState> copy = kept [3];
+        BOOST_CHECK (copy == kept [3]);
+        BOOST_CHECK (copy != kept [4]);
+        SolePtr <SimpleState> moved = std::move (copy);
+        BOOST_CHECK (!copy);
+        BOOST_CHECK (moved.get() == kept [3].get());
+        BOOST_CHECK (moved != nullptr);
+    }
+
+    std::size_t const threadNum = 8;
+    std::vector <int> failures (threadNum, 0);
+    {
+        std::vector <std::thread> threads;
+        for (std::size_t thread = 0; thread != threadNum; ++ thread) {
+            threads.emplace_back ([&, thread]() {
+                for (int round = 0; round != 20000; ++ round) {
+                    int index = int ((round * 7 + thread) % 20);
+                    char symbol = char ('a' + index);
+                    // Symbols from 'k' are created and destructed all the
+                    // time, by all threads.
+                    auto sole = states.get (SimpleState (&states, symbol));
+                    // Copy, to change the reference count.
+                    auto copy = sole;
+                    if (copy->symbol() != symbol)
+                        ++ failures [thread];
+                    if (index < 10 && copy != kept [index])
+                        ++ failures [thread];
+                }
+            });
+        }
+        for (std::thread & thread : threads)
+            thread.join();
+    }
+    for (int failureNum : failures)
+        BOOST_CHECK_EQUAL (failureNum, 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
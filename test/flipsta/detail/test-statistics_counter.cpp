@@ -0,0 +1,66 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_statistics_counter
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/detail/statistics_counter.hpp"
+
+#include <thread>
+#include <vector>
+
+using flipsta::detail::StatisticsCounter;
+
+BOOST_AUTO_TEST_SUITE(test_suite_statistics_counter)
+
+BOOST_AUTO_TEST_CASE (testEnabled) {
+    StatisticsCounter <true> counter;
+    BOOST_CHECK_EQUAL (counter.value(), 0u);
+    ++ counter;
+    ++ counter;
+    BOOST_CHECK_EQUAL (counter.value(), 2u);
+    counter.raise (1);
+    BOOST_CHECK_EQUAL (counter.value(), 2u);
+    counter.raise (5);
+    BOOST_CHECK_EQUAL (counter.value(), 5u);
+
+    StatisticsCounter <true> concurrent;
+    StatisticsCounter <true> maximum;
+    {
+        std::vector <std::thread> threads;
+        for (int thread = 0; thread != 4; ++ thread) {
+            threads.emplace_back ([&, thread]() {
+                for (int i = 0; i != 1000; ++ i) {
+                    ++ concurrent;
+                    maximum.raise (std::size_t (thread * 1000 + i));
+                }
+            });
+        }
+        for (std::thread & thread : threads)
+            thread.join();
+    }
+    BOOST_CHECK_EQUAL (concurrent.value(), 4000u);
+    BOOST_CHECK_EQUAL (maximum.value(), 3999u);
+}
+
+BOOST_AUTO_TEST_CASE (testDisabled) {
+    StatisticsCounter <false> counter;
+    ++ counter;
+    counter.raise (5);
+    BOOST_CHECK_EQUAL (counter.value(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,98 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_detail_tropical_kernel
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/detail/tropical_kernel.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using flipsta::detail::minPlus;
+using flipsta::detail::minPlusScalar;
+
+BOOST_AUTO_TEST_SUITE(test_suite_tropical_kernel)
+
+/**
+Compare minPlus, which may use SIMD instructions, with the scalar version, for
+ranges of all lengths up to 40 and different offsets.
+*/
+template <class Float> void checkMinPlus() {
+    std::size_t const size = 64;
+    std::vector <Float> distances;
+    std::vector <std::uint32_t> neighbours;
+    std::vector <Float> weights;
+    std::vector <std::uint32_t> arcs;
+
+    unsigned random = 1;
+    auto next = [&random] (unsigned limit) -> unsigned {
+        random = random * 1103515245u + 12345u;
+        return (random >> 8) % limit;
+    };
+    for (std::size_t index = 0; index != size; ++ index) {
+        distances.push_back (index % 7 == 3
+            ? std::numeric_limits <Float>::infinity()
+            : Float (next (1000)) / 8 - 20);
+        neighbours.push_back (next (size));
+        weights.push_back (Float (next (1000)) / 4 - 100);
+        arcs.push_back (next (size));
+    }
+
+    for (std::size_t begin = 0; begin != 5; ++ begin) {
+        for (std::size_t end = begin; end != begin + 40; ++ end) {
+            for (Float initial : {Float (0), Float (-1000),
+                std::numeric_limits <Float>::infinity()})
+            {
+                BOOST_CHECK_EQUAL (
+                    minPlus (initial, distances.data(), neighbours.data(),
+                        weights.data(), arcs.data(), begin, end),
+                    minPlusScalar (initial, distances.data(),
+                        neighbours.data(), weights.data(), arcs.data(),
+                        begin, end));
+
+                std::uint32_t const * noArcs = nullptr;
+                BOOST_CHECK_EQUAL (
+                    minPlus (initial, distances.data(), neighbours.data(),
+                        weights.data(), noArcs, begin, end),
+                    minPlusScalar (initial, distances.data(),
+                        neighbours.data(), weights.data(), noArcs,
+                        begin, end));
+            }
+        }
+    }
+
+    // Check the scalar version against a direct computation.
+    BOOST_CHECK_EQUAL (minPlusScalar (Float (5), distances.data(),
+        neighbours.data(), weights.data(), arcs.data(), 2, 2), Float (5));
+    {
+        Float expected = distances [neighbours [arcs [3]]] + weights [arcs [3]];
+        Float other = distances [neighbours [arcs [4]]] + weights [arcs [4]];
+        if (other < expected)
+            expected = other;
+        BOOST_CHECK_EQUAL (minPlusScalar (
+            std::numeric_limits <Float>::infinity(), distances.data(),
+            neighbours.data(), weights.data(), arcs.data(), 3, 5), expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testMinPlus) {
+    checkMinPlus <float>();
+    checkMinPlus <double>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+Helpers for the tests of SharedAutomaton.
+*/
+
+#ifndef FLIPSTA_TEST_SHARED_AUTOMATON_HELPERS_HPP_INCLUDED
+#define FLIPSTA_TEST_SHARED_AUTOMATON_HELPERS_HPP_INCLUDED
+
+#include <cstddef>
+#include <map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "range/for_each_macro.hpp"
+#include "range/std/container.hpp"
+
+#include "flipsta/shared_automaton.hpp"
+
+/**
+Count the distinct states in the automaton.
+*/
+template <class Key, class Weight> inline
+    std::size_t countStates (
+        flipsta::SharedAutomaton <Key, Weight> const & automaton)
+{
+    typedef flipsta::SharedState <Key, Weight> State;
+    std::unordered_set <State const *> states;
+    std::vector <State const *> todo;
+    todo.push_back (automaton.state().get());
+    states.insert (todo.back());
+    while (!todo.empty()) {
+        State const * state = todo.back();
+        todo.pop_back();
+        RANGE_FOR_EACH (arc, state->arcs()) {
+            if (states.insert (arc.second.state().get()).second)
+                todo.push_back (arc.second.state().get());
+        }
+    }
+    return states.size();
+}
+
+/**
+Build an automaton where the states are shared between many paths.
+Each of the \a length states has arcs with keys 'a' and 'b' to the next state,
+so there are 2^length paths but only length + 1 states.
+*/
+template <class Key, class Weight> inline
+    flipsta::SharedAutomaton <Key, Weight> diamond (
+        flipsta::SharedAutomatonMemo <Key, Weight> & memo, int length)
+{
+    typedef flipsta::SharedState <Key, Weight> State;
+    typedef flipsta::SharedAutomaton <Key, Weight> Automaton;
+    Automaton result (math::one <Weight>(), State::finalState());
+    for (int i = 0; i != length; ++ i) {
+        std::map <Key, Automaton> arcs;
+        arcs.insert (std::make_pair (Key ('a'),
+            Automaton (math::one <Weight>(), result.state())));
+        arcs.insert (std::make_pair (Key ('b'),
+            Automaton (Weight (float (i + 1)), result.state())));
+        result = Automaton (Weight (.5f),
+            memo.get (State (&memo, math::zero <Weight>(), arcs)));
+    }
+    return result;
+}
+
+#endif // FLIPSTA_TEST_SHARED_AUTOMATON_HELPERS_HPP_INCLUDED
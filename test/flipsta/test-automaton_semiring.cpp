@@ -18,8 +18,13 @@ limitations under the License.
 #include "utility/test/boost_unit_test.hpp"
 
 #include "flipsta/automaton_semiring.hpp"
+#include "flipsta/automaton.hpp"
+#include "flipsta/shortest_distance.hpp"
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <thread>
 
 #include "range/std/container.hpp"
 
@@ -156,4 +161,99 @@ BOOST_AUTO_TEST_CASE (all) {
     }
 }
 
+/**
+Build the sum of the words, each of which is the product of its symbols.
+*/
+AutomatonSemiring buildLattice (Descriptor const & descriptor,
+    std::vector <std::string> const & words)
+{
+    AutomatonSemiring sum;
+    for (std::string const & word : words) {
+        AutomatonSemiring product = math::one <AutomatonSemiring>();
+        for (char symbol : word)
+            product = product * AutomatonSemiring (
+                descriptor, Cost (float (symbol - 'a')), symbol);
+        sum = sum + product;
+    }
+    return sum;
+}
+
+// Build the same automata from multiple threads at the same time.
+BOOST_AUTO_TEST_CASE (concurrent) {
+    Descriptor descriptor (std::make_shared <
+        flipsta::SharedAutomatonMemo <char, Cost>> (true));
+    BOOST_CHECK (descriptor.memo()->concurrent());
+
+    std::vector <std::string> words = {
+        "abc", "abd", "bcd", "abcd", "bd", "cab", "dabc", "ab", "dcb"};
+
+    std::size_t const threadNum = 8;
+    std::vector <AutomatonSemiring> results (threadNum);
+    {
+        std::vector <std::thread> threads;
+        for (std::size_t thread = 0; thread != threadNum; ++ thread) {
+            threads.emplace_back ([&, thread]() {
+                for (int round = 0; round != 50; ++ round) {
+                    // Build lattices from overlapping subsets of the words,
+                    // and let them go out of scope, so that states are
+                    // destructed while other threads use them.
+                    std::vector <std::string> subset (
+                        words.begin() + (round + thread) % 4, words.end());
+                    buildLattice (descriptor, subset);
+                }
+                results [thread] = buildLattice (descriptor, words);
+            });
+        }
+        for (std::thread & thread : threads)
+            thread.join();
+    }
+
+    AutomatonSemiring expected = buildLattice (descriptor, words);
+    for (AutomatonSemiring const & result : results) {
+        // Equal states must be the same object.
+        BOOST_CHECK (result.automaton().state()
+            == expected.automaton().state());
+        BOOST_CHECK (result == expected);
+    }
+}
+
+// Shortest distance adds up all distances into a state in one go.
+BOOST_AUTO_TEST_CASE (shortestDistance) {
+    Descriptor descriptor;
+    auto label = [&descriptor] (char symbol) {
+        return AutomatonSemiring (
+            descriptor, Cost (float (symbol - 'a')), symbol);
+    };
+
+    typedef flipsta::Automaton <int, AutomatonSemiring> Automaton;
+    auto automaton = std::make_shared <Automaton> (descriptor);
+    for (int state = 1; state != 6; ++ state)
+        automaton->addState (state);
+    automaton->addArc (1, 2, label ('a'));
+    automaton->addArc (1, 3, label ('b'));
+    automaton->addArc (1, 4, label ('c'));
+    automaton->addArc (2, 4, label ('c'));
+    automaton->addArc (2, 5, label ('b'));
+    automaton->addArc (3, 5, label ('b'));
+    automaton->addArc (3, 5, label ('c'));
+    automaton->addArc (4, 5, label ('d'));
+
+    std::vector <std::string> words = {"ab", "acd", "bb", "bc", "cd"};
+    AutomatonSemiring expected = buildLattice (descriptor, words);
+
+    int stateNum = 0;
+    RANGE_FOR_EACH (stateDistance, flipsta::shortestDistanceAcyclicFrom (
+        automaton, 5, flipsta::backward))
+    {
+        ++ stateNum;
+        if (range::first (stateDistance) == 1) {
+            AutomatonSemiring distance = range::second (stateDistance);
+            BOOST_CHECK (distance == expected);
+            BOOST_CHECK (distance.automaton().state()
+                == expected.automaton().state());
+        }
+    }
+    BOOST_CHECK_EQUAL (stateNum, 5);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -26,6 +26,7 @@ BOOST_AUTO_TEST_SUITE(test_suite_error)
 BOOST_AUTO_TEST_CASE (testError) {
     BOOST_CHECK_THROW (throw flipsta::Error(), std::exception);
     BOOST_CHECK_THROW (throw flipsta::Error(), boost::exception);
+    BOOST_CHECK_THROW (throw flipsta::FormatError(), flipsta::Error);
 
     typedef int State;
     try {
@@ -94,6 +94,9 @@ BOOST_AUTO_TEST_CASE (test_flipsta_Map_withoutDefault) {
     checkMapWithoutDefault <flipsta::Map <int, std::string, false>>();
     checkMapWithoutDefault <
         flipsta::Map <flipsta::Dense <int>, std::string, false, false>>();
+
+    checkMapWithoutDefault <flipsta::Map <int, std::string, false, false,
+        flipsta::map_policy::FlatHash>>();
 }
 
 /* With default value. */
@@ -235,6 +238,14 @@ BOOST_AUTO_TEST_CASE (test_flipsta_Map_withDefault) {
     checkMapAlwaysContain <
         flipsta::Map <flipsta::Dense <int>, std::string, true, true>>();
 
+    checkMapWithDefault <flipsta::Map <int, std::string, true, false,
+        flipsta::map_policy::FlatHash>>();
+    checkMapAlwaysContain <flipsta::Map <int, std::string, true, true,
+        flipsta::map_policy::FlatHash>>();
+    // The vector is used whatever the policy.
+    checkMapAlwaysContain <flipsta::Map <flipsta::Dense <int>, std::string,
+        true, true, flipsta::map_policy::FlatHash>>();
+
     // Check that some operations do not involve actually addressing lots of
     // memory when using Dense.
     {
@@ -246,4 +257,72 @@ BOOST_AUTO_TEST_CASE (test_flipsta_Map_withDefault) {
     }
 }
 
+/* Packed values. */
+
+enum class Status { zero, one, two, three };
+
+template <class Map> void checkMapPacked() {
+    Map m (Status::one);
+    BOOST_CHECK (m [0] == Status::one);
+    BOOST_CHECK (m [100] == Status::one);
+
+    m.set (5, Status::three);
+    m.set (6, Status::zero);
+    m.set (100, Status::two);
+    BOOST_CHECK (m [4] == Status::one);
+    BOOST_CHECK (m [5] == Status::three);
+    BOOST_CHECK (m [6] == Status::zero);
+    BOOST_CHECK (m [7] == Status::one);
+    BOOST_CHECK (m [100] == Status::two);
+    BOOST_CHECK (m [1000] == Status::one);
+
+    m.set (5, Status::two);
+    BOOST_CHECK (m [5] == Status::two);
+    BOOST_CHECK (m [6] == Status::zero);
+
+    m.remove (6);
+    BOOST_CHECK (m [5] == Status::two);
+    BOOST_CHECK (m [6] == Status::one);
+
+    m.reserve (2000);
+    BOOST_CHECK (m [5] == Status::two);
+    BOOST_CHECK (m [1999] == Status::one);
+}
+
+BOOST_AUTO_TEST_CASE (test_flipsta_Map_packed) {
+    checkMapPacked <flipsta::Map <flipsta::Dense <int>, Status, true, true,
+        flipsta::map_policy::Packed <2>>>();
+    checkMapPacked <flipsta::Map <flipsta::Dense <int>, Status, true, true,
+        flipsta::map_policy::Packed <4>>>();
+    // Falls back to a hash map.
+    checkMapPacked <flipsta::Map <int, Status, true, true,
+        flipsta::map_policy::Packed <2>>>();
+}
+
+template <class State> void checkStateSet() {
+    flipsta::StateSet <State> set;
+    BOOST_CHECK (!set.contains (0));
+    BOOST_CHECK (!set.contains (100));
+    set.insert (3);
+    set.insert (100);
+    BOOST_CHECK (!set.contains (0));
+    BOOST_CHECK (set.contains (3));
+    BOOST_CHECK (!set.contains (4));
+    BOOST_CHECK (set.contains (100));
+    set.remove (3);
+    BOOST_CHECK (!set.contains (3));
+    BOOST_CHECK (set.contains (100));
+
+    flipsta::StateSet <State> reserved (200);
+    BOOST_CHECK (!reserved.contains (199));
+    reserved.insert (199);
+    BOOST_CHECK (reserved.contains (199));
+    BOOST_CHECK (!reserved.contains (198));
+}
+
+BOOST_AUTO_TEST_CASE (test_flipsta_StateSet) {
+    checkStateSet <int>();
+    checkStateSet <flipsta::Dense <unsigned>>();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
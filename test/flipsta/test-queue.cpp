@@ -48,4 +48,30 @@ BOOST_AUTO_TEST_CASE (test_flipstaLifoQueue) {
     BOOST_CHECK (queue.empty());
 }
 
+BOOST_AUTO_TEST_CASE (test_flipstaFifoQueue) {
+    using flipsta::FifoQueue;
+
+    FifoQueue <int> queue;
+    BOOST_CHECK (queue.empty());
+    BOOST_CHECK_EQUAL (queue.size(), 0u);
+    queue.push (1);
+    BOOST_CHECK_EQUAL (queue.head(), 1);
+
+    queue.push (17);
+    BOOST_CHECK_EQUAL (queue.size(), 2u);
+    BOOST_CHECK_EQUAL (queue.head(), 1);
+    // Mutate the head.
+    queue.head() = 2;
+    BOOST_CHECK_EQUAL (queue.head(), 2);
+    int e = queue.pop();
+    BOOST_CHECK_EQUAL (e, 2);
+    BOOST_CHECK (!queue.empty());
+    queue.push (-87);
+    e = queue.pop();
+    BOOST_CHECK_EQUAL (e, 17);
+    e = queue.pop();
+    BOOST_CHECK_EQUAL (e, -87);
+    BOOST_CHECK (queue.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
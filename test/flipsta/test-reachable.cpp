@@ -0,0 +1,132 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_reachable
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/reachable.hpp"
+
+#include <memory>
+
+#include "flipsta/automaton.hpp"
+#include "flipsta/traverse_breadth_first.hpp"
+
+using flipsta::forward;
+using flipsta::backward;
+
+BOOST_AUTO_TEST_SUITE(test_suite_reachable)
+
+typedef flipsta::Dense <int> State;
+typedef flipsta::Automaton <State, float> Automaton;
+
+/**
+Check that reachableStates gives the same states as traverseBreadthFirst.
+*/
+template <class Direction> void compareWithTraverse (
+    std::shared_ptr <Automaton> const & automaton, Direction direction,
+    int stateNum)
+{
+    flipsta::StateSet <State> reference (stateNum);
+    RANGE_FOR_EACH (report,
+        flipsta::traverseBreadthFirst (automaton, direction))
+    {
+        if (report.event == flipsta::TraversalEvent::visit)
+            reference.insert (report.state);
+    }
+
+    for (std::size_t threadNum : {1, 2, 4, 0}) {
+        auto reachable = flipsta::reachableStates (
+            automaton, direction, stateNum, threadNum);
+        for (int state = 0; state != stateNum; ++ state)
+            BOOST_CHECK_EQUAL (reachable.contains (state),
+                reference.contains (state));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testReachableLarge) {
+    // Pseudo-random automaton, big enough for the frontiers to be split up
+    // between threads.
+    int const stateNum = 5000;
+    auto automaton = std::make_shared <Automaton>();
+    for (int state = 0; state != stateNum; ++ state)
+        automaton->addState (state);
+
+    unsigned random = 1;
+    auto next = [&random] (int limit) -> int {
+        random = random * 1103515245u + 12345u;
+        return int ((random >> 8) % unsigned (limit));
+    };
+    for (int arc = 0; arc != 3 * stateNum; ++ arc) {
+        // The last 100 states are not reachable forward.
+        int source = next (stateNum);
+        int destination = next (stateNum - 100);
+        automaton->addArc (source, destination, 1.f);
+    }
+    automaton->setTerminalLabel (forward, 0, 0.f);
+    automaton->setTerminalLabel (forward, 17, 0.f);
+    automaton->setTerminalLabel (backward, 3, 0.f);
+
+    compareWithTraverse (automaton, forward, stateNum);
+    compareWithTraverse (automaton, backward, stateNum);
+}
+
+BOOST_AUTO_TEST_CASE (testConnected) {
+    /*
+    0 -> 1 -> 2 -> 3, and 1 -> 4 (dead end), and 5 -> 2 (unreachable).
+    6 is on its own.
+    */
+    int const stateNum = 7;
+    auto automaton = std::make_shared <Automaton>();
+    for (int state = 0; state != stateNum; ++ state)
+        automaton->addState (state);
+    automaton->addArc (0, 1, 1.f);
+    automaton->addArc (1, 2, 1.f);
+    automaton->addArc (2, 3, 1.f);
+    automaton->addArc (1, 4, 1.f);
+    automaton->addArc (5, 2, 1.f);
+    automaton->setTerminalLabel (forward, 0, 0.f);
+    automaton->setTerminalLabel (backward, 3, 0.f);
+
+    auto reachable = flipsta::reachableStates (automaton, forward, stateNum);
+    BOOST_CHECK (reachable.contains (0));
+    BOOST_CHECK (reachable.contains (1));
+    BOOST_CHECK (reachable.contains (2));
+    BOOST_CHECK (reachable.contains (3));
+    BOOST_CHECK (reachable.contains (4));
+    BOOST_CHECK (!reachable.contains (5));
+    BOOST_CHECK (!reachable.contains (6));
+
+    auto coReachable = flipsta::reachableStates (
+        automaton, backward, stateNum, 2);
+    BOOST_CHECK (coReachable.contains (0));
+    BOOST_CHECK (coReachable.contains (1));
+    BOOST_CHECK (coReachable.contains (2));
+    BOOST_CHECK (coReachable.contains (3));
+    BOOST_CHECK (!coReachable.contains (4));
+    BOOST_CHECK (coReachable.contains (5));
+    BOOST_CHECK (!coReachable.contains (6));
+
+    auto connected = flipsta::connectedStates (automaton, stateNum, 3);
+    BOOST_CHECK (connected.contains (0));
+    BOOST_CHECK (connected.contains (1));
+    BOOST_CHECK (connected.contains (2));
+    BOOST_CHECK (connected.contains (3));
+    BOOST_CHECK (!connected.contains (4));
+    BOOST_CHECK (!connected.contains (5));
+    BOOST_CHECK (!connected.contains (6));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
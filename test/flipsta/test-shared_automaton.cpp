@@ -20,9 +20,13 @@ limitations under the License.
 #include "flipsta/shared_automaton.hpp"
 
 #include <iostream>
+#include <map>
+#include <vector>
 
 #include "math/cost.hpp"
 
+#include "shared_automaton_helpers.hpp"
+
 BOOST_AUTO_TEST_SUITE(test_suite_flipsta_shared_automaton)
 
 typedef char Key;
@@ -49,7 +53,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (nullAutomaton, PrintValues());
     result.push_back (nullAutomaton);
 
-    std::shared_ptr <State const> final = State::finalState();
+    State::Pointer final = State::finalState();
 
     Automaton finalAutomaton (math::one <Weight>(), final);
     // flipsta::enumerate (finalAutomaton, PrintValues());
@@ -60,7 +64,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     result.push_back (finalAutomaton2);
 
 
-    std::shared_ptr <State const> state1;
+    State::Pointer state1;
     {
         Automaton arc (Weight (0), final);
         std::map <Key, Automaton> arcs;
@@ -73,7 +77,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (automaton1, PrintValues());
     result.push_back (automaton1);
 
-    std::shared_ptr <State const> state2;
+    State::Pointer state2;
     {
         std::map <Key, Automaton> arcs;
         arcs.insert (std::make_pair ('b', Automaton (Weight (0), final)));
@@ -86,7 +90,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (automaton2, PrintValues());
     result.push_back (automaton2);
 
-    std::shared_ptr <State const> state3;
+    State::Pointer state3;
     {
         std::map <Key, Automaton> arcs;
         arcs.insert (std::make_pair ('z', Automaton (Weight (0), final)));
@@ -98,7 +102,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (automaton3, PrintValues());
     result.push_back (automaton3);
 
-    std::shared_ptr <State const> state4;
+    State::Pointer state4;
     {
         std::map <Key, Automaton> arcs;
         arcs.insert (std::make_pair ('d', Automaton (Weight (.125), state2)));
@@ -112,7 +116,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (automaton4, PrintValues());
     result.push_back (automaton4);
 
-    std::shared_ptr <State const> state5;
+    State::Pointer state5;
     {
         std::map <Key, Automaton> arcs;
         arcs.insert (std::make_pair ('c', Automaton (Weight (0), state4)));
@@ -124,7 +128,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (automaton5, PrintValues());
     result.push_back (automaton5);
 
-    std::shared_ptr <State const> state6;
+    State::Pointer state6;
     {
         std::map <Key, Automaton> arcs;
         arcs.insert (std::make_pair ('c', Automaton (Weight (1), state4)));
@@ -136,7 +140,7 @@ std::vector <Automaton> exampleAutomata (Memo & memo) {
     // flipsta::enumerate (automaton6, PrintValues());
     result.push_back (automaton6);
 
-    std::shared_ptr <State const> state7;
+    State::Pointer state7;
     {
         std::map <Key, Automaton> arcs;
         arcs.insert (std::make_pair ('b', Automaton (Weight (0), state4)));
@@ -254,7 +258,7 @@ void test_SharedAutomaton (Memo & memo) {
             exampleAutomaton, sumWeights.weights()));
     }
 
-    std::shared_ptr <State const> final = State::finalState();
+    State::Pointer final = State::finalState();
     Automaton finalAutomaton (math::one <Weight>(), final);
     Mapping finalMapping;
     finalMapping.insert (std::make_pair (
@@ -278,6 +282,312 @@ BOOST_AUTO_TEST_CASE (test_flipsta_SharedAutomaton) {
     }
 }
 
+BOOST_AUTO_TEST_CASE (test_flipsta_SharedAutomaton_bounded) {
+    {
+        Memo memo;
+        BOOST_CHECK_EQUAL (memo.unionCapacity(), 0u);
+        test_SharedAutomaton (memo);
+        BOOST_CHECK (memo.missNum() > 0);
+        BOOST_CHECK (memo.hitNum() > 0);
+        BOOST_CHECK_EQUAL (memo.evictionNum(), 0u);
+    }
+    {
+        Memo memo (false, 3);
+        BOOST_CHECK_EQUAL (memo.unionCapacity(), 3u);
+        test_SharedAutomaton (memo);
+        BOOST_CHECK (memo.unionNum() <= 3);
+        BOOST_CHECK (memo.evictionNum() > 0);
+
+        // Results that have been evicted are recomputed, and yield the same
+        // states.
+        auto automata = exampleAutomata (memo);
+        auto a1 = automata [automata.size() - 2];
+        auto a2 = automata [automata.size() - 1];
+        auto result = flipsta::union_ (a1, a2);
+        for (std::size_t i = 0; i + 1 < automata.size(); ++ i)
+            flipsta::union_ (automata [i], automata [i + 1]);
+        BOOST_CHECK (flipsta::union_ (a1, a2).state() == result.state());
+        BOOST_CHECK (memo.unionNum() <= 3);
+    }
+    {
+        // With shards, the capacity is rounded up.
+        Memo memo (true, 100);
+        BOOST_CHECK (memo.unionCapacity() >= 100);
+        test_SharedAutomaton (memo);
+        BOOST_CHECK (memo.unionNum() <= memo.unionCapacity());
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_equality) {
+    Memo memo;
+    {
+        Automaton null1 (math::zero <Weight>(), nullptr);
+        Automaton null2 (math::zero <Weight>(), nullptr);
+        BOOST_CHECK (null1 == null2);
+        BOOST_CHECK (!(null1 != null2));
+        BOOST_CHECK_EQUAL (hash_value (null1), hash_value (null2));
+
+        auto automata = exampleAutomata (memo);
+        for (std::size_t i = 0; i != automata.size(); ++ i) {
+            for (std::size_t j = 0; j != automata.size(); ++ j) {
+                BOOST_CHECK_EQUAL (automata [i] == automata [j], i == j);
+                if (i != j) {
+                    BOOST_CHECK (
+                        hash_value (automata [i]) != hash_value (automata [j]));
+                }
+            }
+        }
+
+        // Computing the same union twice gives an equal automaton.
+        Automaton u1 = flipsta::union_ (automata [3], automata [4]);
+        Automaton u2 = flipsta::union_ (automata [4], automata [3]);
+        BOOST_CHECK (u1 == u2);
+        BOOST_CHECK_EQUAL (hash_value (u1), hash_value (u2));
+
+        // A state that is not in the store compares equal to the one that is,
+        // since the destinations of its arcs are.
+        State const & state = *u1.state();
+        State copy (&memo, state.finalWeight(), state.arcs());
+        BOOST_CHECK (copy == state);
+        BOOST_CHECK_EQUAL (hash_value (copy), hash_value (state));
+        BOOST_CHECK (memo.get (copy) == u1.state());
+
+        BOOST_CHECK (!(*automata [3].state() == *automata [4].state()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_arcs_sorted) {
+    Memo memo;
+    {
+        auto automata = exampleAutomata (memo);
+        Automaton u = flipsta::union_ (
+            automata [automata.size() - 2], automata [automata.size() - 1]);
+
+        auto const & arcs = u.state()->arcs();
+        BOOST_CHECK (!arcs.empty());
+        for (std::size_t i = 1; i < arcs.size(); ++ i)
+            BOOST_CHECK (arcs [i - 1].first < arcs [i].first);
+
+        RANGE_FOR_EACH (arc, arcs) {
+            Automaton const * found = u.state()->findArc (arc.first);
+            BOOST_CHECK (found == &arc.second);
+        }
+        BOOST_CHECK (u.state()->findArc ('z') == nullptr);
+        BOOST_CHECK (State::finalState()->findArc ('a') == nullptr);
+    }
+}
+
+// Concatenation should take time linear in the number of states, not paths.
+BOOST_AUTO_TEST_CASE (test_concatenate_shared) {
+    Memo memo;
+    {
+        // There are 2^50 paths.
+        int const length = 50;
+        Automaton shared = diamond (memo, length);
+        BOOST_CHECK_EQUAL (countStates (shared), std::size_t (length + 1));
+
+        std::map <Key, Automaton> arcs;
+        arcs.insert (std::make_pair ('c',
+            Automaton (math::one <Weight>(), State::finalState())));
+        Automaton c (Weight (2),
+            memo.get (State (&memo, math::zero <Weight>(), arcs)));
+
+        Automaton concatenated = flipsta::concatenate (shared, c);
+        BOOST_CHECK_EQUAL (
+            countStates (concatenated), std::size_t (length + 2));
+        BOOST_CHECK_EQUAL (
+            concatenated.startWeight(), shared.startWeight() * Weight (2));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_unionAll) {
+    Memo memo;
+    {
+        auto automata = exampleAutomata (memo);
+
+        BOOST_CHECK (flipsta::unionAll (std::vector <Automaton>()).isNull());
+
+        // Compare with union_ on pairs, for all prefixes and suffixes.
+        for (std::size_t begin = 0; begin != automata.size(); ++ begin) {
+            for (std::size_t end = begin + 1; end <= automata.size(); ++ end)
+            {
+                std::vector <Automaton> range (
+                    automata.begin() + begin, automata.begin() + end);
+                Automaton reference (math::zero <Weight>(), nullptr);
+                RANGE_FOR_EACH (automaton, range)
+                    reference = flipsta::union_ (reference, automaton);
+
+                Automaton result = flipsta::unionAll (range);
+                BOOST_CHECK_EQUAL (result.isNull(), reference.isNull());
+                if (!reference.isNull()) {
+                    BOOST_CHECK_EQUAL (
+                        result.startWeight(), reference.startWeight());
+                    BOOST_CHECK (result.state() == reference.state());
+                }
+
+                SumWeights resultWeights;
+                flipsta::enumerate (result, resultWeights);
+                SumWeights referenceWeights;
+                flipsta::enumerate (reference, referenceWeights);
+                BOOST_CHECK (
+                    resultWeights.weights() == referenceWeights.weights());
+            }
+        }
+
+        // Automata that occur more than once.
+        std::vector <Automaton> repeated;
+        RANGE_FOR_EACH (automaton, automata) {
+            repeated.push_back (automaton);
+            repeated.push_back (automaton);
+        }
+        Automaton reference (math::zero <Weight>(), nullptr);
+        RANGE_FOR_EACH (automaton, repeated)
+            reference = flipsta::union_ (reference, automaton);
+        Automaton result = flipsta::unionAll (std::move (repeated));
+        BOOST_CHECK_EQUAL (result.startWeight(), reference.startWeight());
+        BOOST_CHECK (result.state() == reference.state());
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_bestPaths) {
+    Memo memo;
+    {
+        auto automata = exampleAutomata (memo);
+        automata.push_back (flipsta::unionAll (automata));
+        RANGE_FOR_EACH (automaton, automata) {
+            SumWeights reference;
+            flipsta::enumerate (automaton, reference);
+
+            std::vector <std::pair <std::vector <Key>, Weight>> paths;
+            RANGE_FOR_EACH (path, flipsta::bestPaths (automaton))
+                paths.push_back (path);
+
+            // The same paths, in order of weight.
+            BOOST_CHECK_EQUAL (paths.size(), reference.weights().size());
+            Mapping mapping (paths.begin(), paths.end());
+            BOOST_CHECK (mapping == reference.weights());
+            for (std::size_t i = 1; i < paths.size(); ++ i) {
+                BOOST_CHECK (paths [i - 1].second + paths [i].second
+                    == paths [i - 1].second);
+            }
+
+            // At most two.
+            std::vector <std::pair <std::vector <Key>, Weight>> best;
+            RANGE_FOR_EACH (path, flipsta::bestPaths (automaton, 2))
+                best.push_back (path);
+            BOOST_CHECK_EQUAL (best.size(), std::min <std::size_t> (
+                2, paths.size()));
+            for (std::size_t i = 0; i != best.size(); ++ i)
+                BOOST_CHECK_EQUAL (best [i].second, paths [i].second);
+
+            // Only paths at least as good as the second one.
+            if (paths.size() >= 2) {
+                Weight threshold = paths [1].second;
+                std::size_t count = 0;
+                RANGE_FOR_EACH (path, flipsta::bestPaths (automaton,
+                    std::numeric_limits <std::size_t>::max(), threshold))
+                {
+                    BOOST_CHECK (path.second + threshold == path.second);
+                    ++ count;
+                }
+                BOOST_CHECK (count >= 2);
+                BOOST_CHECK (count <= paths.size());
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_statistics) {
+    // The Jamfile defines FLIPSTA_SHARED_AUTOMATON_STATISTICS for all tests.
+    BOOST_REQUIRE (flipsta::detail::statisticsEnabled);
+
+    Memo memo;
+    {
+        flipsta::SharedAutomatonStatistics statistics = memo.statistics();
+        BOOST_CHECK_EQUAL (statistics.stateNum, 1u);
+        BOOST_CHECK_EQUAL (statistics.statesCreated, 1u);
+        BOOST_CHECK_EQUAL (statistics.unionCalls, 0u);
+    }
+    {
+        auto automata = exampleAutomata (memo);
+        RANGE_FOR_EACH (left, automata) {
+            RANGE_FOR_EACH (right, automata) {
+                flipsta::union_ (left, right);
+                flipsta::concatenate (left, right);
+            }
+        }
+        flipsta::unionAll (automata);
+
+        flipsta::SharedAutomatonStatistics statistics = memo.statistics();
+        BOOST_CHECK (statistics.unionCalls > 0);
+        BOOST_CHECK_EQUAL (statistics.unionCalls,
+            statistics.unionHits + statistics.unionMisses);
+        BOOST_CHECK_EQUAL (statistics.unionHits, memo.hitNum());
+        BOOST_CHECK_EQUAL (statistics.unionMisses, memo.missNum());
+        BOOST_CHECK (statistics.unionAllCalls >= 1);
+        BOOST_CHECK_EQUAL (statistics.unionNum, memo.unionNum());
+
+        BOOST_CHECK (statistics.concatenateCalls > 0);
+        BOOST_CHECK (statistics.concatenateStates
+            >= statistics.concatenateCalls);
+        BOOST_CHECK (statistics.concatenateLeftEmpty > 0);
+        BOOST_CHECK (statistics.concatenateStates
+            >= statistics.concatenateLeftEmpty
+                + statistics.concatenateRightEmpty);
+
+        BOOST_CHECK_EQUAL (statistics.stateNum,
+            statistics.statesCreated - statistics.statesDestructed);
+        BOOST_CHECK (statistics.peakStateNum >= statistics.stateNum);
+        // The final state is not in the slabs.
+        BOOST_CHECK (statistics.stateMemory
+            >= (statistics.peakStateNum - 1) * sizeof (State));
+
+        std::stringstream stream;
+        stream << statistics;
+        BOOST_CHECK (!stream.str().empty());
+    }
+    // Only the final state is left.
+    flipsta::SharedAutomatonStatistics statistics = memo.statistics();
+    BOOST_CHECK_EQUAL (statistics.stateNum, 1u);
+    BOOST_CHECK (statistics.statesDestructed > 0);
+}
+
+// Build an automaton that accepts only the sequence of "length" times "key".
+Automaton makeChain (Memo & memo, Key key, std::size_t length) {
+    Automaton result (math::one <Weight>(), State::finalState());
+    for (std::size_t index = 0; index != length; ++ index) {
+        State::Arcs arcs;
+        arcs.emplace_back (key, std::move (result));
+        result = Automaton (math::one <Weight>(),
+            memo.get (State (&memo, math::zero <Weight>(), std::move (arcs))));
+    }
+    return result;
+}
+
+// Releasing a long automaton must not destruct its states recursively, which
+// would overflow the stack.
+void testReleaseLong (bool concurrent) {
+    std::size_t const length = 200000;
+    Memo memo (concurrent);
+    {
+        Automaton a = makeChain (memo, 'a', length);
+        Automaton b = makeChain (memo, 'b', length);
+        BOOST_CHECK_EQUAL (memo.size(), 2 * length + 1);
+
+        // Make the memo refer to the first states.
+        Automaton both = flipsta::union_ (a, b);
+        BOOST_CHECK_EQUAL (both.state()->arcs().size(), 2u);
+        BOOST_CHECK (memo.unionNum() > 0);
+    }
+    BOOST_CHECK_EQUAL (memo.size(), 1u);
+    BOOST_CHECK_EQUAL (memo.unionNum(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE (test_release_long) {
+    testReleaseLong (false);
+    testReleaseLong (true);
+}
+
 BOOST_AUTO_TEST_CASE (test_writeAttAutomaton) {
     Memo memo;
     {
@@ -0,0 +1,138 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_shared_automaton_binary
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/shared_automaton_binary.hpp"
+
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "math/cost.hpp"
+
+#include "shared_automaton_helpers.hpp"
+
+BOOST_AUTO_TEST_SUITE(test_suite_flipsta_shared_automaton_binary)
+
+typedef char Key;
+typedef math::cost <float> Weight;
+
+typedef flipsta::SharedState <Key, Weight> State;
+typedef flipsta::SharedAutomaton <Key, Weight> Automaton;
+typedef flipsta::SharedAutomatonMemo <Key, Weight> Memo;
+
+typedef std::map <std::vector <Key>, Weight> Mapping;
+
+Mapping paths (Automaton const & automaton) {
+    Mapping result;
+    flipsta::enumerate (automaton,
+        [&result] (std::vector <Key> const & keys, Weight const & weight)
+        { result.insert (std::make_pair (keys, weight)); });
+    return result;
+}
+
+std::string write (Automaton const & automaton) {
+    std::ostringstream stream;
+    flipsta::writeBinaryAutomaton (stream, automaton);
+    return stream.str();
+}
+
+Automaton read (std::string const & data, Memo & memo) {
+    std::istringstream stream (data);
+    return flipsta::readBinaryAutomaton (stream, memo);
+}
+
+BOOST_AUTO_TEST_CASE (test_round_trip) {
+    Memo memo;
+    {
+        Automaton nullAutomaton (math::zero <Weight>(), nullptr);
+        BOOST_CHECK (read (write (nullAutomaton), memo).isNull());
+
+        Automaton final (Weight (3), State::finalState());
+        Automaton finalAgain = read (write (final), memo);
+        BOOST_CHECK_EQUAL (finalAgain.startWeight(), Weight (3));
+        BOOST_CHECK (finalAgain.state() == State::finalState());
+
+        Automaton automaton = diamond (memo, 10);
+        std::string data = write (automaton);
+
+        // In the same memo, the states are the same objects.
+        Automaton again = read (data, memo);
+        BOOST_CHECK_EQUAL (again.startWeight(), automaton.startWeight());
+        BOOST_CHECK (again.state() == automaton.state());
+
+        // In a different memo, sharing is restored.
+        Memo otherMemo;
+        {
+            Automaton other = read (data, otherMemo);
+            BOOST_CHECK (other.state() != automaton.state());
+            BOOST_CHECK_EQUAL (countStates (other), countStates (automaton));
+            BOOST_CHECK (paths (other) == paths (automaton));
+            BOOST_CHECK (read (data, otherMemo).state() == other.state());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (test_format_error) {
+    Memo memo;
+    {
+        std::string data = write (diamond (memo, 5));
+
+        BOOST_CHECK_THROW (read ("", memo), flipsta::FormatError);
+        BOOST_CHECK_THROW (read ("FSAC", memo), flipsta::FormatError);
+
+        std::string wrongMagic = data;
+        wrongMagic [0] = 'X';
+        BOOST_CHECK_THROW (read (wrongMagic, memo), flipsta::FormatError);
+
+        // The start weight must be zero exactly when there is no start state.
+        {
+            std::size_t stateNum = 5;
+            auto withStart = [&] (Weight const & weight, std::size_t index) {
+                std::ostringstream stream;
+                stream << data.substr (
+                    0, data.size() - sizeof (float) - sizeof (std::uint64_t));
+                flipsta::BinaryFormat <Weight>::write (stream, weight);
+                flipsta::BinaryFormat <std::uint64_t>::write (stream, index);
+                return stream.str();
+            };
+            BOOST_CHECK (read (withStart (Weight (2), stateNum + 1), memo)
+                .startWeight() == Weight (2));
+            BOOST_CHECK (read (withStart (math::zero <Weight>(), 0), memo)
+                .isNull());
+            BOOST_CHECK_THROW (read (withStart (Weight (2), 0), memo),
+                flipsta::FormatError);
+            BOOST_CHECK_THROW (read (
+                withStart (math::zero <Weight>(), stateNum + 1), memo),
+                flipsta::FormatError);
+            BOOST_CHECK_THROW (
+                read (withStart (Weight (2), stateNum + 2), memo),
+                flipsta::FormatError);
+        }
+
+        // Truncated data.
+        for (std::size_t length = 0; length < data.size(); length += 7) {
+            BOOST_CHECK_THROW (read (data.substr (0, length), memo),
+                flipsta::FormatError);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
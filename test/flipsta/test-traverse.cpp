@@ -185,6 +185,79 @@ BOOST_AUTO_TEST_CASE (testTraverseSimple) {
     checkTraverseSimple <flipsta::Dense <int>>();
 }
 
+/**
+Check that traversing with the number of states given gives the same result as
+without.
+*/
+template <class State> void checkTraverseReserve() {
+    typedef flipsta::Automaton <State, float> Automaton;
+
+    auto automaton = std::make_shared <Automaton>();
+
+    for (int state = 0; state != 10; ++ state)
+        automaton->addState (state);
+    for (int state = 0; state != 9; ++ state) {
+        automaton->addArc (state, state + 1, 1);
+        automaton->addArc (state + 1, state / 2, 1);
+    }
+
+    auto reserved = flipsta::traverse (automaton, forward, 10);
+    auto notReserved = flipsta::traverse (automaton, forward);
+    while (!empty (notReserved)) {
+        BOOST_CHECK (!empty (reserved));
+        if (empty (reserved))
+            break;
+        auto report = chop_in_place (reserved);
+        auto reference = chop_in_place (notReserved);
+        BOOST_CHECK_EQUAL (report.state, reference.state);
+        BOOST_CHECK (report.event == reference.event);
+    }
+    BOOST_CHECK (empty (reserved));
+}
+
+BOOST_AUTO_TEST_CASE (testTraverseReserve) {
+    checkTraverseReserve <int>();
+    checkTraverseReserve <flipsta::Dense <int>>();
+}
+
+/**
+Check that traversal with containers borrowed from a workspace gives the same
+result as without, also when the containers are reused.
+*/
+template <class State> void checkTraverseWorkspace() {
+    typedef flipsta::Automaton <State, float> Automaton;
+
+    auto automaton = std::make_shared <Automaton>();
+
+    for (int state = 0; state != 10; ++ state)
+        automaton->addState (state);
+    for (int state = 0; state != 9; ++ state) {
+        automaton->addArc (state, state + 1, 1);
+        automaton->addArc (state + 1, state / 2, 1);
+    }
+
+    flipsta::Workspace workspace;
+    for (int repetition = 0; repetition != 3; ++ repetition) {
+        auto borrowing = flipsta::traverse (automaton, forward, workspace);
+        auto notBorrowing = flipsta::traverse (automaton, forward);
+        while (!empty (notBorrowing)) {
+            BOOST_CHECK (!empty (borrowing));
+            if (empty (borrowing))
+                break;
+            auto report = chop_in_place (borrowing);
+            auto reference = chop_in_place (notBorrowing);
+            BOOST_CHECK_EQUAL (report.state, reference.state);
+            BOOST_CHECK (report.event == reference.event);
+        }
+        BOOST_CHECK (empty (borrowing));
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testTraverseWorkspace) {
+    checkTraverseWorkspace <int>();
+    checkTraverseWorkspace <flipsta::Dense <int>>();
+}
+
 // Check that moving the result of traverse() is a cheap operation.
 BOOST_AUTO_TEST_CASE (testTraverseMove) {
     typedef TrackedState State;
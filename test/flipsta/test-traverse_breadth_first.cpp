@@ -0,0 +1,216 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/** \file
+This checks flipsta::traverseBreadthFirst and flipsta::isReachable.
+As in test-traverse.cpp, the reference orders depend on the order of the arcs,
+and have been checked manually.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_traverse_breadth_first
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/traverse_breadth_first.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "flipsta/automaton.hpp"
+
+using range::first;
+using range::empty;
+using range::chop;
+using range::chop_in_place;
+
+using flipsta::forward;
+using flipsta::backward;
+
+BOOST_AUTO_TEST_SUITE(test_suite_traverse_breadth_first)
+
+template <class State, class Range, class Reference>
+    void compare (Range && traversedStates, Reference const & reference_)
+{
+    static_assert (std::is_constructible <typename std::decay <Range>::type,
+        typename std::decay <Range>::type &&>::value,
+        "The range must be moveable.");
+    static_assert (!std::is_constructible <typename std::decay <Range>::type,
+        typename std::decay <Range>::type const &>::value,
+        "The range is not copyable.");
+
+    typedef flipsta::TraversedState <State> Report;
+
+    unsigned count = 0;
+    auto reference = range::view (reference_);
+    while (!empty (traversedStates)) {
+        // Interleave both "chop_in_place" and "chop".
+        if (count & 0x1) {
+            Report report = chop_in_place (traversedStates);
+            BOOST_CHECK_EQUAL (report.state, first (reference).state);
+            BOOST_CHECK (report.event == first (reference).event);
+        } else {
+            auto chopped = chop (std::move (traversedStates));
+            Report report = chopped.move_first();
+            traversedStates = chopped.move_rest();
+            BOOST_CHECK_EQUAL (report.state, first (reference).state);
+            BOOST_CHECK (report.event == first (reference).event);
+        }
+        BOOST_CHECK (!empty (reference));
+        if (empty (reference))
+            break;
+        reference = range::drop (reference);
+        ++ count;
+    }
+    BOOST_CHECK (empty (reference));
+}
+
+template <class State> void checkTraverseBreadthFirst() {
+    typedef flipsta::Automaton <State, float> Automaton;
+
+    auto automaton = std::make_shared <Automaton>();
+
+    automaton->addState (1);
+    automaton->addState (2);
+    automaton->addState (3);
+    // Not reachable from 1.
+    automaton->addState (4);
+
+    automaton->addArc (1, 1, .5);
+    automaton->addArc (1, 2, 4);
+    automaton->addArc (1, 3, 2);
+    automaton->addArc (2, 1, -5);
+    automaton->addArc (3, 2, 10.5);
+    automaton->addArc (4, 3, 1);
+
+    automaton->setTerminalLabel (forward, 1, 0.f);
+    automaton->setTerminalLabel (backward, 1, 0.f);
+
+    typedef flipsta::TraversedState <State> Report;
+    typedef flipsta::TraversalEvent Event;
+
+    // Forward.
+    {
+        std::vector <Report> reference;
+        reference.push_back (Report (1, Event::newRoot));
+        reference.push_back (Report (1, Event::visit));
+        reference.push_back (Report (1, Event::forwardOrCrossState));
+        reference.push_back (Report (1, Event::finishVisit));
+        reference.push_back (Report (3, Event::visit));
+        reference.push_back (Report (2, Event::forwardOrCrossState));
+        reference.push_back (Report (3, Event::finishVisit));
+        reference.push_back (Report (2, Event::visit));
+        reference.push_back (Report (1, Event::forwardOrCrossState));
+        reference.push_back (Report (2, Event::finishVisit));
+
+        compare <State> (flipsta::traverseBreadthFirst (automaton, forward),
+            reference);
+    }
+    // Backward.
+    {
+        std::vector <Report> reference;
+        reference.push_back (Report (1, Event::newRoot));
+        reference.push_back (Report (1, Event::visit));
+        reference.push_back (Report (1, Event::forwardOrCrossState));
+        reference.push_back (Report (1, Event::finishVisit));
+        reference.push_back (Report (2, Event::visit));
+        reference.push_back (Report (1, Event::forwardOrCrossState));
+        reference.push_back (Report (2, Event::finishVisit));
+        reference.push_back (Report (3, Event::visit));
+        reference.push_back (Report (1, Event::forwardOrCrossState));
+        reference.push_back (Report (3, Event::finishVisit));
+        reference.push_back (Report (4, Event::visit));
+        reference.push_back (Report (4, Event::finishVisit));
+
+        compare <State> (flipsta::traverseBreadthFirst (automaton, backward),
+            reference);
+    }
+    // Forward, from explicit start states, which are reported first.
+    {
+        std::vector <State> startStates;
+        startStates.push_back (4);
+        startStates.push_back (2);
+        startStates.push_back (4);
+
+        std::vector <Report> reference;
+        reference.push_back (Report (4, Event::newRoot));
+        reference.push_back (Report (2, Event::newRoot));
+        reference.push_back (Report (4, Event::visit));
+        reference.push_back (Report (4, Event::finishVisit));
+        reference.push_back (Report (2, Event::visit));
+        reference.push_back (Report (2, Event::finishVisit));
+        reference.push_back (Report (3, Event::visit));
+        reference.push_back (Report (2, Event::forwardOrCrossState));
+        reference.push_back (Report (3, Event::finishVisit));
+        reference.push_back (Report (1, Event::visit));
+        reference.push_back (Report (3, Event::forwardOrCrossState));
+        reference.push_back (Report (2, Event::forwardOrCrossState));
+        reference.push_back (Report (1, Event::forwardOrCrossState));
+        reference.push_back (Report (1, Event::finishVisit));
+
+        compare <State> (flipsta::traverseBreadthFirst (
+            automaton, forward, startStates), reference);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testTraverseBreadthFirst) {
+    checkTraverseBreadthFirst <int>();
+    checkTraverseBreadthFirst <flipsta::Dense <int>>();
+}
+
+template <class State> void checkIsReachable() {
+    typedef flipsta::Automaton <State, float> Automaton;
+
+    auto automaton = std::make_shared <Automaton>();
+
+    // A chain 0 -> 1 -> ... -> 9, with an extra arc 5 -> 2,
+    // and a separate chain 10 -> 11.
+    for (int state = 0; state != 12; ++ state)
+        automaton->addState (state);
+    for (int state = 0; state != 9; ++ state)
+        automaton->addArc (state, state + 1, 1);
+    automaton->addArc (5, 2, 1);
+    automaton->addArc (10, 11, 1);
+
+    auto states = [] (std::initializer_list <int> list) {
+        std::vector <State> result;
+        for (int state : list)
+            result.push_back (State (state));
+        return result;
+    };
+
+    BOOST_CHECK (flipsta::isReachable (automaton, states ({0}), states ({9})));
+    BOOST_CHECK (flipsta::isReachable (automaton, states ({5}), states ({3})));
+    BOOST_CHECK (flipsta::isReachable (automaton, states ({4}), states ({4})));
+    BOOST_CHECK (flipsta::isReachable (
+        automaton, states ({10, 7}), states ({11})));
+    BOOST_CHECK (flipsta::isReachable (
+        automaton, states ({10}), states ({0, 1, 11})));
+
+    BOOST_CHECK (!flipsta::isReachable (
+        automaton, states ({9}), states ({0})));
+    BOOST_CHECK (!flipsta::isReachable (
+        automaton, states ({3}), states ({1})));
+    BOOST_CHECK (!flipsta::isReachable (
+        automaton, states ({0}), states ({10, 11})));
+    BOOST_CHECK (!flipsta::isReachable (automaton, states ({}), states ({0})));
+    BOOST_CHECK (!flipsta::isReachable (automaton, states ({0}), states ({})));
+}
+
+BOOST_AUTO_TEST_CASE (testIsReachable) {
+    checkIsReachable <int>();
+    checkIsReachable <flipsta::Dense <int>>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,170 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_workspace
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/workspace.hpp"
+
+#include <vector>
+
+#include "flipsta/map.hpp"
+#include "flipsta/queue.hpp"
+
+using flipsta::Workspace;
+using flipsta::Borrowed;
+
+BOOST_AUTO_TEST_SUITE(test_suite_workspace)
+
+BOOST_AUTO_TEST_CASE (testWorkspaceReuse) {
+    Workspace workspace;
+    int const * data;
+    {
+        auto vector = workspace.borrow <std::vector <int>>();
+        BOOST_CHECK (vector->empty());
+        vector->resize (1000, 5);
+        data = vector->data();
+    }
+    {
+        // The same vector should come back, cleared but with its memory.
+        auto vector = workspace.borrow <std::vector <int>>();
+        BOOST_CHECK (vector->empty());
+        BOOST_CHECK (vector->capacity() >= 1000);
+        BOOST_CHECK_EQUAL (vector->data(), data);
+
+        // With the first one borrowed, the next one must be new.
+        auto other = workspace.borrow <std::vector <int>> (std::size_t (3));
+        BOOST_CHECK_EQUAL (other->size(), 3u);
+        BOOST_CHECK (other->data() != data);
+
+        // A container of a different type.
+        auto doubles = workspace.borrow <std::vector <double>>();
+        BOOST_CHECK (doubles->empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testBorrowedMove) {
+    Workspace workspace;
+    int const * data;
+    {
+        auto vector = workspace.borrow <std::vector <int>>();
+        vector->push_back (7);
+        data = vector->data();
+
+        Borrowed <std::vector <int>> moved (std::move (vector));
+        BOOST_CHECK_EQUAL (moved->size(), 1u);
+        BOOST_CHECK_EQUAL ((*moved) [0], 7);
+    }
+    {
+        auto vector = workspace.borrow <std::vector <int>>();
+        BOOST_CHECK (vector->empty());
+        BOOST_CHECK_EQUAL (vector->data(), data);
+        auto second = workspace.borrow <std::vector <int>>();
+        BOOST_CHECK (second->data() != data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testWithoutWorkspace) {
+    auto vector = Workspace::borrowFrom <std::vector <int>> (
+        nullptr, std::size_t (4), 2);
+    BOOST_CHECK_EQUAL (vector->size(), 4u);
+    BOOST_CHECK_EQUAL ((*vector) [3], 2);
+}
+
+BOOST_AUTO_TEST_CASE (testClear) {
+    typedef flipsta::Dense <int> State;
+    Workspace workspace;
+    {
+        auto map = workspace.borrow <flipsta::Map <
+            int, float, true, false, flipsta::map_policy::FlatHash>> (1.5f);
+        map->set (3, 4.f);
+        BOOST_CHECK_EQUAL ((*map) [3], 4.f);
+
+        auto denseMap = workspace.borrow <flipsta::Map <
+            State, char, true, true>> ('a');
+        denseMap->set (State (2), 'c');
+
+        auto states = workspace.borrow <flipsta::StateSet <State>> (
+            std::size_t (10));
+        states->insert (State (5));
+
+        auto queue = workspace.borrow <flipsta::LifoQueue <int>>();
+        queue->push (4);
+    }
+    {
+        auto map = workspace.borrow <flipsta::Map <
+            int, float, true, false, flipsta::map_policy::FlatHash>> (0.f);
+        // The default value of the original map is kept.
+        BOOST_CHECK_EQUAL ((*map) [3], 1.5f);
+        BOOST_CHECK (!map->contains (3));
+
+        auto denseMap = workspace.borrow <flipsta::Map <
+            State, char, true, true>> ('b');
+        BOOST_CHECK_EQUAL ((*denseMap) [State (2)], 'a');
+
+        auto states = workspace.borrow <flipsta::StateSet <State>>();
+        BOOST_CHECK (!states->contains (State (5)));
+
+        auto queue = workspace.borrow <flipsta::LifoQueue <int>>();
+        BOOST_CHECK (queue->empty());
+    }
+}
+
+// After a map has been used for a large automaton, reusing it for a small one
+// must not be affected by the earlier values.
+BOOST_AUTO_TEST_CASE (testClearAfterLargeRun) {
+    typedef flipsta::Dense <int> State;
+    typedef flipsta::Map <State, int, true, true> DenseMap;
+    typedef flipsta::Map <State, unsigned, true, true,
+        flipsta::map_policy::Packed <2>> PackedMap;
+    int const largeStateNum = 100000;
+    Workspace workspace;
+    {
+        auto denseMap = workspace.borrow <DenseMap> (-1);
+        auto packedMap = workspace.borrow <PackedMap> (0u);
+        for (int state = 0; state != largeStateNum; ++ state) {
+            denseMap->set (State (state), state);
+            packedMap->set (State (state), unsigned (state % 3 + 1));
+        }
+    }
+    {
+        auto denseMap = workspace.borrow <DenseMap> (-1);
+        auto packedMap = workspace.borrow <PackedMap> (0u);
+        for (int state = 0; state != 5; ++ state) {
+            denseMap->set (State (state), 10 * state);
+            packedMap->set (State (state), 3u);
+        }
+        for (int state = 0; state != 5; ++ state) {
+            BOOST_CHECK_EQUAL ((*denseMap) [State (state)], 10 * state);
+            BOOST_CHECK_EQUAL ((*packedMap) [State (state)], 3u);
+        }
+        // The keys of the earlier run read back as the default.
+        for (int state = 5; state < largeStateNum; state += 997) {
+            BOOST_CHECK_EQUAL ((*denseMap) [State (state)], -1);
+            BOOST_CHECK_EQUAL ((*packedMap) [State (state)], 0u);
+        }
+        BOOST_CHECK_EQUAL ((*denseMap) [State (largeStateNum - 1)], -1);
+        BOOST_CHECK_EQUAL ((*packedMap) [State (largeStateNum - 1)], 0u);
+
+        // Removing a key from the earlier run leaves it at the default.
+        denseMap->remove (State (largeStateNum - 1));
+        packedMap->remove (State (largeStateNum - 1));
+        BOOST_CHECK_EQUAL ((*denseMap) [State (largeStateNum - 1)], -1);
+        BOOST_CHECK_EQUAL ((*packedMap) [State (largeStateNum - 1)], 0u);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,196 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_frozen_automaton
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/frozen_automaton.hpp"
+
+#include <memory>
+#include <type_traits>
+
+#include "range/walk_size.hpp"
+
+#include "math/cost.hpp"
+#include "math/product.hpp"
+#include "math/sequence.hpp"
+
+#include "flipsta/automaton.hpp"
+
+#include "example_automata.hpp"
+
+using range::first;
+using range::second;
+
+using flipsta::forward;
+using flipsta::backward;
+
+BOOST_AUTO_TEST_SUITE(test_suite_frozen_automaton)
+
+/**
+Check that \a frozen has the same arcs as \a original, in both directions.
+*/
+template <class Original, class Frozen, class Numbering>
+    void checkSameArcs (Original const & original, Frozen const & frozen,
+        Numbering const & numbering)
+{
+    std::size_t arcNum = 0;
+    RANGE_FOR_EACH (state, flipsta::states (frozen)) {
+        RANGE_FOR_EACH (arc, flipsta::arcsOn (frozen, forward, state)) {
+            ++ arcNum;
+            BOOST_CHECK (arc.state (backward) == state);
+
+            std::size_t found = 0;
+            RANGE_FOR_EACH (originalArc, flipsta::arcsOn (original, forward,
+                numbering.originalState (state)))
+            {
+                if (originalArc.state (forward)
+                    == numbering.originalState (arc.state (forward)))
+                {
+                    ++ found;
+                    BOOST_CHECK (originalArc.label() == arc.label());
+                }
+            }
+            BOOST_CHECK_EQUAL (found, 1u);
+        }
+
+        // The arcs backward should be the same ones.
+        RANGE_FOR_EACH (arc, flipsta::arcsOn (frozen, backward, state)) {
+            BOOST_CHECK (arc.state (forward) == state);
+            bool found = false;
+            RANGE_FOR_EACH (forwardArc,
+                flipsta::arcsOn (frozen, forward, arc.state (backward)))
+            {
+                if (forwardArc.state (forward) == state)
+                    found = true;
+            }
+            BOOST_CHECK (found);
+        }
+    }
+    BOOST_CHECK_EQUAL (arcNum, frozen.arcNum());
+}
+
+BOOST_AUTO_TEST_CASE (testFrozenAutomaton) {
+    typedef flipsta::Dense <std::uint32_t> State;
+
+    std::shared_ptr <flipsta::Automaton <char, math::cost <float>>> automaton
+        = acyclicExample();
+
+    auto numbering = flipsta::numberStates (automaton);
+    auto frozen = flipsta::freeze (automaton, numbering);
+
+    static_assert (std::is_same <
+        std::decay <decltype (*frozen)>::type::State, State>::value, "");
+
+    BOOST_CHECK_EQUAL (frozen->stateNum(), 6u);
+    BOOST_CHECK_EQUAL (frozen->arcNum(), 10u);
+    BOOST_CHECK_EQUAL (range::walk_size (flipsta::states (*frozen)), 6);
+    BOOST_CHECK (flipsta::hasState (*frozen, State (5)));
+    BOOST_CHECK (!flipsta::hasState (*frozen, State (6)));
+
+    checkSameArcs (*automaton, *frozen, numbering);
+
+    // The automaton is acyclic, so the numbering is topological.
+    for (std::size_t arc = 0; arc != frozen->arcNum(); ++ arc)
+        BOOST_CHECK (frozen->sources() [arc] < frozen->destinations() [arc]);
+
+    // Arc indices: state 0 ('d') has two arcs, with labels 5 and 3.
+    {
+        auto range = frozen->arcRange (forward, State (0));
+        BOOST_CHECK_EQUAL (range.second - range.first, 2u);
+        float total = 0;
+        for (auto arc = range.first; arc != range.second; ++ arc)
+            total += frozen->labels() [arc].value();
+        BOOST_CHECK_EQUAL (total, 8.f);
+
+        auto backwardRange = frozen->arcRange (backward, State (0));
+        BOOST_CHECK_EQUAL (backwardRange.second - backwardRange.first, 0u);
+    }
+
+    // Terminal labels.
+    {
+        auto initialStates = flipsta::terminalStates (*frozen, forward);
+        BOOST_CHECK_EQUAL (range::walk_size (initialStates), 1);
+        BOOST_CHECK (first (first (initialStates)) == State (0));
+        BOOST_CHECK_EQUAL (second (first (initialStates)).value(), 0);
+
+        auto finalStates = flipsta::terminalStates (*frozen, backward);
+        BOOST_CHECK_EQUAL (range::walk_size (finalStates), 1);
+        BOOST_CHECK (first (first (finalStates)) == State (5));
+        BOOST_CHECK_EQUAL (second (first (finalStates)).value(), 1);
+
+        BOOST_CHECK_EQUAL (flipsta::terminalLabel (
+            *frozen, backward, State (5)).value(), 1);
+        BOOST_CHECK (flipsta::terminalLabel (*frozen, backward, State (4))
+            == math::zero <math::cost <float>>());
+    }
+
+    // Without an explicit numbering.
+    {
+        auto frozen2 = flipsta::freeze (automaton);
+        BOOST_CHECK_EQUAL (frozen2->arcNum(), 10u);
+        BOOST_CHECK (frozen2->destinations() == frozen->destinations());
+    }
+}
+
+/**
+With product labels, as used for AT&T automata, the components are stored in
+separate arrays.
+*/
+BOOST_AUTO_TEST_CASE (testFrozenAutomatonProduct) {
+    typedef math::optional_sequence <char> Sequence;
+    typedef math::empty_sequence <char> Empty;
+    typedef math::cost <float> Weight;
+    typedef math::product <math::over <Sequence, Sequence, Weight>> Label;
+    typedef math::product <math::over <Empty, Empty, Weight>> TerminalLabel;
+
+    typedef flipsta::Automaton <int, Label, TerminalLabel> Automaton;
+    auto automaton = std::make_shared <Automaton>();
+    automaton->addState (1);
+    automaton->addState (2);
+    automaton->addState (3);
+    automaton->addArc (1, 2, Label (Sequence ('a'), Sequence ('b'), 1.5f));
+    automaton->addArc (1, 3, Label (Sequence ('c'), Sequence(), 2.5f));
+    automaton->addArc (2, 3, Label (Sequence(), Sequence ('a'), 3.5f));
+    automaton->setTerminalLabel (
+        forward, 1, TerminalLabel (Empty(), Empty(), 0.f));
+    automaton->setTerminalLabel (
+        backward, 3, TerminalLabel (Empty(), Empty(), 0.5f));
+
+    auto numbering = flipsta::numberStates (automaton);
+    auto frozen = flipsta::freeze (automaton, numbering);
+
+    checkSameArcs (*automaton, *frozen, numbering);
+
+    // The weights are in one contiguous array.
+    auto const & weights = frozen->labels().template component <2>();
+    static_assert (std::is_same <typename std::decay <decltype (weights)>::type,
+        std::vector <Weight>>::value, "");
+    BOOST_CHECK_EQUAL (weights.size(), 3u);
+    float total = 0;
+    for (Weight const & weight : weights)
+        total += weight.value();
+    BOOST_CHECK_EQUAL (total, 7.5f);
+
+    // Labels are put together again from their components.
+    for (std::size_t arc = 0; arc != frozen->arcNum(); ++ arc) {
+        BOOST_CHECK_EQUAL (
+            range::third (frozen->labels() [arc].components()).value(),
+            weights [arc].value());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_renumber_states
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/renumber_states.hpp"
+
+#include <memory>
+#include <type_traits>
+
+#include "range/walk_size.hpp"
+
+#include "flipsta/error.hpp"
+
+#include "example_automata.hpp"
+
+using range::first;
+using range::second;
+
+using flipsta::forward;
+using flipsta::backward;
+
+BOOST_AUTO_TEST_SUITE(test_suite_renumber_states)
+
+BOOST_AUTO_TEST_CASE (testNumberStates) {
+    std::shared_ptr <flipsta::Automaton <char, math::cost <float>>> automaton
+        = acyclicExample();
+
+    // The automaton is acyclic, and there is only one topological order.
+    {
+        auto numbering = flipsta::numberStates (automaton);
+        static_assert (std::is_same <decltype (numbering.denseState ('a')),
+            flipsta::Dense <std::uint32_t>>::value, "");
+
+        BOOST_CHECK_EQUAL (numbering.size(), 6u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('d').value(), 0u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('c').value(), 1u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('a').value(), 2u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('f').value(), 3u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('b').value(), 4u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('e').value(), 5u);
+
+        BOOST_CHECK_EQUAL (numbering.originalState (0), 'd');
+        BOOST_CHECK_EQUAL (numbering.originalState (5), 'e');
+
+        BOOST_CHECK (numbering.contains ('a'));
+        BOOST_CHECK (!numbering.contains ('q'));
+        BOOST_CHECK_THROW (numbering.denseState ('q'), flipsta::StateNotFound);
+        BOOST_CHECK_THROW (numbering.originalState (6), flipsta::StateNotFound);
+    }
+
+    // Backward, with a different index type.
+    {
+        auto numbering = flipsta::numberStates <std::uint16_t> (
+            automaton, backward);
+        static_assert (std::is_same <decltype (numbering.denseState ('a')),
+            flipsta::Dense <std::uint16_t>>::value, "");
+
+        BOOST_CHECK_EQUAL (numbering.size(), 6u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('e').value(), 0u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('b').value(), 1u);
+        BOOST_CHECK_EQUAL (numbering.denseState ('d').value(), 5u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testRenumberStates) {
+    typedef math::cost <float> Cost;
+    typedef flipsta::Dense <std::uint32_t> State;
+
+    std::shared_ptr <flipsta::Automaton <char, Cost>> automaton
+        = acyclicExample();
+
+    auto numbering = flipsta::numberStates (automaton);
+    auto renumbered = flipsta::renumberStates (automaton, numbering);
+
+    static_assert (std::is_same <
+        std::decay <decltype (*renumbered)>::type::State, State>::value,
+        "The states should be dense.");
+
+    BOOST_CHECK_EQUAL (range::walk_size (flipsta::states (*renumbered)), 6);
+
+    // Every arc goes from a lower to a higher state, and corresponds to an arc
+    // in the original automaton.
+    std::size_t arcNum = 0;
+    RANGE_FOR_EACH (state, flipsta::states (*renumbered)) {
+        RANGE_FOR_EACH (arc, flipsta::arcsOn (*renumbered, forward, state)) {
+            ++ arcNum;
+            BOOST_CHECK (arc.state (backward) < arc.state (forward));
+
+            char originalSource
+                = numbering.originalState (arc.state (backward));
+            char originalDestination
+                = numbering.originalState (arc.state (forward));
+            bool found = false;
+            RANGE_FOR_EACH (originalArc,
+                flipsta::arcsOn (*automaton, forward, originalSource))
+            {
+                if (originalArc.state (forward) == originalDestination) {
+                    found = true;
+                    BOOST_CHECK_EQUAL (originalArc.label().value(),
+                        arc.label().value());
+                }
+            }
+            BOOST_CHECK (found);
+        }
+    }
+    BOOST_CHECK_EQUAL (arcNum, 10u);
+
+    // The arc from 'd' to 'c'.
+    {
+        auto arcs = flipsta::arcsOn (*renumbered, forward, State (0));
+        BOOST_CHECK_EQUAL (range::walk_size (arcs), 2);
+        RANGE_FOR_EACH (arc, arcs) {
+            if (arc.state (forward) == State (1))
+                BOOST_CHECK_EQUAL (arc.label().value(), 5);
+            else {
+                BOOST_CHECK (arc.state (forward) == State (2));
+                BOOST_CHECK_EQUAL (arc.label().value(), 3);
+            }
+        }
+    }
+
+    // Terminal labels.
+    {
+        auto initialStates = flipsta::terminalStates (*renumbered, forward);
+        BOOST_CHECK_EQUAL (range::walk_size (initialStates), 1);
+        BOOST_CHECK (first (first (initialStates)) == State (0));
+        BOOST_CHECK_EQUAL (second (first (initialStates)).value(), 0);
+
+        auto finalStates = flipsta::terminalStates (*renumbered, backward);
+        BOOST_CHECK_EQUAL (range::walk_size (finalStates), 1);
+        BOOST_CHECK (first (first (finalStates)) == State (5));
+        BOOST_CHECK_EQUAL (second (first (finalStates)).value(), 1);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
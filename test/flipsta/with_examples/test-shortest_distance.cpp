@@ -21,7 +21,10 @@ limitations under the License.
 
 #include "math/arithmetic_magma.hpp"
 
+#include <map>
+
 #include "flipsta/automaton.hpp"
+#include "flipsta/frozen_automaton.hpp"
 
 #include "example_automata.hpp"
 
@@ -160,4 +163,117 @@ BOOST_AUTO_TEST_CASE (testAcyclicShortestDistance) {
     }
 }
 
+/**
+Check that the shortest distances on the frozen automaton, which uses a
+specialised kernel, are the same as those on the original automaton.
+*/
+template <class Direction, class Automaton, class Frozen, class Numbering>
+    void compareFrozen (Automaton const & automaton, Frozen const & frozen,
+        Numbering const & numbering, State initial)
+{
+    typedef math::cost <float> Cost;
+
+    std::map <State, Cost> reference;
+    RANGE_FOR_EACH (stateDistance,
+        shortestDistanceAcyclicFrom (automaton, initial, Direction()))
+        reference.insert (std::make_pair (
+            first (stateDistance), second (stateDistance)));
+
+    std::size_t count = 0;
+    RANGE_FOR_EACH (stateDistance, shortestDistanceAcyclicFrom (frozen,
+        numbering.denseState (initial), Direction()))
+    {
+        ++ count;
+        State state = numbering.originalState (first (stateDistance));
+        BOOST_CHECK_EQUAL (second (stateDistance), reference [state]);
+    }
+    BOOST_CHECK_EQUAL (count, reference.size());
+}
+
+BOOST_AUTO_TEST_CASE (testAcyclicShortestDistanceFrozen) {
+    auto automaton = utility::shared_from_unique (acyclicExample());
+    auto numbering = flipsta::numberStates (automaton);
+    auto frozen = utility::shared_from_unique (
+        flipsta::freeze (automaton, numbering));
+
+    for (State initial : {'a', 'b', 'c', 'd', 'e', 'f'}) {
+        compareFrozen <flipsta::Forward> (
+            automaton, frozen, numbering, initial);
+        compareFrozen <flipsta::Backward> (
+            automaton, frozen, numbering, initial);
+    }
+
+    // Start from more than one state.
+    {
+        typedef math::cost <float> Cost;
+        typedef flipsta::Dense <std::uint32_t> DenseState;
+        std::vector <std::pair <DenseState, Cost>> start;
+        start.push_back (std::make_pair (numbering.denseState ('d'), Cost (0)));
+        start.push_back (std::make_pair (numbering.denseState ('c'), Cost (3)));
+
+        std::map <State, Cost> reference;
+        reference ['d'] = Cost (0);
+        reference ['c'] = Cost (3);
+        reference ['a'] = Cost (3);
+        reference ['f'] = Cost (9);
+        reference ['b'] = Cost (7);
+        reference ['e'] = Cost (5);
+
+        RANGE_FOR_EACH (stateDistance,
+            shortestDistanceAcyclic (frozen, start, forward))
+        {
+            BOOST_CHECK_EQUAL (second (stateDistance), reference [
+                numbering.originalState (first (stateDistance))]);
+        }
+    }
+}
+
+/**
+Check that the shortest distances are the same when scratch memory is borrowed
+from a workspace, also when it is reused for a different automaton.
+*/
+template <class AutomatonPtr, class InitialState>
+    void compareWorkspace (AutomatonPtr const & automaton,
+        InitialState const & initial, flipsta::Workspace & workspace)
+{
+    auto reference = shortestDistanceAcyclicFrom (automaton, initial, forward);
+    auto distances = shortestDistanceAcyclicFrom (
+        automaton, initial, forward, workspace);
+    while (!empty (reference)) {
+        BOOST_CHECK (!empty (distances));
+        if (empty (distances))
+            return;
+        auto d = chop_in_place (distances);
+        auto r = chop_in_place (reference);
+        BOOST_CHECK_EQUAL (first (d), first (r));
+        BOOST_CHECK_EQUAL (second (d), second (r));
+    }
+    BOOST_CHECK (empty (distances));
+}
+
+BOOST_AUTO_TEST_CASE (testAcyclicShortestDistanceWorkspace) {
+    auto automaton = utility::shared_from_unique (acyclicExample());
+    auto numbering = flipsta::numberStates (automaton);
+    auto frozen = utility::shared_from_unique (
+        flipsta::freeze (automaton, numbering));
+
+    auto larger = utility::shared_from_unique (acyclicExample());
+    larger->addState ('g');
+    larger->addArc ('e', 'g', math::cost <float> (4));
+
+    flipsta::Workspace workspace;
+    for (State initial : {'a', 'b', 'c', 'd', 'e', 'f'}) {
+        compareWorkspace (automaton, initial, workspace);
+        compareWorkspace (larger, initial, workspace);
+        compareWorkspace (frozen, numbering.denseState (initial), workspace);
+    }
+
+    // An exception must leave the workspace in a usable state.
+    auto cyclic = utility::shared_from_unique (acyclicExample());
+    cyclic->addArc ('e', 'd', math::cost <float> (1));
+    BOOST_CHECK_THROW (shortestDistanceAcyclicFrom (
+        cyclic, 'd', forward, workspace), AutomatonNotAcyclic);
+    compareWorkspace (automaton, 'd', workspace);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+/*
+Copyright 2015 Rogier van Dalen.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#define BOOST_TEST_MODULE test_flipsta_shortest_distance_batch
+#include "utility/test/boost_unit_test.hpp"
+
+#include "flipsta/shortest_distance_batch.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "range/std/container.hpp"
+
+#include "flipsta/automaton.hpp"
+
+#include "example_automata.hpp"
+
+using flipsta::forward;
+using flipsta::backward;
+using flipsta::AutomatonNotAcyclic;
+
+BOOST_AUTO_TEST_SUITE(test_suite_shortest_distance_batch)
+
+typedef math::cost <float> Cost;
+typedef flipsta::Automaton <char, Cost> Automaton;
+
+/**
+Make automata of different sizes, by adding a chain of states of a different
+length to each copy of acyclicExample.
+*/
+std::vector <std::shared_ptr <Automaton>> makeAutomata (int number) {
+    std::vector <std::shared_ptr <Automaton>> automata;
+    for (int index = 0; index != number; ++ index) {
+        std::shared_ptr <Automaton> automaton (acyclicExample());
+        automaton->setTerminalLabel (forward, 'd', Cost (float (index)));
+        char previous = 'e';
+        for (int extra = 0; extra != index % 7; ++ extra) {
+            char state = char ('g' + extra);
+            automaton->addState (state);
+            automaton->addArc (previous, state, Cost (float (extra)));
+            previous = state;
+        }
+        automata.push_back (automaton);
+    }
+    return automata;
+}
+
+template <class Direction> void compareWithSequential (
+    std::vector <std::shared_ptr <Automaton>> const & automata,
+    Direction direction)
+{
+    for (std::size_t threadNum : {1, 2, 5, 0}) {
+        auto results = flipsta::shortestDistanceBatch (
+            automata, direction, threadNum);
+        BOOST_CHECK_EQUAL (results.size(), automata.size());
+
+        for (std::size_t index = 0; index != automata.size(); ++ index) {
+            auto const & automaton = automata [index];
+            auto reference = flipsta::shortestDistanceAcyclic (automaton,
+                flipsta::terminalStates (automaton, direction), direction);
+            auto const & result = results [index];
+            for (auto const & distance : result) {
+                BOOST_CHECK (!range::empty (reference));
+                if (range::empty (reference))
+                    break;
+                auto expected = range::chop_in_place (reference);
+                BOOST_CHECK_EQUAL (distance.first, range::first (expected));
+                BOOST_CHECK_EQUAL (distance.second, range::second (expected));
+            }
+            BOOST_CHECK (range::empty (reference));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE (testShortestDistanceBatch) {
+    auto automata = makeAutomata (50);
+    compareWithSequential (automata, forward);
+    compareWithSequential (automata, backward);
+
+    // Empty batch.
+    std::vector <std::shared_ptr <Automaton>> none;
+    BOOST_CHECK (flipsta::shortestDistanceBatch (none, forward).empty());
+}
+
+BOOST_AUTO_TEST_CASE (testShortestDistanceBatchCyclic) {
+    auto automata = makeAutomata (20);
+    automata [13]->addArc ('e', 'd', Cost (1));
+    for (std::size_t threadNum : {1, 4})
+        BOOST_CHECK_THROW (
+            flipsta::shortestDistanceBatch (automata, forward, threadNum),
+            AutomatonNotAcyclic);
+}
+
+BOOST_AUTO_TEST_SUITE_END()